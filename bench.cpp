@@ -0,0 +1,261 @@
+/***************************************************************************/
+/*                                                                         */
+/* BENCH.CPP,                                                              */
+/*     a sample file for use with the FrontDoor Nodelist Code              */
+/*                                                                         */
+/* (c) 1997,1998 Colin Turner                                              */
+/*                                                                         */
+/* Please see FDNODE.DOC for details on the conditions attached to this    */
+/* code.                                                                   */
+/*                                                                         */
+/***************************************************************************/
+/*                                                                         */
+/* Times lookups made one after another against the same lookups made by   */
+/* FDNBatch, driven by Poll() as from a program's own loop, with 1, 16, 64 */
+/* and 256 lookups pending at once.                                        */
+/*                                                                         */
+/***************************************************************************/
+
+#include "fdnbatch.h"   // Nodelist class and batch declarations
+#include "ctl.h"        // FrontDoor SETUP.FD structure
+#include <stdio.h>
+#include <time.h>
+
+#define BENCHMAX        4000          // Addresses looked up in each test
+
+
+// A lookup which, once complete, starts the next one in its place
+
+class BenchLookup : public FDNNodeLookup {
+
+  public :
+
+    BenchLookup(unsigned short zone, unsigned short net, unsigned short node) : FDNNodeLookup(zone, net, node, 0) {}
+
+    virtual   void  Complete();
+};
+
+
+// Prototypes
+
+void            main(int argc, char *argv[]);
+void            PrintBanner();
+void            ReadFD(void);
+void            GatherAddresses(void);
+void            TimeSingle(void);
+void            TimeBatch(int Concurrency);
+void            StartNext(void);
+void            PrintRate(char * Title, long Count, clock_t Taken);
+
+
+char NAME[]="FDNode Bench";
+char VERSION[]="1.00";
+char FDNodelistDir[72]="";
+
+// The base class is used deliberately, so that the timings reflect reads
+// from the index files rather than from a page cache.
+FrontDoorNode * Nodelist;
+FDNBatch * Batch;
+
+unsigned short (*Address)[3];
+int Addresses, NextAddress;
+long Matches;
+
+void main(int argc, char *argv[])
+{
+  ReadFD();
+  PrintBanner();
+
+  // As in COMPILE.CPP, the nodelist directory may be overridden for testing.
+  if(argc==2) strcpy(FDNodelistDir, argv[1]);
+
+  Nodelist = new FrontDoorNode(FDNodelistDir, "", 0, 0);
+  Address = new unsigned short[BENCHMAX][3];
+  if(!Nodelist || !Address){
+    printf("\nMemory allocation error");
+    exit(10);
+  }
+  if(Nodelist->IsFrozen()){
+    printf("\nError opening nodelist indices (error %d).", Nodelist->GetError());
+    printf("\nEither run this program in the nodelist directory, the FD system\nDirectory, or correctly set the FD environment variable.\n\n");
+    exit(1);
+  }
+
+  GatherAddresses();
+  printf("\nFD nodelist in %s, %d addresses\n\n", FDNodelistDir, Addresses);
+
+  TimeSingle();
+  TimeBatch(1);
+  TimeBatch(16);
+  TimeBatch(64);
+  TimeBatch(256);
+
+  delete[] Address;
+  delete Nodelist;
+}
+
+
+void PrintBanner()
+{
+  printf("\nFrontDoor (TM) Nodelist Lookup Benchmark, Version %s\nColin Turner, 2:443/13.0\nCompiled at %s on %s\n", VERSION, __TIME__, __DATE__);
+}
+
+
+/*
+**    GatherAddresses
+**
+** Lists the nodes of each net of each zone, up to BENCHMAX of them.
+**
+**/
+void GatherAddresses(void)
+{
+  FDNFind Zones, Nets, Nodes;
+
+  Addresses = 0;
+  Nodelist->GetZones(Zones);
+  while(Zones && Addresses<BENCHMAX){
+    Nodelist->GetNets(Nets, Zones.GetZone());
+    while(Nets && Addresses<BENCHMAX){
+      Nodelist->GetNodes(Nodes, Zones.GetZone(), Nets.GetNet());
+      while(Nodes && Addresses<BENCHMAX){
+        Address[Addresses][0] = Zones.GetZone();
+        Address[Addresses][1] = Nets.GetNet();
+        Address[Addresses][2] = Nodes.GetNode();
+        Addresses++;
+        ++Nodes;
+      }
+      ++Nets;
+    }
+    ++Zones;
+  }
+}
+
+
+/*
+**    TimeSingle
+**
+** Looks up each address and its sysop, one after another.
+**
+**/
+void TimeSingle(void)
+{
+  FDNFind Match;
+  clock_t Start;
+  int loop;
+
+  Matches = 0;
+  Start = clock();
+  for(loop=0; loop<Addresses; loop++){
+    if(!Nodelist->Find(Match, Address[loop][0], Address[loop][1], Address[loop][2], 0)){
+      if(Nodelist->GetSysop(Match)) Matches++;
+    }
+  }
+  PrintRate("One at a time", Matches, clock() - Start);
+}
+
+
+/*
+**    TimeBatch
+**
+** Looks up each address and its sysop with a batch, keeping Concurrency
+** lookups pending until the addresses run out.
+**
+**/
+void TimeBatch(int Concurrency)
+{
+  char Title[40];
+  clock_t Start;
+  int loop;
+
+  Batch = new FDNBatch(*Nodelist, Concurrency);
+  if(!Batch){
+    printf("\nMemory allocation error");
+    exit(10);
+  }
+  Matches = 0;
+  NextAddress = 0;
+  Start = clock();
+  for(loop=0; loop<Concurrency; loop++) StartNext();
+
+  // A program would do its other work between polls
+  while(Batch->Poll(0));
+
+  sprintf(Title, "Batch of %d", Concurrency);
+  PrintRate(Title, Matches, clock() - Start);
+  printf("      %ld rounds, %ld reads\n", Batch->GetRounds(), Batch->GetReads());
+  delete Batch;
+}
+
+
+void StartNext(void)
+{
+  BenchLookup * Lookup;
+
+  if(NextAddress>=Addresses) return;
+  Lookup = new BenchLookup(Address[NextAddress][0], Address[NextAddress][1], Address[NextAddress][2]);
+  if(!Lookup) return;
+  NextAddress++;
+  if(!Batch->Add(*Lookup)) delete Lookup;
+}
+
+
+void BenchLookup::Complete()
+{
+  if(Found && *Sysop) Matches++;
+  StartNext();
+  delete this;
+}
+
+
+void PrintRate(char * Title, long Count, clock_t Taken)
+{
+  double Seconds = (double) Taken / CLOCKS_PER_SEC;
+
+  if(Seconds>0) printf("(+) %-14s : %6ld found, %8.0f lookups a second\n", Title, Count, Count / Seconds);
+  else printf("(+) %-14s : %6ld found, too quick to time\n", Title, Count);
+}
+
+
+/*
+**    ReadFD
+**
+** A highly non-sophisticated function which reads the NodelistDir from the
+** SETUP.FD FrontDoor configuration file.
+**
+** NO Macro Expansion is performed.
+**
+**/
+void ReadFD(void)
+{
+  FILE *fp;
+  char filename[72]="";
+  struct _ctl *fdsetup;
+
+  fdsetup = new _ctl;
+  if(!fdsetup){
+         printf("\nUnable to allocate memory for SETUP.FD\n");
+         exit(11);
+  }
+  if(getenv("FD")){
+         strcpy(filename, getenv("FD"));
+         if(filename[strlen(filename)-1]!='\\') strcat(filename, "\\");
+         strcat(filename,"SETUP.FD");
+  }
+  else strcpy(filename, "SETUP.FD");
+  fp=_fsopen(filename,"rb",SH_DENYWR);
+  if(fp){
+
+    if((fread(fdsetup,sizeof(struct _ctl),1,fp))!=1) printf("\n SETUP.FD read error (structure packing in compiler?)\n");
+    fclose(fp);
+
+    strcpy(FDNodelistDir, fdsetup->s.nodelistpath);
+
+  }
+  else{
+    printf("\nSETUP.FD must be in the current directory, or pointed to by\nan FD environment variable\n");
+    delete fdsetup;
+    exit(11);
+  }
+  delete fdsetup;
+
+}
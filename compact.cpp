@@ -0,0 +1,145 @@
+/***************************************************************************/
+/*                                                                         */
+/* COMPACT.CPP,                                                            */
+/*     a sample file for use with the FrontDoor Nodelist Write Code        */
+/*                                                                         */
+/* (c) 1997,1998 Colin Turner                                              */
+/*                                                                         */
+/* Please see FDNODE.DOC for details on the conditions attached to this    */
+/* code.                                                                   */
+/*                                                                         */
+/***************************************************************************/
+/*                                                                         */
+/* Rewrites an existing index set into fully packed pages, laid out        */
+/* breadth first, and reports the effect. Run it after a compile, or after */
+/* a series of incremental updates.                                        */
+/*                                                                         */
+/***************************************************************************/
+
+#include "fdnode.h"     // Nodelist class declarations
+#include "ctl.h"        // FrontDoor SETUP.FD structure
+#include <stdio.h>
+
+
+// Prototypes
+
+void            main(int argc, char *argv[]);
+void            PrintBanner();
+void            ReadFD(void);
+void            CompactIndex(char Index, char * Name);
+
+
+char NAME[]="FDWNode Compact";
+char VERSION[]="1.03";
+char FDNodelistDir[72]="";
+unsigned short Country;
+
+// The base class is used deliberately, so that the lookup timings reflect
+// reads from the index files rather than from a page cache.
+FrontDoorWNode * Nodelist;
+
+void main(int argc, char *argv[])
+{
+  ReadFD();
+  PrintBanner();
+
+  // As in COMPILE.CPP, the nodelist directory may be overridden for testing.
+  if(argc==2) strcpy(FDNodelistDir, argv[1]);
+
+  // Open the existing index set for update, keeping the current extension
+  Nodelist = new FrontDoorWNode(FDNodelistDir, "CUR", Country, 0);
+  if(!Nodelist){
+    printf("\nMemory allocation error");
+    exit(10);
+  }
+
+  printf("\nFD nodelist in %s\n\n", FDNodelistDir);
+
+  if(Nodelist->IsFrozen()){
+    printf("\nError opening nodelist indices (error %d).", Nodelist->GetError());
+    printf("\nEither run this program in the nodelist directory, the FD system\nDirectory, or correctly set the FD environment variable.\n\n");
+    exit(1);
+  }
+
+  CompactIndex(NFDXIndex, "NODELIST.FDX");
+  CompactIndex(UFDXIndex, "USERLIST.FDX");
+  CompactIndex(PFDXIndex, "PHONE.FDX");
+  delete Nodelist;
+}
+
+
+void PrintBanner()
+{
+  printf("\nFrontDoor (TM) NodeList Index Compactor, Version %s\nColin Turner, 2:443/13.0\nCompiled at %s on %s\n", VERSION, __TIME__, __DATE__);
+}
+
+
+/*
+**    CompactIndex
+**
+** Compacts one index and prints the before and after figures. Lookup times
+** are for a root to leaf descent for every key in the index.
+**
+**/
+void CompactIndex(char Index, char * Name)
+{
+  FDWNCompactReport Report;
+
+  printf("(+) Compacting %s\n", Name);
+  if(!Nodelist->Compact(Index, Report)){
+    printf("(!) Compaction failed, error %d\n", Nodelist->GetError());
+    return;
+  }
+  printf("  - Before : %7ld bytes, height %d, %5ld pages, fill %3d%%, lookups %6lu ms\n",
+         Report.BytesBefore, Report.Before.Height, Report.Before.Pages, Report.Before.FillFactor,
+         (unsigned long) ((Report.ProbeBefore * 1000.0) / CLOCKS_PER_SEC));
+  printf("  - After  : %7ld bytes, height %d, %5ld pages, fill %3d%%, lookups %6lu ms\n",
+         Report.BytesAfter, Report.After.Height, Report.After.Pages, Report.After.FillFactor,
+         (unsigned long) ((Report.ProbeAfter * 1000.0) / CLOCKS_PER_SEC));
+}
+
+
+/*
+**    ReadFD
+**
+** A highly non-sophisticated function which reads the NodelistDir from the
+** SETUP.FD FrontDoor configuration file.
+**
+** NO Macro Expansion is performed.
+**
+**/
+void ReadFD(void)
+{
+  FILE *fp;
+  char filename[72]="";
+  struct _ctl *fdsetup;
+
+  fdsetup = new _ctl;
+  if(!fdsetup){
+         printf("\nUnable to allocate memory for SETUP.FD\n");
+         exit(11);
+  }
+  if(getenv("FD")){
+         strcpy(filename, getenv("FD"));
+         if(filename[strlen(filename)-1]!='\\') strcat(filename, "\\");
+         strcat(filename,"SETUP.FD");
+  }
+  else strcpy(filename, "SETUP.FD");
+  fp=_fsopen(filename,"rb",SH_DENYWR);
+  if(fp){
+
+    if((fread(fdsetup,sizeof(struct _ctl),1,fp))!=1) printf("\n SETUP.FD read error (structure packing in compiler?)\n");
+    fclose(fp);
+
+    strcpy(FDNodelistDir, fdsetup->s.nodelistpath);
+    Country = fdsetup->s.countrycode;
+
+  }
+  else{
+    printf("\nSETUP.FD must be in the current directory, or pointed to by\nan FD environment variable\n");
+    delete fdsetup;
+    exit(11);
+  }
+  delete fdsetup;
+
+}
@@ -18,31 +18,177 @@
 #include "fdnode.h"     // Nodelist class declarations
 #include "fdwcache.h"   // Cached Write Class, much faster
 #include "ctl.h"        // FrontDoor SETUP.FD structure
+#include "fdnarc.h"     // Nodelists from ZIP archives
 #include <dos.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <conio.h>
+#include <time.h>
 
 // Comment this to use the base class only
 
 #define CacheOn
 
+// Comment this to parse nodelists on the main thread only. Otherwise large
+// nodelists are split at Host lines and the pieces parsed on several
+// threads, where the platform has them. The index itself is always built
+// by the main thread.
+
+#define ThreadsOn
+
+// Uncomment this to build the index set in a directory of its own and
+// publish it once it is finished, so that FrontDoorNode readers carry on
+// with the old set rather than freezing while the compile runs. FrontDoor
+// itself knows nothing of this, and reads the nodelist directory only.
+
+//#define PublishOn
+
+#ifdef PublishOn
+#define PUBLISH WFDNodePublish
+#else
+#define PUBLISH 0
+#endif
+
+// Comment this out to stop the sum of each index page being written when
+// the compile finishes. The sums let programs with a page cache keep the
+// pages the compile did not change.
+
+#define SumsOn
+
+#ifdef SumsOn
+#define SUMS WFDNodeChecksum
+#else
+#define SUMS 0
+#endif
+
+#if defined(ThreadsOn) && defined(__NT__)
+#define ParallelParse
+#include <windows.h>
+#elif defined(ThreadsOn) && defined(__OS2__)
+#define ParallelParse
+#define INCL_DOSPROCESS
+#include <os2.h>
+#endif
+
+
+// The state of the nodelist parser, carried from one line to the next.
+// RouteNet and RouteNode are the routing for the entry on the line just
+// parsed, the others the context which later lines inherit.
+
+struct NodeContext {
+  unsigned short Zone, Region, Net, Hub, Node, Point;
+  unsigned short RNet, RNode;
+  unsigned short RouteNet, RouteNode;
+  char           Status;
+};
+
+// An entry of a NODEDIFF waiting to be added, once all removals are done
+
+struct PendingEntry {
+  NodeContext    Context;
+  long           Offset;
+};
+
+// A nodelist being read a large block at a time, rather than a line at a
+// time through the C library. Lines are terminated where they lie in the
+// block and handed back in place, and the offset of a line in the file is
+// simply where the block began plus how far into it the line lies. The
+// file is read in binary mode, so offsets no longer rely on text mode
+// line ends. A nodelist may instead be unpacked from an archive as it is
+// read, and written out to the file its offsets will refer to.
+
+#if defined(__DOS__) && !defined(__386__)
+#define NODEBLOCK 32768U
+#else
+#define NODEBLOCK 262144U
+#endif
+
+struct NodeReader {
+  FILE *         File;
+  FDNArchive *   Archive;       // If reading from an archive instead
+  FILE *         Copy;          // Where the data from the archive is written
+  char *         Block;
+  unsigned       Size;          // Bytes held in Block
+  unsigned       Next;          // Where in Block the next line starts
+  long           Base;          // Offset in the file of the start of Block
+  int            End;           // Set once the file is exhausted
+  int            Error;         // The copy could not be written
+};
+
+#ifdef ParallelParse
+
+// The most pieces a nodelist is split into, and the most of them which
+// are parsed at once
+
+#define NODECHUNKS  64
+#define NODETHREADS 8
+
+// An entry parsed from a piece of a nodelist, waiting to be added
+
+struct ParsedEntry {
+  NodeContext    Context;
+  char *         Name;          // As returned by ParseNodeLine()
+  long           Offset;
+  unsigned long  Number;        // Line number within the piece
+};
+
+// A piece of a nodelist, which starts at a Host line (or at the start of
+// the file). A Host line sets all of the parser context but the zone and
+// region, so these are taken from the end of the piece before once all
+// the pieces are parsed. ZoneFrom and RegionFrom count the entries
+// parsed before the first line of the piece which set them, or are -1.
+
+struct NodeChunk {
+  char *         Start;
+  char *         End;
+  long           Base;          // Offset in the file of Start
+  NodeContext    Context;       // The parser state at the end of the piece
+  ParsedEntry *  Entries;
+  long           Count;
+  long           ZoneFrom;
+  long           RegionFrom;
+  unsigned long  Lines;
+  int            Error;         // The entries could not be allocated
+  int            Eof;           // An end of file marker was found
+  clock_t        Ticks;         // Time taken to parse the piece
+};
+
+#endif
+
 
 // Prototypes
 
 void            main(int argc, char *argv[]);
 void            PrintBanner();
+void            PrintTreeQuality(char Index, char * Name);
 
 void            ReadFD(void);
+unsigned long   HashFile(char * Filename);
 
 char *          ReadControlLine(FILE * fp, char * buffer);
+int             OpenNodeReader(NodeReader & Reader, char * Filename, char * Archive);
+char *          ReadNodeLine(NodeReader & Reader, long & Offset);
+int             CloseNodeReader(NodeReader & Reader);
 
+void            ProcessControlFile(int Tables);
 void            ProcessDialTable(char * Defaults, FILE * control);
 void            ProcessCostTable(FILE * control);
-void            ProcessNodeFile(char * Filename, long int Whence);
-void            ProcessPointFile(char * Filename);
+long            ProcessNodeFile(char * Filename, long int Whence, char * Archive);
+char *          ParseNodeLine(char * p, NodeContext & Context);
+#ifdef ParallelParse
+long            ProcessNodeChunks(char * Filename, long int Whence, char * Archive);
+char *          LoadNodeFile(char * Filename, char * Archive, long & Size);
+void            ParseNodeChunk(NodeChunk & Chunk);
+void            AddNodeEntries(ParsedEntry * Entries, long Count, long int Whence);
+#endif
+void            AddNodeLine(NodeContext & Context, char * p, long int Whence, long Offset);
+void            DeleteNodeLine(NodeContext & Context, char * p);
+void            MoveNodeLine(NodeContext & Context, char * p, long Offset);
+int             ApplyNodeDiff(unsigned short OldExt, unsigned short & NewExt, unsigned long * Hash, unsigned long ControlHash);
+long            ProcessPointFile(char * Filename);
 
 unsigned short  GetNodelistDetails(char * stem, char * buffer);
+unsigned short  GetArchiveDetails(char * stem, char * buffer, unsigned long & Crc);
 int             AddToPrivate(char * Parameter);
 int             AddToPoint(char * Parameter);
 
@@ -56,6 +202,9 @@ char FDNodelistDir[72]="";
 char FDSemaphoreDir[72]="";
 unsigned short Country;
 char Buffer[1024];
+long Shadowed;      // Entries which replaced those of an earlier list
+long Assembled;     // Bytes copied into FDNET.PVT and FDPOINT.PVT
+clock_t Assembling; // and the time taken
 
 // Global write nodelist class
 #ifdef CacheOn
@@ -66,12 +215,16 @@ FrontDoorWNode * Nodelist;
 
 void main(int argc, char *argv[])
 {
-  unsigned short ExtInt;
+  unsigned short ExtInt, PackedExt, DiffExt;
   char NLExt[5];
-  int  quit=0;
   char stuff[72];
-  char * p;
-  FILE * control;
+  char Source[3][72];
+  char Packed[72];
+  long Whence[3] = { WFDNOfficial, WFDNPrivate, WFDNPoint };
+  unsigned long Hash[3];
+  unsigned long ControlHash, PackedHash;
+  int  First, loop;
+  FDWNSegment Segment;
   
   // Get the FrontDoor config information we need.
   ReadFD();
@@ -87,17 +240,123 @@ void main(int argc, char *argv[])
 
   sprintf(stuff, "%sNODELIST.*", FDNodelistDir);
   ExtInt = GetNodelistDetails(stuff, NULL);
+
+  // A newer nodelist may have arrived in an archive, in which case it is
+  // unpacked as it is compiled, rather than beforehand.
+  sprintf(stuff, "%sNODELIST.Z*", FDNodelistDir);
+  PackedExt = GetArchiveDetails(stuff, Packed, PackedHash);
+  if((PackedExt != 0xFFFFU) && ((ExtInt == 0xFFFFU) || (PackedExt > ExtInt))) ExtInt = PackedExt;
+  else *Packed = 0;
+
+  // Build FDNET.PVT and FDPOINT.PVT from the lists named in FDNODE.CTL,
+  // before anything else, so that a NODEDIFF is only applied in place to
+  // an index set compiled from them as they are now
+  sprintf(stuff, "%sFDNET.PVT", FDNodelistDir);
+  remove(stuff);
+  sprintf(stuff, "%sFDPOINT.PVT", FDNodelistDir);
+  remove(stuff);
+  ProcessControlFile(0);
+  if(Assembled){
+    printf("  - %ld bytes of private lists in %.2fs", Assembled, (double) Assembling / CLOCKS_PER_SEC);
+    if(Assembling) printf(" (%.0fK/s)", (double) Assembled * CLOCKS_PER_SEC / Assembling / 1024);
+    printf("\n");
+  }
+
+  // Hash each of the lists, and FDNODE.CTL itself, to see what has
+  // changed since the index set was compiled
+  if(ExtInt != 0xFFFFU) sprintf(Source[0], "%sNODELIST.%03u", FDNodelistDir, ExtInt);
+  else *Source[0] = 0;
+  sprintf(Source[1], "%sFDNET.PVT", FDNodelistDir);
+  sprintf(Source[2], "%sFDPOINT.PVT", FDNodelistDir);
+  for(loop = 0; loop < 3; loop++) Hash[loop] = HashFile(Source[loop]);
+  if(*Packed) Hash[0] = PackedHash ? PackedHash : 1;
+  sprintf(stuff, "%sFDNODE.CTL", FDNodelistDir);
+  ControlHash = HashFile(stuff);
+
+  // If a NODEDIFF has arrived for the nodelist the index set was built
+  // from, apply it, and to the index set too if it can be, rather than
+  // compiling from scratch.
+  if((ExtInt != 0xFFFFU) && !*Packed){
+    switch(ApplyNodeDiff(ExtInt, DiffExt, Hash, ControlHash)){
+      case 2 :
+        printf("(+) Index quality\n");
+        PrintTreeQuality(NFDXIndex, "NODELIST.FDX");
+        PrintTreeQuality(UFDXIndex, "USERLIST.FDX");
+        PrintTreeQuality(PFDXIndex, "PHONE.FDX");
+        delete Nodelist;
+        return;
+      case 1 :
+        ExtInt = DiffExt;
+        sprintf(Source[0], "%sNODELIST.%03u", FDNodelistDir, ExtInt);
+        Hash[0] = HashFile(Source[0]);
+        break;
+    }
+  }
+
+  // A list which is there but cannot be read (still being written, say)
+  // must not be left out of the index set
+  for(loop = 0; loop < 3; loop++){
+    if(!Hash[loop] && *Source[loop] && CheckFile(Source[loop])){
+      printf("(!) Unable to read %s\n", Source[loop]);
+      exit(3);
+    }
+  }
+
   if(ExtInt == 0xFFFFU) sprintf(NLExt, "PVT");
   else sprintf(NLExt, "%03u", ExtInt);
 
+  // If the existing index set was compiled from the same FDNODE.CTL, only
+  // the first list which has changed, and those after it (whose entries
+  // take precedence), need compiling again. Otherwise start from scratch.
+  First = 0;
   #ifdef CacheOn
-  // If you're loading with some sort of cache, and need to override the OnThaw()
-  // function, you must NOT expect the class to be thawed for you.
-  // Alternatively, build this into the derived constructor
-  Nodelist = new FDWCachedNode(FDNodelistDir, NLExt, Country, WFDNodeOverWrite);
-  #else  
-  Nodelist = new FrontDoorWNode(FDNodelistDir, NLExt, Country, WFDNodeOverWrite);
+  Nodelist = new FDWCachedNode(FDNodelistDir, NLExt, Country, WFDNodeWriteBehind | PUBLISH | SUMS);
+  #else
+  Nodelist = new FrontDoorWNode(FDNodelistDir, NLExt, Country, PUBLISH | SUMS);
   #endif
+  if(Nodelist && !Nodelist->IsFrozen()){
+    Nodelist->GetSegment(WFDNInternal, Segment);
+    if(Segment.Hash == ControlHash){
+      for(First = 0; First < 3; First++){
+        Nodelist->GetSegment(Whence[First], Segment);
+        if(Segment.Hash != Hash[First]) break;
+      }
+      // Removing entries which replaced those of an earlier list would
+      // lose the earlier ones too
+      for(loop = First; loop < 3; loop++){
+        Nodelist->GetSegment(Whence[loop], Segment);
+        if(Segment.Shadowed) First = 0;
+      }
+    }
+  }
+  // The official list must be unpacked, even if it is no different
+  if(*Packed) First = 0;
+
+  // With nothing to compile, the index set is not published again, so
+  // that readers keep their caches of it
+  if(First == 3){
+    printf("(+) No lists have changed\n");
+    Nodelist->Discard();
+    delete Nodelist;
+    return;
+  }
+
+  if(!First){
+    if(Nodelist){
+      Nodelist->Discard();
+      delete Nodelist;
+    }
+    #ifdef CacheOn
+    // If you're loading with some sort of cache, and need to override the OnThaw()
+    // function, you must NOT expect the class to be thawed for you.
+    // Alternatively, build this into the derived constructor.
+    // Pages are not written behind here, since files built in memory only
+    // reach the disk when they are closed
+    Nodelist = new FDWCachedNode(FDNodelistDir, NLExt, Country, WFDNodeOverWrite | WFDNodeInMemory | PUBLISH | SUMS);
+    #else  
+    Nodelist = new FrontDoorWNode(FDNodelistDir, NLExt, Country, WFDNodeOverWrite | WFDNodeInMemory | PUBLISH | SUMS);
+    #endif
+  }
   if(!Nodelist){
     printf("\nMemory allocation error");
     exit(10);
@@ -111,44 +370,44 @@ void main(int argc, char *argv[])
     exit(1);
   }
 
-  // The following line is reasonably technical and should be avoided unless
-  // you understand what it does. Essentially it tailors the NODELIST.FDX
-  // adding a little which results in slightly smaller index files when you
-  // add nodelist files in approximately zone order
-  Nodelist->SetTreeFlags(NFDXIndex, 0, 24);
-
-  sprintf(stuff, "%sFDNODE.CTL", FDNodelistDir);
-  control=_fsopen(stuff, "r", SH_DENYRW);
-  if(!control){
-    perror("Unable to open FDNODE.CTL");
-    quit=1;
-  }
-
-  sprintf(stuff, "%sFDNET.PVT", FDNodelistDir);
-  remove(stuff);
-  sprintf(stuff, "%sFDPOINT.PVT", FDNodelistDir);
-  remove(stuff);
-  
-  while(!quit){
-    p = ReadControlLine(control, Buffer);
-    if(!p) quit=1;
-    else{
-      if(!strnicmp(p, "PVTLIST", 7))   AddToPrivate(p+7);
-      if(!strnicmp(p, "POINTLIST", 9)) AddToPoint(p+9);
-      if(!strnicmp(p, "DIAL", 4))      ProcessDialTable(p+4, control);
-      if(!strnicmp(p, "COST", 4))      ProcessCostTable(control);
+  // The following lines are reasonably technical and should be avoided
+  // unless you understand what they do. Essentially they tailor the
+  // splitting of each index so that runs of ascending keys (nodelist files
+  // added in approximately zone order) leave full pages behind, while
+  // random additions still split in the middle. The library does not do
+  // this unless asked, so that existing index layouts are unchanged.
+  Nodelist->SetTreeFlags(NFDXIndex, WFDNodeAdaptSplit, 16);
+  Nodelist->SetTreeFlags(UFDXIndex, WFDNodeAdaptSplit, 16);
+  Nodelist->SetTreeFlags(PFDXIndex, WFDNodeAdaptSplit, 16);
+
+  // PHONE.FDX only changes with FDNODE.CTL
+  if(!First) ProcessControlFile(1);
+  else printf("(+) FDNODE.CTL unchanged, compiling changed lists only\n");
+
+  for(loop = First; loop < 3; loop++){
+    if(First){
+      printf("(+) Removing entries from %s\n", Source[loop]);
+      printf("  - %ld records removed\n", Nodelist->DeleteSegment(Whence[loop]));
+    }
+    memset(&Segment, 0, sizeof(FDWNSegment));
+    if(Hash[loop]){
+      Shadowed = 0;
+      if(Whence[loop] == WFDNPoint) Segment.Entries = ProcessPointFile(Source[loop]);
+      else Segment.Entries = ProcessNodeFile(Source[loop], Whence[loop], (!loop && *Packed) ? Packed : NULL);
+      Segment.Hash     = Hash[loop];
+      Segment.Shadowed = Shadowed;
     }
+    Nodelist->SetSegment(Whence[loop], Segment);
   }
-  fclose(control);
 
-  if(ExtInt != 0xFFFFU){
-    sprintf(stuff, "%sNODELIST.%03u", FDNodelistDir, ExtInt);
-    ProcessNodeFile(stuff, WFDNOfficial);
-  }
-  sprintf(stuff, "%sFDNET.PVT", FDNodelistDir);
-  ProcessNodeFile(stuff, WFDNPrivate);
-  sprintf(stuff, "%sFDPOINT.PVT", FDNodelistDir);
-  ProcessPointFile(stuff);
+  memset(&Segment, 0, sizeof(FDWNSegment));
+  Segment.Hash = ControlHash;
+  Nodelist->SetSegment(WFDNInternal, Segment);
+
+  printf("(+) Index quality\n");
+  PrintTreeQuality(NFDXIndex, "NODELIST.FDX");
+  PrintTreeQuality(UFDXIndex, "USERLIST.FDX");
+  PrintTreeQuality(PFDXIndex, "PHONE.FDX");
   delete Nodelist;
 
 }
@@ -160,6 +419,20 @@ void PrintBanner()
 }
 
 
+void PrintTreeQuality(char Index, char * Name)
+{
+  FDWNTreeQuality Report;
+
+  if(!Nodelist->GetTreeQuality(Index, Report)){
+    printf("  - %-12s unable to walk tree (error %d)\n", Name, Nodelist->GetError());
+    return;
+  }
+  printf("  - %-12s height %d, %5ld pages (%5ld leaves), %6ld records, fill %3d%% (leaves %3d%%)\n",
+         Name, Report.Height, Report.Pages, Report.LeafPages, Report.Records,
+         Report.FillFactor, Report.LeafFill);
+}
+
+
 /*
 **    ReadFD
 **
@@ -208,6 +481,52 @@ void ReadFD(void)
 }
 
 
+/*
+**    HashFile
+**
+** Works out a CRC-32 of the contents of a file, so that a list which has
+** not changed since the index set was compiled can be left alone.
+**
+**    Parameters
+**
+**    Filename    The file to hash, may be empty
+**
+**    Returns
+**
+**    0 if the file cannot be read, otherwise the CRC (never 0)
+**
+*/
+unsigned long HashFile(char * Filename)
+{
+  FILE * File;
+  unsigned char * Block;
+  size_t Read, loop;
+  unsigned long Crc = 0xFFFFFFFFUL;
+  int bit;
+
+  if(!*Filename) return(0);
+  File = _fsopen(Filename, "rb", SH_DENYWR);
+  if(!File) return(0);
+  Block = new unsigned char[4096];
+  if(!Block){
+    fclose(File);
+    return(0);
+  }
+
+  while((Read = fread(Block, 1, 4096, File)) != 0){
+    for(loop = 0; loop < Read; loop++){
+      Crc ^= Block[loop];
+      for(bit = 0; bit < 8; bit++) Crc = (Crc >> 1) ^ ((Crc & 1) ? 0xEDB88320UL : 0);
+    }
+  }
+  fclose(File);
+  delete [] Block;
+
+  Crc = ~Crc & 0xFFFFFFFFUL;
+  return(Crc ? Crc : 1);
+}
+
+
 /*
 **      ReadControlLine
 **
@@ -244,6 +563,178 @@ char * ReadControlLine(FILE * fp, char * buffer)
 }
 
 
+/*
+**    OpenNodeReader, ReadNodeLine, CloseNodeReader
+**
+** The nodelist equivalent of ReadControlLine() above, through a NodeReader.
+** Comment and blank lines are skipped, as are leading spaces, and reading
+** stops at an end of file marker. A line longer than the block is split.
+**
+** The line returned lies in the block, with its line end replaced by a
+** terminator, and is only good until the next call.
+**
+** When reading from an archive, everything unpacked is written to the
+** nodelist file as it is read, including anything after an end of file
+** marker, which is copied when the reader is closed.
+**
+**    Parameters
+**
+**    Reader      The reader in question
+**    Filename    The nodelist to open, or to unpack to
+**    Archive     The archive holding the nodelist, or NULL
+**    Offset      Set to the offset in the file of the returned line
+**
+**    Returns
+**
+**    OpenNodeReader() returns 1 on success, 0 on failure.
+**    ReadNodeLine() returns NULL at the end of the file, otherwise the line.
+**    CloseNodeReader() returns 0 if the archive was damaged, or the
+**    nodelist could not be written out, and 1 otherwise.
+**
+*/
+int OpenNodeReader(NodeReader & Reader, char * Filename, char * Archive)
+{
+  memset(&Reader, 0, sizeof(NodeReader));
+  if(Archive){
+    Reader.Archive = new FDNArchive;
+    if(!Reader.Archive) return(0);
+    if(Reader.Archive->Open(Archive)) Reader.Copy = _fsopen(Filename, "wb", SH_DENYWR);
+    if(!Reader.Copy){
+      delete Reader.Archive;
+      Reader.Archive = NULL;
+      return(0);
+    }
+  }
+  else{
+    Reader.File = _fsopen(Filename, "rb", SH_DENYWR);
+    if(!Reader.File) return(0);
+  }
+  Reader.Block = new char[NODEBLOCK];
+  if(!Reader.Block){
+    CloseNodeReader(Reader);
+    return(0);
+  }
+  return(1);
+}
+
+
+char * ReadNodeLine(NodeReader & Reader, long & Offset)
+{
+  char * Line, * End;
+  size_t Read;
+
+  for(;;){
+    Line = Reader.Block + Reader.Next;
+    End  = (char *) memchr(Line, '\n', Reader.Size - Reader.Next);
+    if(!End){
+      // Shift the unread part of the block down and fill up behind it,
+      // leaving room for the terminator of a last line with no line end.
+      if(!Reader.End && (Reader.Next || (Reader.Size < NODEBLOCK - 1))){
+        Reader.Size -= Reader.Next;
+        memmove(Reader.Block, Line, Reader.Size);
+        Reader.Base += Reader.Next;
+        Reader.Next  = 0;
+        if(Reader.Archive) Read = Reader.Archive->Read(Reader.Block + Reader.Size, NODEBLOCK - 1 - Reader.Size);
+        else Read = fread(Reader.Block + Reader.Size, 1, NODEBLOCK - 1 - Reader.Size, Reader.File);
+        if(Reader.Copy && (fwrite(Reader.Block + Reader.Size, 1, Read, Reader.Copy) != Read)) Reader.Error = 1;
+        if(!Read) Reader.End = 1;
+        Reader.Size += (unsigned) Read;
+        continue;
+      }
+      if(Reader.Next == Reader.Size) return(NULL);
+      End = Reader.Block + Reader.Size;
+      Reader.Next = Reader.Size;
+    }
+    else Reader.Next = (unsigned) (End - Reader.Block) + 1;
+
+    *End = 0;
+    if((End > Line) && (End[-1] == '\r')) End[-1] = 0;
+
+    while(*Line==' ') Line++;
+    if(*Line==0x1A){
+      Reader.Next = Reader.Size;
+      Reader.End  = 1;
+      return(NULL);
+    }
+    if(*Line && (*Line!=';')){
+      Offset = Reader.Base + (Line - Reader.Block);
+      return(Line);
+    }
+  }
+}
+
+
+int CloseNodeReader(NodeReader & Reader)
+{
+  size_t Read;
+  int Success = !Reader.Error;
+
+  if(Reader.Copy){
+    while(Reader.Block && ((Read = Reader.Archive->Read(Reader.Block, NODEBLOCK)) != 0)){
+      if(fwrite(Reader.Block, 1, Read, Reader.Copy) != Read) Success = 0;
+    }
+    if(fclose(Reader.Copy)) Success = 0;
+  }
+  if(Reader.Archive){
+    if(Reader.Archive->GetError()) Success = 0;
+    delete Reader.Archive;
+  }
+  if(Reader.File) fclose(Reader.File);
+  if(Reader.Block) delete [] Reader.Block;
+  memset(&Reader, 0, sizeof(NodeReader));
+  return(Success);
+}
+
+
+/*
+**    ProcessControlFile
+**
+** Reads FDNODE.CTL. This is done in two passes, the first building
+** FDNET.PVT and FDPOINT.PVT from the lists named, and the second adding
+** the DIAL and COST tables to PHONE.FDX, which only needs doing when the
+** index set is compiled from scratch.
+**
+**    Parameters
+**
+**    Tables      0 for the lists, 1 for the tables
+**
+*/
+void ProcessControlFile(int Tables)
+{
+  char stuff[72];
+  char * p;
+  int quit = 0;
+  FILE * control;
+
+  sprintf(stuff, "%sFDNODE.CTL", FDNodelistDir);
+  control=_fsopen(stuff, "r", SH_DENYRW);
+  if(!control){
+    perror("Unable to open FDNODE.CTL");
+    return;
+  }
+
+  while(!quit){
+    p = ReadControlLine(control, Buffer);
+    if(!p) quit=1;
+    else{
+      if(Tables){
+        if(!strnicmp(p, "DIAL", 4))      ProcessDialTable(p+4, control);
+        if(!strnicmp(p, "COST", 4))      ProcessCostTable(control);
+      }
+      else{
+        if(!strnicmp(p, "PVTLIST", 7))   AddToPrivate(p+7);
+        if(!strnicmp(p, "POINTLIST", 9)) AddToPoint(p+9);
+        if(!strnicmp(p, "DIAL", 4) || !strnicmp(p, "COST", 4)){
+          // Skip over the table
+          while((p = ReadControlLine(control, Buffer)) != NULL && strnicmp(p, "END", 3));
+        }
+      }
+    }
+  }
+  fclose(control);
+}
+
+
 /*
 **    ProcessDialTable
 **
@@ -391,87 +882,810 @@ void ProcessCostTable(FILE * control)
 **
 **    Filename    The name of the file to compile, usually FDNET.PVT in some
 **                path, or the official NODELIST.xxx file.
+**    Whence      Which file it is
+**    Archive     The archive to unpack Filename from as it is compiled, or
+**                NULL if it is already unpacked
+**
+**    Returns
+**
+**    The number of entries compiled
 **
 */
-void ProcessNodeFile(char * Filename, long int Whence)
+long ProcessNodeFile(char * Filename, long int Whence, char * Archive)
 {
-  unsigned short Zone, Region, Net, Hub, Node, Point;
-  unsigned short RNet, RNode;
-  FILE *NodeFile;
-  int quit = 0;
-  char * p;
+  NodeContext Context;
+  NodeReader NodeFile;
+  char * Line, * p;
   unsigned long Number=0;
-  char Status = 0;
   long Offset;
-
-  Zone = Region = Net = Node = Hub = Point = RNet = RNode = 0;
-  NodeFile = _fsopen(Filename, "r", SH_DENYWR);
-  if(!NodeFile){
+  long Entries = 0;
+
+  memset(&Context, 0, sizeof(NodeContext));
+  if(Archive) printf("(+) Compiling %s from %s\n", Filename, Archive);
+  else printf("(+) Compiling %s\n", Filename);
+#ifdef ParallelParse
+  Entries = ProcessNodeChunks(Filename, Whence, Archive);
+  if(Entries >= 0) return(Entries);
+  Entries = 0;
+#endif
+  if(!OpenNodeReader(NodeFile, Filename, Archive)){
     perror("Unable to open Data file");
     // Cannot find file
     exit(3);
   }
-  printf("(+) Compiling %s\n", Filename);
-  while(!quit){
-    p = ReadControlLine(NodeFile, Buffer);
-    if(!p) quit = 1;
-    else{
-      Number++;
-      if(*p!=','){
+  while((Line = ReadNodeLine(NodeFile, Offset)) != NULL){
+    Number++;
+    p = ParseNodeLine(Line, Context);
+    if(!p) continue;
+    // Ok, we're ready to dissect the line and add it to the Database
+    AddNodeLine(Context, p, Whence, Offset + (p - Line));
+    Entries++;
+    if(Context.Status==ISZC) printf("%5lu Zone %5u\n",Number, Context.Zone);
+  }
+  if(!CloseNodeReader(NodeFile)){
+    printf("(!) Unable to unpack %s\n", Archive);
+    remove(Filename);
+    exit(3);
+  }
+  return(Entries);
+}
 
-        if(!strnicmp(p, "Zone", 4)){
-          Zone   = (unsigned short) atoi(p+5); RNet = 0; RNode = 0; Status = ISZC; Region = Node = Point = 0; Net = Zone;
-        }
-        if(!strnicmp(p, "Region", 6)){
-          Region = (unsigned short) atoi(p+7); RNet = Net = Region; RNode = 0; Status = ISRC; Node = Point = 0;
-        }
-        if(!strnicmp(p, "Host", 4)){
-          Net    = (unsigned short) atoi(p+5); RNet = Net; RNode = 0; Status = ISNC; Hub = Node = Point = 0;
-        }
-        if(!strnicmp(p, "Hub", 3)){
-          Hub    = (unsigned short) atoi(p+4); RNet = Net; RNode = Hub; Status = ISHUB; Node = Hub;
-        }
-        if(!strnicmp(p, "Hold", 4)){
-          Node   = (unsigned short) atoi(p+5); Status = ISHOLD; Point = 0;
+
+/*
+**    ParseNodeLine
+**
+** The guts of the nodelist parser above, which works out the address,
+** status and routing of the entry on a single line.
+**
+**    Parameters
+**
+**    p           The line from the nodelist
+**    Context     The parser state left by the previous line, updated
+**
+**    Returns
+**
+**    NULL for a comment or blank line, otherwise a pointer to the system
+**    name, which is where the offset of the entry points.
+**
+*/
+char * ParseNodeLine(char * p, NodeContext & Context)
+{
+  // skip any leading spaces
+  while(*p==' ') p++;
+  if((*p==';') || (*p=='\r') || (*p=='\n') || (*p==0x1A) || !*p) return(NULL);
+
+  if(*p!=','){
+
+    if(!strnicmp(p, "Zone", 4)){
+      Context.Zone   = (unsigned short) atoi(p+5); Context.RNet = 0; Context.RNode = 0; Context.Status = ISZC; Context.Region = Context.Node = Context.Point = 0; Context.Net = Context.Zone;
+    }
+    if(!strnicmp(p, "Region", 6)){
+      Context.Region = (unsigned short) atoi(p+7); Context.RNet = Context.Net = Context.Region; Context.RNode = 0; Context.Status = ISRC; Context.Node = Context.Point = 0;
+    }
+    if(!strnicmp(p, "Host", 4)){
+      Context.Net    = (unsigned short) atoi(p+5); Context.RNet = Context.Net; Context.RNode = 0; Context.Status = ISNC; Context.Hub = Context.Node = Context.Point = 0;
+    }
+    if(!strnicmp(p, "Hub", 3)){
+      Context.Hub    = (unsigned short) atoi(p+4); Context.RNet = Context.Net; Context.RNode = Context.Hub; Context.Status = ISHUB; Context.Node = Context.Hub;
+    }
+    if(!strnicmp(p, "Hold", 4)){
+      Context.Node   = (unsigned short) atoi(p+5); Context.Status = ISHOLD; Context.Point = 0;
+    }
+    if(!strnicmp(p, "Down", 4)){
+      Context.Node   = (unsigned short) atoi(p+5); Context.Status = ISDOWN; Context.Point = 0;
+    }
+    if(!strnicmp(p, "PVT", 3)){
+      Context.Node   = (unsigned short) atoi(p+4); Context.Status = ISPVT; Context.Point = 0;
+    }
+    if(!strnicmp(p, "Point", 5)){
+      Context.Point  = (unsigned short) atoi(p+6); Context.Status = ISPOINT;
+    }
+    p = strchr(p, ',') + 1;
+    p = strchr(p, ',') + 1;
+  }
+  else{
+    p++;
+    Context.Node = (unsigned short) atoi(p);
+    p = strchr(p, ',') + 1;
+    Context.Status = 0;
+    Context.RNet = Context.Net; Context.RNode = Context.Hub;
+    Context.Point = 0;
+  }
+
+  switch(Context.Status){
+    case ISNC:
+      Context.RouteNet = Context.Region; Context.RouteNode = 0;
+      break;
+    case ISPOINT:
+      Context.RouteNet = Context.Net;    Context.RouteNode = Context.Node;
+      break;
+    default:
+      Context.RouteNet = Context.RNet;   Context.RouteNode = Context.RNode;
+      break;
+  }
+  return(p);
+}
+
+
+#ifdef ParallelParse
+
+#if defined(__NT__)
+DWORD WINAPI ParseNodeThread(LPVOID Chunk)
+{
+  ParseNodeChunk(*(NodeChunk *) Chunk);
+  return(0);
+}
+#elif defined(__OS2__)
+void APIENTRY ParseNodeThread(ULONG Chunk)
+{
+  ParseNodeChunk(*(NodeChunk *) Chunk);
+}
+#endif
+
+
+/*
+**    ProcessNodeChunks
+**
+** ProcessNodeFile() for a large nodelist, which is read whole and cut into
+** pieces at Host lines. The compile then runs as a pipeline: the pieces
+** are parsed on threads of their own, a few at a time, while the main
+** thread adds the entries of those already parsed to the index, in the
+** order they appear in the file. A piece is only started once an earlier
+** one has been taken, so that no more than one piece per processor is
+** ever waiting, parsed, in memory.
+**
+** The time spent parsing, indexing, and waiting for the parsers is shown
+** at the end.
+**
+**    Parameters
+**
+**    Filename    The name of the file to compile
+**    Whence      Which file it is
+**    Archive     The archive to unpack it from, or NULL
+**
+**    Returns
+**
+**    The number of entries compiled, or -1 if the file is too small to be
+**    worth splitting, or cannot be read whole, in which case it should be
+**    read line by line instead.
+**
+*/
+long ProcessNodeChunks(char * Filename, long int Whence, char * Archive)
+{
+  NodeChunk Chunk[NODECHUNKS];
+  NodeContext Context;
+  ParsedEntry * Entry;
+  char * Data, * p, * q;
+  long Size, Entries = 0, loop2, Limit;
+  unsigned long Number = 0;
+  int Chunks, Threads = 1, Started, loop, Stop = 0;
+  clock_t Parsing = 0, Indexing = 0, Waiting = 0, Mark;
+#if defined(__NT__)
+  HANDLE Thread[NODECHUNKS];
+  SYSTEM_INFO Info;
+  DWORD Id;
+#elif defined(__OS2__)
+  TID Thread[NODECHUNKS];
+  ULONG Processors;
+#endif
+
+  Data = LoadNodeFile(Filename, Archive, Size);
+  if(!Data) return(-1);
+
+#if defined(__NT__)
+  GetSystemInfo(&Info);
+  Threads = (int) Info.dwNumberOfProcessors;
+#elif defined(__OS2__) && defined(QSV_NUMPROCESSORS)
+  if(!DosQuerySysInfo(QSV_NUMPROCESSORS, QSV_NUMPROCESSORS, &Processors, sizeof(ULONG))) Threads = (int) Processors;
+#endif
+  if(Threads < 1) Threads = 1;
+  if(Threads > NODETHREADS) Threads = NODETHREADS;
+  Chunks = (int) ((Size + NODEBLOCK - 1) / NODEBLOCK);
+  if(Chunks < Threads) Chunks = Threads;
+  if(Chunks > NODECHUNKS) Chunks = NODECHUNKS;
+
+  // Cut the file into pieces of about the same size, moving each cut on
+  // to the next Host line
+  memset(Chunk, 0, sizeof(Chunk));
+  p = Data;
+  for(loop = 0; loop < Chunks; loop++){
+    Chunk[loop].Start = p;
+    Chunk[loop].Base  = p - Data;
+    q = Data + (Size / Chunks) * (loop + 1);
+    if(q < p) q = p;
+    if(loop == Chunks - 1) q = Data + Size;
+    while(q < Data + Size){
+      q = (char *) memchr(q, '\n', (Data + Size) - q);
+      if(!q) q = Data + Size;
+      else{
+        p = ++q;
+        while(*p==' ') p++;
+        if(!strnicmp(p, "Host", 4)) break;
+      }
+    }
+    Chunk[loop].End = p = q;
+  }
+
+  // Add the entries in order, filling in the zone and region for those
+  // before the first Zone or Region line of each piece
+  memset(&Context, 0, sizeof(NodeContext));
+  for(Started = 0, loop = 0; loop < Chunks; loop++){
+    // Keep the parsers busy, starting a piece for each one taken
+    for(; (Started < Chunks) && (Started < loop + Threads); Started++){
+#if defined(__NT__)
+      Thread[Started] = CreateThread(NULL, 0, ParseNodeThread, &Chunk[Started], 0, &Id);
+      if(!Thread[Started]) ParseNodeChunk(Chunk[Started]);
+#elif defined(__OS2__)
+      if(DosCreateThread(&Thread[Started], ParseNodeThread, (ULONG) &Chunk[Started], 0, 65536UL)){
+        Thread[Started] = 0;
+        ParseNodeChunk(Chunk[Started]);
+      }
+#endif
+    }
+
+    Mark = clock();
+#if defined(__NT__)
+    if(Thread[loop]){
+      WaitForSingleObject(Thread[loop], INFINITE);
+      CloseHandle(Thread[loop]);
+    }
+#elif defined(__OS2__)
+    if(Thread[loop]) DosWaitThread(&Thread[loop], DCWW_WAIT);
+#endif
+    Waiting += clock() - Mark;
+    Parsing += Chunk[loop].Ticks;
+
+    // A piece left without memory is tried again, with the others out of
+    // the way
+    if(Chunk[loop].Error){
+      Chunk[loop].Error = 0;
+      ParseNodeChunk(Chunk[loop]);
+      if(Chunk[loop].Error){
+        printf("(!) Not enough memory to compile %s\n", Filename);
+        exit(3);
+      }
+    }
+
+    Mark = clock();
+    for(loop2 = 0; !Stop && (loop2 < Chunk[loop].Count); loop2++){
+      Entry = Chunk[loop].Entries + loop2;
+      Limit = (Chunk[loop].ZoneFrom < 0) ? Chunk[loop].Count : Chunk[loop].ZoneFrom;
+      if(loop2 < Limit) Entry->Context.Zone = Context.Zone;
+      Limit = (Chunk[loop].RegionFrom < 0) ? Chunk[loop].Count : Chunk[loop].RegionFrom;
+      if(loop2 < Limit){
+        Entry->Context.Region = Context.Region;
+        if(Entry->Context.Status == ISNC) Entry->Context.RouteNet = Context.Region;
+      }
+      if(Entry->Context.Status==ISZC) printf("%5lu Zone %5u\n", Number + Entry->Number, Entry->Context.Zone);
+    }
+    if(!Stop){
+      AddNodeEntries(Chunk[loop].Entries, Chunk[loop].Count, Whence);
+      Entries += Chunk[loop].Count;
+    }
+    Indexing += clock() - Mark;
+    if(Chunk[loop].ZoneFrom >= 0)   Context.Zone   = Chunk[loop].Context.Zone;
+    if(Chunk[loop].RegionFrom >= 0) Context.Region = Chunk[loop].Context.Region;
+    Number += Chunk[loop].Lines;
+    if(Chunk[loop].Eof) Stop = 1;
+    delete [] Chunk[loop].Entries;
+    Chunk[loop].Entries = NULL;
+  }
+  delete [] Data;
+
+  printf("  - %ld entries in %d pieces on %d threads\n", Entries, Chunks, Threads);
+  printf("  - parsing %.2fs, indexing %.2fs (%.0f entries/s), waiting %.2fs\n",
+         (double) Parsing / CLOCKS_PER_SEC, (double) Indexing / CLOCKS_PER_SEC,
+         Indexing ? (double) Entries * CLOCKS_PER_SEC / Indexing : 0.0,
+         (double) Waiting / CLOCKS_PER_SEC);
+  return(Entries);
+}
+
+
+/*
+**    LoadNodeFile
+**
+** Reads a nodelist whole for ProcessNodeChunks(). One which is to be
+** unpacked from an archive is also written out, as its offsets will refer
+** to the file once it is compiled.
+**
+**    Parameters
+**
+**    Filename    The nodelist
+**    Archive     The archive to unpack it from, or NULL
+**    Size        Set to the size of the nodelist
+**
+**    Returns
+**
+**    The nodelist, terminated, or NULL if it is too small to be worth
+**    splitting, or cannot be read
+**
+*/
+char * LoadNodeFile(char * Filename, char * Archive, long & Size)
+{
+  FDNArchive Packed;
+  FILE * NodeFile;
+  char * Data;
+  int Success;
+
+  if(Archive){
+    if(!Packed.Open(Archive)) return(NULL);
+    Size = (long) Packed.GetSize();
+    if((Size <= (long) NODEBLOCK) || ((Data = new char[Size + 1]) == NULL)) return(NULL);
+    Success = (Packed.Read(Data, (size_t) Size) == (size_t) Size) && !Packed.GetError();
+    if(Success){
+      NodeFile = _fsopen(Filename, "wb", SH_DENYWR);
+      Success = NodeFile && (fwrite(Data, 1, (size_t) Size, NodeFile) == (size_t) Size);
+      if(NodeFile && fclose(NodeFile)) Success = 0;
+    }
+  }
+  else{
+    NodeFile = _fsopen(Filename, "rb", SH_DENYWR);
+    if(!NodeFile) return(NULL);
+    fseek(NodeFile, 0L, SEEK_END);
+    Size = ftell(NodeFile);
+    if((Size <= (long) NODEBLOCK) || ((Data = new char[Size + 1]) == NULL)){
+      fclose(NodeFile);
+      return(NULL);
+    }
+    fseek(NodeFile, 0L, SEEK_SET);
+    Success = (fread(Data, 1, (size_t) Size, NodeFile) == (size_t) Size);
+    fclose(NodeFile);
+  }
+  if(!Success){
+    delete [] Data;
+    return(NULL);
+  }
+  Data[Size] = 0;
+  return(Data);
+}
+
+
+/*
+**    ParseNodeChunk
+**
+** Parses one piece of a nodelist for ProcessNodeChunks(), which may be
+** running on a thread of its own. Lines are terminated in place, and
+** nothing outside the piece is touched.
+**
+**    Parameters
+**
+**    Chunk       The piece in question, with Start, End and Base set
+**
+*/
+void ParseNodeChunk(NodeChunk & Chunk)
+{
+  ParsedEntry * Entry;
+  char * Line, * p, * q;
+  long Lines = 1;
+  clock_t Start = clock();
+
+  memset(&Chunk.Context, 0, sizeof(NodeContext));
+  Chunk.ZoneFrom = Chunk.RegionFrom = -1;
+  for(p = Chunk.Start; (p = (char *) memchr(p, '\n', Chunk.End - p)) != NULL; p++) Lines++;
+  Chunk.Entries = new ParsedEntry[Lines];
+  if(!Chunk.Entries){
+    Chunk.Error = 1;
+    return;
+  }
+
+  for(p = Chunk.Start; p < Chunk.End; p = q + 1){
+    // Only the last piece can end without a line end, and the file is
+    // terminated there already
+    Line = p;
+    q = (char *) memchr(p, '\n', Chunk.End - p);
+    if(!q) q = Chunk.End;
+    else *q = 0;
+    if((q > Line) && (q[-1] == '\r')) q[-1] = 0;
+
+    while(*Line==' ') Line++;
+    if(*Line==0x1A){
+      Chunk.Eof = 1;
+      break;
+    }
+    if(!*Line || (*Line==';')) continue;
+    Chunk.Lines++;
+    p = ParseNodeLine(Line, Chunk.Context);
+    if(!p) continue;
+    if((Chunk.Context.Status==ISZC) && (Chunk.ZoneFrom < 0)) Chunk.ZoneFrom = Chunk.Count;
+    if(((Chunk.Context.Status==ISZC) || (Chunk.Context.Status==ISRC)) && (Chunk.RegionFrom < 0)) Chunk.RegionFrom = Chunk.Count;
+    Entry = Chunk.Entries + Chunk.Count++;
+    Entry->Context = Chunk.Context;
+    Entry->Name    = p;
+    Entry->Offset  = Chunk.Base + (p - Chunk.Start);
+    Entry->Number  = Chunk.Lines;
+  }
+  Chunk.Ticks = clock() - Start;
+}
+
+
+/*
+**    AddNodeEntries
+**
+** Adds the entries parsed from a piece of a nodelist to NODELIST.FDX and
+** USERLIST.FDX, as AddNodeLine() would one at a time, but as a batch for
+** each index, so that entries which fall in the same page are added to
+** it together. If there is not the memory for the batch the entries are
+** added one at a time after all.
+**
+**    Parameters
+**
+**    Entries     The entries of the piece, with the zone and region
+**                filled in
+**    Count       The number of entries
+**    Whence      Which file the offsets are in
+**
+*/
+void AddNodeEntries(ParsedEntry * Entries, long Count, long int Whence)
+{
+  NFDXRecord * NData;
+  UFDXRecord * UData;
+  NFDXRecord Earlier;
+  ParsedEntry * Entry;
+  FDWNBatchReport Report;
+  long loop;
+
+  if(!Count) return;
+  NData = new NFDXRecord[Count];
+  UData = new UFDXRecord[Count];
+  if(!NData || !UData){
+    if(NData) delete [] NData;
+    if(UData) delete [] UData;
+    for(loop = 0; loop < Count; loop++) AddNodeLine(Entries[loop].Context, Entries[loop].Name, Whence, Entries[loop].Offset);
+    return;
+  }
+
+  for(loop = 0; loop < Count; loop++){
+    Entry = Entries + loop;
+    Nodelist->CreateRecord(NData[loop], Entry->Context.Zone, Entry->Context.Net, Entry->Context.Node, Entry->Context.Point, Entry->Context.RouteNet, Entry->Context.RouteNode, Entry->Context.Status, Whence, Entry->Offset);
+    Nodelist->CreateRecord(UData[loop], Entry->Context.Zone, Entry->Context.Net, Entry->Context.Node, Entry->Context.Point, strchr(strchr(Entry->Name, ',')+1, ',')+1, Entry->Context.Status, Whence, Entry->Offset);
+
+    // Note when an entry takes the place of one from an earlier list
+    if(Whence != WFDNOfficial){
+      memcpy(&Earlier, &NData[loop], sizeof(NFDXRecord));
+      if(Nodelist->GetRecord(Earlier, -1) && ((Earlier.offset.loff & 0xFF000000UL) != (unsigned long) Whence)) Shadowed++;
+    }
+  }
+  Nodelist->AddRecords(NData, Count, Report);
+  Nodelist->AddRecords(UData, Count, Report);
+
+  delete [] NData;
+  delete [] UData;
+}
+
+#endif
+
+
+/*
+**    AddNodeLine, DeleteNodeLine, MoveNodeLine
+**
+** Add the entry from a parsed nodelist line to NODELIST.FDX and
+** USERLIST.FDX, remove it again, or point its records at a new offset.
+** Removal and moving only concern records from the official list, in both
+** indices, so that an entry overridden by the private list or the point
+** list is left alone. An entry added
+** from a later list where one from an earlier list already has the same
+** address is counted in Shadowed.
+**
+**    Parameters
+**
+**    Context     As left by ParseNodeLine() for the line
+**    p           As returned by ParseNodeLine()
+**    Whence      Which file the offset is in
+**    Offset      Offset of the entry in that file
+**
+*/
+void AddNodeLine(NodeContext & Context, char * p, long int Whence, long Offset)
+{
+  NFDXRecord NData;
+
+  // Note when an entry takes the place of one from an earlier list
+  if(Whence != WFDNOfficial){
+    Nodelist->CreateRecord(NData, Context.Zone, Context.Net, Context.Node, Context.Point, Context.RouteNet, Context.RouteNode, Context.Status, Whence, 0);
+    if(Nodelist->GetRecord(NData, -1) && ((NData.offset.loff & 0xFF000000UL) != (unsigned long) Whence)) Shadowed++;
+  }
+  Nodelist->AddRecord(Context.Zone, Context.Net, Context.Node, Context.Point, Context.RouteNet, Context.RouteNode, Context.Status, Whence, Offset);
+  Nodelist->AddRecord(Context.Zone, Context.Net, Context.Node, Context.Point, strchr(strchr(p, ',')+1, ',')+1, Context.Status, Whence, Offset);
+}
+
+
+void DeleteNodeLine(NodeContext & Context, char * p)
+{
+  NFDXRecord NData;
+  UFDXRecord UData;
+
+  Nodelist->CreateRecord(NData, Context.Zone, Context.Net, Context.Node, Context.Point, Context.RouteNet, Context.RouteNode, Context.Status, WFDNOfficial, 0);
+  if(Nodelist->GetRecord(NData, WFDNOfficial)) Nodelist->DeleteRecord(NData);
+  Nodelist->CreateRecord(UData, Context.Zone, Context.Net, Context.Node, Context.Point, strchr(strchr(p, ',')+1, ',')+1, Context.Status, WFDNOfficial, 0);
+  if(Nodelist->GetRecord(UData, WFDNOfficial)) Nodelist->DeleteRecord(UData);
+}
+
+
+void MoveNodeLine(NodeContext & Context, char * p, long Offset)
+{
+  NFDXRecord NData;
+  UFDXRecord UData;
+
+  Nodelist->CreateRecord(NData, Context.Zone, Context.Net, Context.Node, Context.Point, Context.RouteNet, Context.RouteNode, Context.Status, WFDNOfficial, 0);
+  if(Nodelist->GetRecord(NData, WFDNOfficial)){
+    NData.offset.loff = WFDNOfficial + Offset;
+    Nodelist->UpdateRecord(NData);
+  }
+  Nodelist->CreateRecord(UData, Context.Zone, Context.Net, Context.Node, Context.Point, strchr(strchr(p, ',')+1, ',')+1, Context.Status, WFDNOfficial, 0);
+  if(Nodelist->GetRecord(UData, WFDNOfficial)){
+    UData.offset = WFDNOfficial + Offset;
+    Nodelist->UpdateRecord(UData);
+  }
+}
+
+
+/*
+**    ApplyNodeDiff
+**
+** Brings the nodelist up to date from a weekly NODEDIFF, and the index set
+** with it where that can be done without compiling the new nodelist in
+** full.
+**
+** The NODEDIFF is applied to the old nodelist to produce the new one in
+** the usual way, while both are parsed alongside. Deleted entries are
+** removed from the index set, added ones are added, and entries merely
+** copied have their offsets moved if the lines before them changed in
+** length. A copied entry whose address, status or routing changed (say
+** because its hub was renumbered) counts as changed, and is removed and
+** added again. Additions are held back in a temporary file until all
+** removals are done, as an entry may move to earlier in the nodelist.
+**
+** Only NODELIST.FDX and USERLIST.FDX are touched, so the index set is only
+** updated if it was compiled from exactly the old nodelist, FDNODE.CTL and
+** the private lists as they are now, and no private entry replaced an
+** official one. Otherwise the new nodelist is written all the same, and
+** the reason the index set was left alone is shown.
+**
+**    Parameters
+**
+**    OldExt      The extension of the current nodelist
+**    NewExt      Set to the extension of the new nodelist
+**    Hash        The hashes of the official, private and point lists
+**    ControlHash The hash of FDNODE.CTL
+**
+**    Returns
+**
+**    0 if there was no NODEDIFF for the old nodelist, or it could not be
+**      applied, in which case the old nodelist stands
+**    1 if the new nodelist was written, and must now be compiled in full
+**    2 if the index set was updated too, and Nodelist left open on it
+**
+*/
+int ApplyNodeDiff(unsigned short OldExt, unsigned short & NewExt, unsigned long * Hash, unsigned long ControlHash)
+{
+  char DiffName[72], OldName[72], NewName[72], PendingName[72];
+  char OldNLExt[5], NewNLExt[5];
+  unsigned short DiffExt;
+  FILE *Old, *Diff, *New, *Pending = NULL;
+  NodeContext OldContext, NewContext;
+  PendingEntry Entry;
+  FDWNSegment Official, Segment;
+  const char * Declined = NULL;
+  char Command;
+  char * p;
+  char * q;
+  long Count, OldOffset, NewOffset;
+  long Added = 0, Removed = 0, Changed = 0, Moved = 0;
+  int  success = 1;
+
+  sprintf(DiffName, "%sNODEDIFF.*", FDNodelistDir);
+  if(!CheckFile(DiffName)) return(0);
+  DiffExt = GetNodelistDetails(DiffName, NULL);
+  if((DiffExt == 0xFFFFU) || (DiffExt == OldExt)) return(0);
+
+  sprintf(OldNLExt, "%03u", OldExt);
+  sprintf(NewNLExt, "%03u", DiffExt);
+  sprintf(OldName, "%sNODELIST.%s", FDNodelistDir, OldNLExt);
+  sprintf(DiffName, "%sNODEDIFF.%s", FDNodelistDir, NewNLExt);
+  sprintf(NewName, "%sNODELIST.%s", FDNodelistDir, NewNLExt);
+  sprintf(PendingName, "%sNODEDIFF.$$$", FDNodelistDir);
+
+  // Either may still be being written, in which case try again later
+  // rather than compile the old nodelist as if nothing had arrived
+  Old  = _fsopen(OldName, "rb", SH_DENYWR);
+  Diff = _fsopen(DiffName, "rb", SH_DENYWR);
+  if(!Old || !Diff){
+    perror(Old ? DiffName : OldName);
+    exit(3);
+  }
+
+  // The first line of a NODEDIFF is the first line of the nodelist it
+  // applies to
+  if(!fgets(Buffer, 1024, Diff) || !(p = new char[1024])) success = 0;
+  else{
+    if(!fgets(p, 1024, Old) || strcmp(p, Buffer)) success = 0;
+    delete [] p;
+  }
+  if(!success){
+    printf("(!) %s does not apply to %s\n", DiffName, OldName);
+    fclose(Old);
+    fclose(Diff);
+    return(0);
+  }
+  rewind(Old);
+
+  // The index set can only be updated if it was compiled from the old
+  // nodelist and the lists and tables as they stand
+  #ifdef CacheOn
+  Nodelist = new FDWCachedNode(FDNodelistDir, "CUR", Country, WFDNodeWriteBehind | PUBLISH | SUMS);
+  #else
+  Nodelist = new FrontDoorWNode(FDNodelistDir, "CUR", Country, PUBLISH | SUMS);
+  #endif
+  if(!Nodelist || Nodelist->IsFrozen()) Declined = "it could not be opened";
+  else if(stricmp(Nodelist->GetNodeExt(), OldNLExt) || !Nodelist->GetSegment(WFDNOfficial, Official) ||
+          (Official.Hash != Hash[0])) Declined = "it was not compiled from the old nodelist";
+  else if(!Nodelist->GetSegment(WFDNInternal, Segment) || (Segment.Hash != ControlHash)) Declined = "FDNODE.CTL has changed";
+  else if(!Nodelist->GetSegment(WFDNPrivate, Segment) || (Segment.Hash != Hash[1])) Declined = "FDNET.PVT has changed";
+  else if(Segment.Shadowed) Declined = "private entries replace official ones";
+  else if(!Nodelist->GetSegment(WFDNPoint, Segment) || (Segment.Hash != Hash[2])) Declined = "FDPOINT.PVT has changed";
+  else if(Segment.Shadowed) Declined = "point entries replace official ones";
+
+  New = _fsopen(NewName, "wb", SH_DENYWR);
+  if(!New){
+    perror(NewName);
+    fclose(Old);
+    fclose(Diff);
+    if(Nodelist){
+      Nodelist->Discard();
+      delete Nodelist;
+      Nodelist = NULL;
+    }
+    exit(3);
+  }
+  if(!Declined){
+    Pending = _fsopen(PendingName, "w+b", SH_DENYRW);
+    if(!Pending) Declined = "no temporary file could be made";
+  }
+  if(!Declined){
+    // From here on the index set belongs to the new nodelist
+    Nodelist->Freeze();
+    Nodelist->SetNLExt(NewNLExt);
+    if(!Nodelist->Thaw()) Declined = "it could not be opened again";
+  }
+  if(Declined){
+    printf("(!) Not updating the index set from %s, as %s\n", DiffName, Declined);
+    if(Pending){
+      fclose(Pending);
+      remove(PendingName);
+      Pending = NULL;
+    }
+    if(Nodelist){
+      Nodelist->Discard();
+      delete Nodelist;
+      Nodelist = NULL;
+    }
+  }
+  printf("(+) Applying %s to %s\n", DiffName, OldName);
+
+  memset(&OldContext, 0, sizeof(NodeContext));
+  memset(&NewContext, 0, sizeof(NodeContext));
+  while(success && fgets(Buffer, 1024, Diff) && (*Buffer != 0x1A)){
+    Command = (char) toupper(*Buffer);
+    Count   = atol(Buffer + 1);
+    switch(Command){
+      case 'A':
+        // Lines for the new nodelist follow in the NODEDIFF
+        for(; success && Count; Count--){
+          NewOffset = ftell(New);
+          if(!fgets(Buffer, 1024, Diff)) success = 0;
+          else{
+            fputs(Buffer, New);
+            if(!Nodelist) continue;
+            p = ParseNodeLine(Buffer, NewContext);
+            if(p){
+              Entry.Context = NewContext;
+              Entry.Offset  = NewOffset + (p - Buffer);
+              fwrite(&Entry, sizeof(PendingEntry), 1, Pending);
+              Added++;
+            }
+          }
         }
-        if(!strnicmp(p, "Down", 4)){
-          Node   = (unsigned short) atoi(p+5); Status = ISDOWN; Point = 0;
+        break;
+      case 'C':
+        // Lines copied from the old nodelist
+        for(; success && Count; Count--){
+          OldOffset = ftell(Old);
+          NewOffset = ftell(New);
+          if(!fgets(Buffer, 1024, Old)) success = 0;
+          else{
+            fputs(Buffer, New);
+            if(!Nodelist) continue;
+            q = ParseNodeLine(Buffer, OldContext);
+            p = ParseNodeLine(Buffer, NewContext);
+            if(!p) continue;
+            if((OldContext.Zone == NewContext.Zone) && (OldContext.Net == NewContext.Net) &&
+               (OldContext.Node == NewContext.Node) && (OldContext.Point == NewContext.Point) &&
+               (OldContext.RouteNet == NewContext.RouteNet) && (OldContext.RouteNode == NewContext.RouteNode) &&
+               (OldContext.Status == NewContext.Status)){
+              if(OldOffset != NewOffset){
+                MoveNodeLine(NewContext, p, NewOffset + (p - Buffer));
+                Moved++;
+              }
+            }
+            else{
+              DeleteNodeLine(OldContext, q);
+              Entry.Context = NewContext;
+              Entry.Offset  = NewOffset + (p - Buffer);
+              fwrite(&Entry, sizeof(PendingEntry), 1, Pending);
+              Changed++;
+            }
+          }
         }
-        if(!strnicmp(p, "PVT", 3)){
-          Node   = (unsigned short) atoi(p+4); Status = ISPVT; Point = 0;
+        break;
+      case 'D':
+        // Lines dropped from the old nodelist
+        for(; success && Count; Count--){
+          if(!fgets(Buffer, 1024, Old)) success = 0;
+          else{
+            if(!Nodelist) continue;
+            q = ParseNodeLine(Buffer, OldContext);
+            if(q){
+              DeleteNodeLine(OldContext, q);
+              Removed++;
+            }
+          }
         }
-        if(!strnicmp(p, "Point", 5)){
-          Point  = (unsigned short) atoi(p+6); Status = ISPOINT;
+        break;
+      default:
+        // Anything but a blank line means a damaged NODEDIFF
+        if((*Buffer != '\r') && (*Buffer != '\n')){
+          printf("(!) Did not understand NODEDIFF line\n[%s]\n", Buffer);
+          success = 0;
         }
-        p = strchr(p, ',') + 1;
-        p = strchr(p, ',') + 1;
-      }
-      else{
-        p++;
-        Node = (unsigned short) atoi(p);
-        p = strchr(p, ',') + 1;
-        Status = 0;
-        RNet = Net; RNode = Hub;
-        Point = 0;
-      }
-      // Ok, we're ready to dissect the line and add it to the Database
-      Offset = ftell(NodeFile) - strlen(p) - 1;
-      switch(Status){
-        case ISNC:
-          Nodelist->AddRecord(Zone, Net, Node, Point, Region, 0, Status, Whence, Offset);
-          break;
-        case ISPOINT:
-          Nodelist->AddRecord(Zone, Net, Node, Point, Net, Node, Status, Whence, Offset);
-          break;  
-        default:
-          Nodelist->AddRecord(Zone, Net, Node, Point, RNet, RNode, Status, Whence, Offset);
-          break;
+        break;
+    }
+  }
+  if(success) fputc(0x1A, New);
+  fclose(Old);
+  fclose(Diff);
+  fclose(New);
+
+  // Now the additions, which refer to the finished nodelist
+  if(success && Nodelist){
+    New = _fsopen(NewName, "rb", SH_DENYWR);
+    if(!New) success = 0;
+    else{
+      rewind(Pending);
+      while(fread(&Entry, sizeof(PendingEntry), 1, Pending) == 1){
+        fseek(New, Entry.Offset, SEEK_SET);
+        if(fgets(Buffer, 1024, New)) AddNodeLine(Entry.Context, Buffer, WFDNOfficial, Entry.Offset);
       }
-      Nodelist->AddRecord(Zone, Net, Node, Point, strchr(strchr(p, ',')+1, ',')+1, Status, Whence, Offset);
-      if(Status==ISZC) printf("%5lu Zone %5u\n",Number, Zone);
+      fclose(New);
     }
   }
-  fclose(NodeFile);
+  if(Pending){
+    fclose(Pending);
+    remove(PendingName);
+  }
+
+  if(!success){
+    // The index set is of no use now; with its official list marked as
+    // unknown the old nodelist is compiled in full
+    printf("(!) Unable to apply %s\n", DiffName);
+    if(Nodelist){
+      Official.Hash = 0;
+      Nodelist->SetSegment(WFDNOfficial, Official);
+      Nodelist->Discard();
+      delete Nodelist;
+      Nodelist = NULL;
+    }
+    remove(NewName);
+    return(0);
+  }
+
+  NewExt = DiffExt;
+  if(!Nodelist) return(1);
+  printf("  - %ld entries added, %ld removed, %ld changed, %ld moved\n", Added, Removed, Changed, Moved);
+
+  // The official list segment is now the new nodelist
+  Official.Hash     = HashFile(NewName);
+  Official.Entries += Added - Removed;
+  Nodelist->SetSegment(WFDNOfficial, Official);
+  return(2);
 }
 
 
@@ -486,26 +1700,32 @@ void ProcessNodeFile(char * Filename, long int Whence)
 **    Filename    The name of the file to compile, usually FDPOINT.PVT in some
 **                path.
 **
+**    Returns
+**
+**    The number of entries compiled
+**
 */
-void ProcessPointFile(char * Filename)
+long ProcessPointFile(char * Filename)
 {
   unsigned short Zone, Node, Net, Point;
-  FILE *NodeFile;
+  NodeContext Context;
+  long Entries = 0;
+  NodeReader NodeFile;
   int quit = 0;
-  char *p;
+  char *Line, *p;
   long Offset;
 
   Zone = Net = Node = Point = 0;
-  NodeFile = _fsopen(Filename, "r", SH_DENYWR);
+  memset(&Context, 0, sizeof(NodeContext));
 
-  if(!NodeFile){
+  if(!OpenNodeReader(NodeFile, Filename, NULL)){
     perror("Unable to open Data file");
     // Cannot find file
     exit(3);
   }
   printf("(+) Compiling %s\n", Filename);
   while(!quit){
-    p = ReadControlLine(NodeFile, Buffer);
+    p = Line = ReadNodeLine(NodeFile, Offset);
     if(!p) quit = 1;
     else{
       if(*p!=','){
@@ -518,7 +1738,8 @@ void ProcessPointFile(char * Filename)
           Node = (unsigned short) atoi(p);
 
           // Ok, read next line
-          p = ReadControlLine(NodeFile, Buffer);
+          p = Line = ReadNodeLine(NodeFile, Offset);
+          if(!p) break;
         }
 
         if(!strnicmp(p, "Hold", 4) || !strnicmp(p, "Down", 4)){
@@ -535,15 +1756,22 @@ void ProcessPointFile(char * Filename)
         p = strchr(p, ',') + 1;
       }
       // Ok, we're ready to dissect the line and add it to the Database
-      Offset = ftell(NodeFile) - strlen(p) - 1;
-
-      // Add data to NODELIST.FDX
-      Nodelist->AddRecord(Zone, Net, Node, Point, Net, Node, ISPOINT, WFDNPoint, Offset);
-      // Add data to USERLIST.FDX
-      Nodelist->AddRecord(Zone, Net, Node, Point, strchr(strchr(p, ',')+1, ',')+1, ISPOINT, WFDNPoint, Offset);
+      Offset += p - Line;
+
+      // Add data to NODELIST.FDX and USERLIST.FDX
+      Context.Zone      = Zone;
+      Context.Net       = Net;
+      Context.Node      = Node;
+      Context.Point     = Point;
+      Context.RouteNet  = Net;
+      Context.RouteNode = Node;
+      Context.Status    = ISPOINT;
+      AddNodeLine(Context, p, WFDNPoint, Offset);
+      Entries++;
     }
   }
-  fclose(NodeFile);
+  CloseNodeReader(NodeFile);
+  return(Entries);
 }
           
                        
@@ -616,6 +1844,63 @@ unsigned short GetNodelistDetails(char * filename, char * buffer)
 }
 
 
+/*
+**    GetArchiveDetails
+**
+** The equivalent of GetNodelistDetails() for nodelists which are still in
+** the ZIP archives they were distributed in, eg. NODELIST.Z*. Each archive
+** is opened, and the one holding the nodelist with the greatest numeric
+** extension is chosen.
+**
+**    Parameters
+**
+**    filename    The filemask for the archives
+**    buffer      A region of memory to hold the name of the chosen archive
+**    Crc         Set to the CRC-32 of the nodelist in it
+**
+**    Returns
+**
+**    0xFFFF      No archive holding a nodelist was found
+**    other       The numeric extension of the nodelist in the archive
+**
+**/
+unsigned short GetArchiveDetails(char * filename, char * buffer, unsigned long & Crc)
+{
+  char          Stub[72];
+  char          Name[72];
+  const char *  extension;
+  struct        find_t found;
+  FDNArchive    Archive;
+  int           done=0;
+  int           BestIndex=-1;
+  char *        p;
+
+  // Get the directory name (if any), with its separator, and put it in Stub
+  strcpy(Stub, filename);
+  for(p = Stub + strlen(Stub); (p > Stub) && !strchr("\\/:", p[-1]); p--);
+  *p = 0;
+
+  done=_dos_findfirst(filename, 0, &found);
+  while(!done){
+    sprintf(Name, "%s%s", Stub, found.name);
+    if(Archive.Open(Name)){
+      extension = strrchr(Archive.GetMemberName(), '.');
+      if(extension && isdigit(extension[1]) && isdigit(extension[2]) && isdigit(extension[3]) && !extension[4]){
+        if(atoi(extension + 1) > BestIndex){
+          strcpy(buffer, Name);
+          BestIndex = atoi(extension + 1);
+          Crc = Archive.GetCrc();
+        }
+      }
+      Archive.Close();
+    }
+    done=_dos_findnext(&found);
+  }
+  if(BestIndex < 0) return(0xFFFFU);
+  return((unsigned short) BestIndex);
+}
+
+
 /*
 **    AddToPrivate
 **
@@ -702,6 +1987,8 @@ int AddToPoint(char * Parameter){
 **    AppendFile
 **
 ** Appends a file to an existing file, optionally adding a brief header line.
+** The program stops if the file, or the archive it is in, cannot be read
+** to the end.
 **
 **    Parameters
 **
@@ -716,43 +2003,102 @@ int AddToPoint(char * Parameter){
 **/
 int AppendFile(char * FileName, char * Existing, char * Header)
 {
-  FILE * NewSection, * ExistingSection;
-  char * TransferBuffer = new char[4096];
-  size_t BytesCopied;
-
+  FILE * NewSection = NULL, * ExistingSection;
+  FDNArchive * Archive = NULL;
+  char * TransferBuffer;
+  size_t BufferSize = NODEBLOCK, BytesCopied;
+  long Remaining;
+  clock_t Start = clock();
+  int Success = 1, Damaged = 0;
+
+  // Copy in large blocks, making do with less if memory is short
+  TransferBuffer = new char[BufferSize];
+  if(!TransferBuffer){
+    BufferSize = 4096;
+    TransferBuffer = new char[BufferSize];
+  }
   if(!TransferBuffer) return(0);
 
-  NewSection = _fsopen(FileName, "rb", SH_DENYNO);
-  if(!NewSection) return(0);
+  // A list in an archive is unpacked straight into the existing file
+  if(FDNArchive::IsArchive(FileName)){
+    Archive = new FDNArchive;
+    if(Archive && !Archive->Open(FileName)){
+      delete Archive;
+      Archive = NULL;
+    }
+    if(!Archive){
+      delete [] TransferBuffer;
+      return(0);
+    }
+    Remaining = (long) Archive->GetSize();
+  }
+  else{
+    NewSection = _fsopen(FileName, "rb", SH_DENYNO);
+    if(!NewSection){
+      delete [] TransferBuffer;
+      return(0);
+    }
+    fseek(NewSection, 0L, SEEK_END);
+    Remaining = ftell(NewSection);
+    fseek(NewSection, 0L, SEEK_SET);
+  }
 
   if(!CheckFile(Existing)) ExistingSection = _fsopen(Existing, "wb", SH_DENYWR);
   else ExistingSection = _fsopen(Existing, "r+b", SH_DENYWR);
   if(!ExistingSection){
     perror("Can't open file");
+    if(Archive) delete Archive;
+    else fclose(NewSection);
+    delete [] TransferBuffer;
     return(0);
   }
 
   fseek(ExistingSection, 0, SEEK_END);
 
-  printf("  - Incorporating %s\n", FileName);
+  if(Archive) printf("  - Incorporating %s from %s\n", Archive->GetMemberName(), FileName);
+  else printf("  - Incorporating %s\n", FileName);
 
   fprintf(ExistingSection, "%s", Header);
 
-  while(!feof(NewSection)){
-    BytesCopied = fread(TransferBuffer, 1, 4096, NewSection);
-    if(BytesCopied){
-      if(TransferBuffer[BytesCopied - 1] == 0x1A) BytesCopied--;
-      fwrite(TransferBuffer, 1, BytesCopied, ExistingSection);
-    }
+  // Only an end of file marker at the very end of the list is dropped
+  while(Remaining > 0){
+    BytesCopied = (Remaining < (long) BufferSize) ? (size_t) Remaining : BufferSize;
+    if(Archive) BytesCopied = Archive->Read(TransferBuffer, BytesCopied);
+    else BytesCopied = fread(TransferBuffer, 1, BytesCopied, NewSection);
+    if(!BytesCopied) break;
+    Remaining -= (long) BytesCopied;
+    if(!Remaining && (TransferBuffer[BytesCopied - 1] == 0x1A)) BytesCopied--;
+    if(fwrite(TransferBuffer, 1, BytesCopied, ExistingSection) != BytesCopied) Success = 0;
+    Assembled += (long) BytesCopied;
   }
 
   fprintf(ExistingSection, "\r\n");
 
-  fclose(NewSection);
-  fclose(ExistingSection);
+  if(Archive){
+    if(Archive->GetError()){
+      printf("(!) %s is damaged\n", FileName);
+      Damaged = 1;
+    }
+    delete Archive;
+  }
+  else fclose(NewSection);
+  if(!Damaged && (Remaining > 0)){
+    printf("(!) Unable to read all of %s\n", FileName);
+    Damaged = 1;
+  }
+  if(fclose(ExistingSection)) Success = 0;
+  if(!Success) printf("(!) Unable to write to %s\n", Existing);
 
-  delete TransferBuffer;
-  return(1);
+  delete [] TransferBuffer;
+  Assembling += clock() - Start;
+
+  // A list which ends early, or fails its CRC, would be compiled as a
+  // truncated list, so give up as ProcessNodeFile() does
+  if(Damaged){
+    remove(Existing);
+    exit(3);
+  }
+  return(Success);
 }
 
 
@@ -0,0 +1,575 @@
+/*
+** Piglet Productions
+**
+** FileName       : FDNARC.CPP
+**
+** Implements     : FDNArchive
+**
+** Description
+**
+** Reading of nodelists from ZIP archives, see FDNARC.H. The unpacking of
+** deflated data follows the description in RFC 1951, decoding a bit at a
+** time, which is ample for a nodelist.
+**
+**
+** Copyright applies on this file, and distribution may be limited.
+*/
+
+#include "fdnarc.h"
+#include <string.h>
+
+
+// Base values and extra bits for the lengths and distances of matches
+
+static const unsigned short LengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short LengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short DistanceBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+  8193, 12289, 16385, 24577 };
+static const short DistanceExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// The order in which the lengths of the code length code are sent
+
+static const short LengthOrder[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+
+// Little endian values from the archive headers
+
+static unsigned int GetShort(const unsigned char * p)
+{
+  return((unsigned int) p[0] | ((unsigned int) p[1] << 8));
+}
+
+
+static unsigned long GetLong(const unsigned char * p)
+{
+  return((unsigned long) GetShort(p) | ((unsigned long) GetShort(p + 2) << 16));
+}
+
+
+/*
+**    FDNArchive
+**
+** Constructor, the archive is opened with Open()
+**
+**/
+FDNArchive::FDNArchive()
+{
+  File   = NULL;
+  In     = NULL;
+  Window = NULL;
+  Close();
+}
+
+
+FDNArchive::~FDNArchive()
+{
+  Close();
+}
+
+
+/*
+**    IsArchive
+**
+** Looks at the start of a file to see if it is a ZIP archive.
+**
+**    Parameters
+**
+**    Filename    The file in question
+**
+**    Returns
+**
+**    1 if it is, 0 if not or it cannot be read
+**
+*/
+int FDNArchive::IsArchive(const char * Filename)
+{
+  FILE * Test;
+  unsigned char Signature[4];
+  int Result = 0;
+
+  Test = fopen(Filename, "rb");
+  if(!Test) return(0);
+  if((fread(Signature, 1, 4, Test) == 4) && (GetLong(Signature) == 0x04034B50UL)) Result = 1;
+  fclose(Test);
+  return(Result);
+}
+
+
+/*
+**    Open
+**
+** Opens an archive, and readies the first file in it to be read.
+**
+** The central directory at the end of the archive is used to find the
+** member, since the headers in front of the data may not hold its size.
+**
+**    Parameters
+**
+**    Filename    The archive
+**
+**    Returns
+**
+**    1 on success, 0 on failure (see GetError())
+**
+*/
+int FDNArchive::Open(const char * Filename)
+{
+  unsigned char Header[46];
+  long End, Start, Base, Position, Directory = -1, Local;
+  unsigned Entries = 0, Length, Skip;
+  size_t Bytes;
+  int Flags = 0, Found = 0;
+
+  Close();
+  File = fopen(Filename, "rb");
+  if(!File){
+    error = FDNArcNoFile;
+    return(0);
+  }
+  In = new unsigned char[ARCBUFFER];
+  if(!In){
+    Close();
+    error = FDNArcMemory;
+    return(0);
+  }
+
+  // The end of central directory record is in the last 64K or so, behind
+  // any comment on the archive
+  fseek(File, 0L, SEEK_END);
+  End = ftell(File);
+  Start = End - (65535L + 22);
+  if(Start < 0) Start = 0;
+  for(Position = End - 22; (Position >= Start) && (Directory < 0); Position = Base - 1){
+    Base = Position - (long) (ARCBUFFER - 22);
+    if(Base < Start) Base = Start;
+    Bytes = (size_t) (Position - Base + 22);
+    fseek(File, Base, SEEK_SET);
+    if(fread(In, 1, Bytes, File) != Bytes) break;
+    for(; Position >= Base; Position--){
+      if(GetLong(In + (size_t) (Position - Base)) == 0x06054B50UL){
+        Entries   = GetShort(In + (size_t) (Position - Base) + 10);
+        Directory = (long) GetLong(In + (size_t) (Position - Base) + 16);
+        break;
+      }
+    }
+  }
+  if(Directory < 0){
+    Close();
+    error = FDNArcFormat;
+    return(0);
+  }
+
+  // Take the first entry which is not a directory
+  fseek(File, Directory, SEEK_SET);
+  for(; Entries && !Found; Entries--){
+    if((fread(Header, 1, 46, File) != 46) || (GetLong(Header) != 0x02014B50UL)) break;
+    Flags  = (int) GetShort(Header + 8);
+    Method = (int) GetShort(Header + 10);
+    Crc    = GetLong(Header + 16);
+    Packed = GetLong(Header + 20);
+    Size   = GetLong(Header + 24);
+    Length = GetShort(Header + 28);
+    Skip   = GetShort(Header + 30) + GetShort(Header + 32);
+    Local  = (long) GetLong(Header + 42);
+    Bytes  = (Length < sizeof(Member)) ? Length : sizeof(Member) - 1;
+    if(fread(Member, 1, Bytes, File) != Bytes) break;
+    Member[Bytes] = 0;
+    fseek(File, (long) (Length - Bytes) + Skip, SEEK_CUR);
+    if(Bytes && (Member[Bytes - 1] != '/') && (Member[Bytes - 1] != '\\')) Found = 1;
+  }
+  if(!Found || (Flags & 1) || ((Method != 0) && (Method != 8)) || (!Method && (Packed != Size))){
+    Close();
+    error = FDNArcFormat;
+    return(0);
+  }
+
+  // Skip the local header in front of the data
+  fseek(File, Local, SEEK_SET);
+  if((fread(Header, 1, 30, File) != 30) || (GetLong(Header) != 0x04034B50UL)){
+    Close();
+    error = FDNArcFormat;
+    return(0);
+  }
+  fseek(File, (long) GetShort(Header + 26) + GetShort(Header + 28), SEEK_CUR);
+
+  if(Method){
+    Window = new unsigned char[ARCWINDOW];
+    if(!Window){
+      Close();
+      error = FDNArcMemory;
+      return(0);
+    }
+  }
+  return(1);
+}
+
+
+/*
+**    Close
+**
+** Closes the archive, if one is open, and resets the state
+**
+**/
+void FDNArchive::Close()
+{
+  if(File) fclose(File);
+  if(In) delete [] In;
+  if(Window) delete [] Window;
+  File         = NULL;
+  In           = NULL;
+  Window       = NULL;
+  error        = FDNArcOk;
+  *Member      = 0;
+  Method       = 0;
+  Size         = 0;
+  Crc          = 0;
+  Packed       = 0;
+  Done         = 0;
+  Running      = 0xFFFFFFFFUL;
+  InSize       = 0;
+  InNext       = 0;
+  BitBuffer    = 0;
+  BitCount     = 0;
+  WindowNext   = 0;
+  Last         = 0;
+  Block        = 0;
+  Stored       = 0;
+  CopyLength   = 0;
+  CopyDistance = 0;
+}
+
+
+/*
+**    Read
+**
+** Reads the next part of the member, unpacking it as needed. Once all
+** of it has been read, it is checked against the CRC in the archive.
+**
+**    Parameters
+**
+**    Buffer      Where to place the data
+**    Bytes       How much to read
+**
+**    Returns
+**
+**    The number of bytes read, which is less than Bytes only at the end of
+**    the member, or on an error (see GetError())
+**
+*/
+size_t FDNArchive::Read(void * Buffer, size_t Bytes)
+{
+  unsigned char * Out = (unsigned char *) Buffer;
+  unsigned char Byte;
+  size_t Count = 0, Chunk, loop;
+  int Symbol, bit;
+
+  if(!File || error) return(0);
+  while((Count < Bytes) && !error && (Done < Size)){
+    if(!Method){
+      Chunk = Bytes - Count;
+      if(Chunk > Size - Done) Chunk = (size_t) (Size - Done);
+      Chunk = fread(Out + Count, 1, Chunk, File);
+      if(!Chunk) error = FDNArcData;
+      Done  += Chunk;
+      Count += Chunk;
+      continue;
+    }
+    if(CopyLength){
+      Byte = Window[(WindowNext - CopyDistance) & (ARCWINDOW - 1)];
+      Put(Byte);
+      Out[Count++] = Byte;
+      CopyLength--;
+      continue;
+    }
+    switch(Block){
+      case 1:
+        if(!Stored){
+          Block = 0;
+          break;
+        }
+        Byte = (unsigned char) GetBits(8);
+        Put(Byte);
+        Out[Count++] = Byte;
+        Stored--;
+        break;
+      case 2:
+        Symbol = Decode(Lengths);
+        if(Symbol < 256){
+          if(Symbol < 0){
+            error = FDNArcData;
+            break;
+          }
+          Byte = (unsigned char) Symbol;
+          Put(Byte);
+          Out[Count++] = Byte;
+        }
+        else if(Symbol == 256) Block = 0;
+        else{
+          Symbol -= 257;
+          if(Symbol >= 29){
+            error = FDNArcData;
+            break;
+          }
+          CopyLength = LengthBase[Symbol] + GetBits(LengthExtra[Symbol]);
+          Symbol = Decode(Distances);
+          if((Symbol < 0) || (Symbol >= 30)){
+            error = FDNArcData;
+            break;
+          }
+          CopyDistance = DistanceBase[Symbol] + GetBits(DistanceExtra[Symbol]);
+          if(CopyDistance > Done) error = FDNArcData;
+        }
+        break;
+      default:
+        // The data ran out before the size given in the archive
+        if(Last) error = FDNArcData;
+        else StartBlock();
+        break;
+    }
+  }
+
+  for(loop = 0; loop < Count; loop++){
+    Running ^= Out[loop];
+    for(bit = 0; bit < 8; bit++) Running = (Running >> 1) ^ ((Running & 1) ? 0xEDB88320UL : 0);
+  }
+  if(!error && (Done == Size) && ((~Running & 0xFFFFFFFFUL) != Crc)) error = FDNArcCrc;
+  return(Count);
+}
+
+
+/*
+**    FillInput, GetBits
+**
+** Reading of the packed data, a few bits at a time, least significant
+** first.
+**
+**    Parameters
+**
+**    Bits        The number of bits wanted, up to 16
+**
+**    Returns
+**
+**    FillInput() returns 1 if more data was read, 0 if not.
+**    GetBits() returns the value of the bits, which is 0 on an error.
+**
+*/
+int FDNArchive::FillInput()
+{
+  size_t Chunk = ARCBUFFER;
+
+  if(Chunk > Packed) Chunk = (size_t) Packed;
+  if(!Chunk) return(0);
+  InSize = (unsigned) fread(In, 1, Chunk, File);
+  InNext = 0;
+  Packed -= InSize;
+  return(InSize != 0);
+}
+
+
+unsigned FDNArchive::GetBits(int Bits)
+{
+  unsigned Value;
+
+  while(BitCount < Bits){
+    if((InNext == InSize) && !FillInput()){
+      error = FDNArcData;
+      return(0);
+    }
+    BitBuffer |= (unsigned long) In[InNext++] << BitCount;
+    BitCount += 8;
+  }
+  Value = (unsigned) (BitBuffer & ((1UL << Bits) - 1));
+  BitBuffer >>= Bits;
+  BitCount -= Bits;
+  return(Value);
+}
+
+
+/*
+**    Construct, Decode
+**
+** Huffman codes are sent as the length of the code for each symbol. Codes
+** of the same length are consecutive, in symbol order, so counting the
+** codes of each length is all that is needed to decode them.
+**
+**    Parameters
+**
+**    Code        The code to build, or decode with
+**    Length      The code length of each symbol, 0 for symbols not used
+**    Symbols     The number of symbols
+**
+**    Returns
+**
+**    Construct() returns 0 for a complete code, a negative value if too
+**    many codes were given, and a positive one if there are codes to spare.
+**    Decode() returns the symbol read, or -1 if there is none.
+**
+*/
+int FDNArchive::Construct(FDNHuffman & Code, const short * Length, int Symbols)
+{
+  short Offset[16];
+  int Symbol, Bits;
+  long Left = 1;
+
+  for(Bits = 0; Bits < 16; Bits++) Code.Count[Bits] = 0;
+  for(Symbol = 0; Symbol < Symbols; Symbol++) Code.Count[Length[Symbol]]++;
+  if(Code.Count[0] == Symbols) return(0);
+
+  for(Bits = 1; Bits < 16; Bits++){
+    Left <<= 1;
+    Left -= Code.Count[Bits];
+    if(Left < 0) return(-1);
+  }
+
+  Offset[1] = 0;
+  for(Bits = 1; Bits < 15; Bits++) Offset[Bits + 1] = (short) (Offset[Bits] + Code.Count[Bits]);
+  for(Symbol = 0; Symbol < Symbols; Symbol++){
+    if(Length[Symbol]) Code.Symbol[Offset[Length[Symbol]]++] = (short) Symbol;
+  }
+  return(Left ? 1 : 0);
+}
+
+
+int FDNArchive::Decode(FDNHuffman & Code)
+{
+  long Value = 0, First = 0, Count;
+  int Bits, Index = 0;
+
+  for(Bits = 1; (Bits < 16) && !error; Bits++){
+    Value |= GetBits(1);
+    Count = Code.Count[Bits];
+    if(Value - Count < First) return(Code.Symbol[Index + (int) (Value - First)]);
+    Index += (int) Count;
+    First += Count;
+    First <<= 1;
+    Value <<= 1;
+  }
+  return(-1);
+}
+
+
+/*
+**    StartBlock
+**
+** Reads the header of the next deflate block, and the codes for it if
+** they are sent with it.
+**
+**    Returns
+**
+**    1 on success, 0 on error
+**
+*/
+int FDNArchive::StartBlock()
+{
+  short Length[286 + 30];
+  int Literals, Dists, Codes, Index, Symbol, Repeat, Result;
+  short Previous;
+
+  Last = (int) GetBits(1);
+  switch(GetBits(2)){
+    case 0:
+      // Stored, from the next byte boundary
+      BitBuffer = 0;
+      BitCount  = 0;
+      Stored = GetBits(16);
+      if((GetBits(16) ^ 0xFFFFU) != (unsigned) Stored) error = FDNArcData;
+      Block = 1;
+      break;
+
+    case 1:
+      // Packed with the fixed codes
+      for(Index = 0; Index < 144; Index++) Length[Index] = 8;
+      for(; Index < 256; Index++) Length[Index] = 9;
+      for(; Index < 280; Index++) Length[Index] = 7;
+      for(; Index < 288; Index++) Length[Index] = 8;
+      Construct(Lengths, Length, 288);
+      for(Index = 0; Index < 30; Index++) Length[Index] = 5;
+      Construct(Distances, Length, 30);
+      Block = 2;
+      break;
+
+    case 2:
+      // Packed with codes sent first, themselves sent using a code which
+      // is built in Distances until it is needed
+      Literals = (int) GetBits(5) + 257;
+      Dists    = (int) GetBits(5) + 1;
+      Codes    = (int) GetBits(4) + 4;
+      if((Literals > 286) || (Dists > 30)){
+        error = FDNArcData;
+        break;
+      }
+      for(Index = 0; Index < 19; Index++) Length[LengthOrder[Index]] = (short) ((Index < Codes) ? GetBits(3) : 0);
+      if(Construct(Distances, Length, 19)){
+        error = FDNArcData;
+        break;
+      }
+      for(Index = 0; (Index < Literals + Dists) && !error; ){
+        Symbol = Decode(Distances);
+        if(Symbol < 0) error = FDNArcData;
+        else if(Symbol < 16) Length[Index++] = (short) Symbol;
+        else{
+          Previous = 0;
+          if(Symbol == 16){
+            if(!Index){
+              error = FDNArcData;
+              break;
+            }
+            Previous = Length[Index - 1];
+            Repeat = 3 + (int) GetBits(2);
+          }
+          else if(Symbol == 17) Repeat = 3 + (int) GetBits(3);
+          else Repeat = 11 + (int) GetBits(7);
+          if(Index + Repeat > Literals + Dists){
+            error = FDNArcData;
+            break;
+          }
+          while(Repeat--) Length[Index++] = Previous;
+        }
+      }
+      if(error) break;
+      // There must be a code for the end of the block, and only a single
+      // code may be left incomplete
+      Result = Construct(Lengths, Length, Literals);
+      if(!Length[256] || (Result < 0) || (Result && (Literals - Lengths.Count[0] != 1))){
+        error = FDNArcData;
+        break;
+      }
+      Result = Construct(Distances, Length + Literals, Dists);
+      if((Result < 0) || (Result && (Dists - Distances.Count[0] != 1))){
+        error = FDNArcData;
+        break;
+      }
+      Block = 2;
+      break;
+
+    default:
+      error = FDNArcData;
+      break;
+  }
+  return(!error);
+}
+
+
+/*
+**    Put
+**
+** Adds a byte unpacked to the window, for later matches to refer to
+**
+**/
+void FDNArchive::Put(unsigned char Byte)
+{
+  Window[WindowNext] = Byte;
+  WindowNext = (WindowNext + 1) & (ARCWINDOW - 1);
+  Done++;
+}
+
+/* end of file fdnarc.cpp */
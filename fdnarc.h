@@ -0,0 +1,115 @@
+/*
+** Piglet Productions
+**
+** FileName       : FDNARC.H
+**
+** Defines        : FDNArchive
+**
+** Description
+**
+** Reads a nodelist out of the ZIP archive it was distributed in, unpacking
+** it as it is read, so that a compiler can take it straight from the
+** archive without it first being unpacked to disk. Only stored and
+** deflated members are understood, which covers every nodelist archive
+** seen in practice.
+**
+**
+** Copyright applies on this file, and distribution may be limited.
+*/
+
+#ifndef _FDN_FDNARC
+#define _FDN_FDNARC
+
+#include <stdio.h>
+#include <stddef.h>
+
+// The distance back which deflate may refer, and the size of the buffer
+// used for reading the archive
+
+#define ARCWINDOW   32768U
+#define ARCBUFFER   4096U
+
+// The error codes for FDNArchive, as returned by GetError()
+
+#define FDNArcOk        0     // No error
+#define FDNArcNoFile    1     // The archive could not be opened
+#define FDNArcFormat    2     // Not a ZIP archive, or the member is encrypted or packed in a way not understood
+#define FDNArcMemory    3     // Not enough memory
+#define FDNArcData      4     // The packed data is damaged
+#define FDNArcCrc       5     // The unpacked data does not match the CRC in the archive
+
+
+// The code lengths of a Huffman code, arranged for decoding
+
+class FDNHuffman
+{
+  public :
+
+  short Count[16];    // The number of codes of each length
+  short Symbol[288];  // The symbols, in order of their codes
+};
+
+
+class FDNArchive
+{
+  // Data
+
+  protected :
+
+    FILE *          File;
+    int             error;
+    char            Member[80];     // Name of the member being read
+    int             Method;         // 0 for stored, 8 for deflated
+    unsigned long   Size;           // Size of the member once unpacked
+    unsigned long   Crc;            // CRC-32 of the member, from the archive
+    unsigned long   Packed;         // Packed bytes still to be read from the file
+    unsigned long   Done;           // Bytes unpacked so far
+    unsigned long   Running;        // CRC-32 of those bytes, so far
+
+    unsigned char * In;             // Packed data waiting to be decoded
+    unsigned        InSize;
+    unsigned        InNext;
+    unsigned long   BitBuffer;
+    int             BitCount;
+
+    unsigned char * Window;         // The last ARCWINDOW bytes unpacked
+    unsigned        WindowNext;
+    int             Last;           // The final block has been started
+    int             Block;          // 0 between blocks, 1 in a stored block, 2 in a packed one
+    unsigned long   Stored;         // Bytes left in a stored block
+    unsigned        CopyLength;     // Bytes left of a match being copied
+    unsigned        CopyDistance;
+    FDNHuffman      Lengths;        // Codes for the literals and lengths of the current block
+    FDNHuffman      Distances;      // Codes for the distances of the current block
+
+  // Implementation
+
+  public :
+
+    FDNArchive();
+    virtual ~FDNArchive();
+
+    int            Open(const char * Filename);
+    void           Close();
+    size_t         Read(void * Buffer, size_t Bytes);
+
+    const char *   GetMemberName() { return(Member); }
+    unsigned long  GetSize()       { return(Size); }
+    unsigned long  GetCrc()        { return(Crc); }
+    int            GetError()      { return(error); }
+
+    static int     IsArchive(const char * Filename);
+
+  protected :
+
+    int            FillInput();
+    unsigned       GetBits(int Bits);
+    int            Construct(FDNHuffman & Code, const short * Length, int Symbols);
+    int            Decode(FDNHuffman & Code);
+    int            StartBlock();
+    void           Put(unsigned char Byte);
+};
+
+#endif
+
+/* end of file fdnarc.h */
@@ -0,0 +1,680 @@
+/*
+** Piglet Productions
+**
+** FileName       : FDNBATCH.CPP
+**
+** Implements     : FDNBatch, FDNNodeLookup, FDNPhoneLookup, FDNListLookup
+**
+** Description
+**
+** Lookups run together, their page reads made side by side. See FDNBATCH.H.
+**
+**
+** Copyright applies on this file, and distribution may be limited.
+*/
+
+#include "fdnbatch.h"
+#include <stdio.h>
+
+
+/*
+**    FDNNodeLookup
+**
+** A lookup by address, or by the name of the sysop.
+*/
+FDNNodeLookup::FDNNodeLookup(unsigned short zone, unsigned short net, unsigned short node, unsigned short point)
+{
+  ByName = 0;
+  Address[0] = zone;
+  Address[1] = net;
+  Address[2] = node;
+  Address[3] = point;
+  *UserName = 0;
+  Found = 0;
+}
+
+
+FDNNodeLookup::FDNNodeLookup(const char * username)
+{
+  ByName = 1;
+  Address[0] = Address[1] = Address[2] = Address[3] = 0;
+  strncpy(UserName, username, FDNLOOKUPTEXT - 1);
+  UserName[FDNLOOKUPTEXT - 1] = 0;
+  Found = 0;
+}
+
+
+static void CopyText(char * To, const char * From)
+{
+  if(From) strncpy(To, From, FDNLOOKUPTEXT - 1);
+  else *To = 0;
+  To[FDNLOOKUPTEXT - 1] = 0;
+}
+
+
+void FDNNodeLookup::Perform(FrontDoorNode & Nodelist)
+{
+  FDNFind Match;
+
+  if(ByName) Found = !Nodelist.Find(Match, UserName);
+  else Found = !Nodelist.Find(Match, Address[0], Address[1], Address[2], Address[3]);
+
+  if(!Found){
+    Offset = 0;
+    Speed = 0;
+    Zone = Net = Node = Point = 0;
+    *SysName = *Location = *Sysop = *Number = *Flags = 0;
+    return;
+  }
+  Offset = Match.GetOffset();
+  Zone   = Match.GetZone();
+  Net    = Match.GetNet();
+  Node   = Match.GetNode();
+  Point  = Match.GetPoint();
+  Speed  = Nodelist.GetSpeed(Match);
+  CopyText(SysName,  Nodelist.GetSysName(Match));
+  CopyText(Location, Nodelist.GetLocation(Match));
+  CopyText(Sysop,    Nodelist.GetSysop(Match));
+  CopyText(Number,   Nodelist.GetNumber(Match));
+  CopyText(Flags,    Nodelist.GetFlags(Match));
+}
+
+
+/*
+**    FDNPhoneLookup
+**
+** A lookup of the cost of calling a node, and the number to dial.
+*/
+FDNPhoneLookup::FDNPhoneLookup(unsigned short zone, unsigned short net, unsigned short node, unsigned short point)
+{
+  Address[0] = zone;
+  Address[1] = net;
+  Address[2] = node;
+  Address[3] = point;
+  Found = 0;
+  Cost = 0xFFFF;
+  *Number = 0;
+}
+
+
+void FDNPhoneLookup::Perform(FrontDoorNode & Nodelist)
+{
+  FDNFind Match;
+
+  *Number = 0;
+  Cost = 0xFFFF;
+  Found = !Nodelist.Find(Match, Address[0], Address[1], Address[2], Address[3]);
+  if(Found) Cost = Nodelist.GetPhoneData(Match, Number);
+}
+
+
+/*
+**    FDNListLookup
+**
+** A list of zones, nets, nodes or points, of up to max entries.
+*/
+FDNListLookup::FDNListLookup(int type, unsigned short zone, unsigned short net, unsigned short node, int max)
+{
+  Type = type;
+  Address[0] = zone;
+  Address[1] = net;
+  Address[2] = node;
+  Entries = 0;
+  Entry = new FDNListEntry[max];
+  MaxEntries = Entry ? max : 0;
+}
+
+
+FDNListLookup::~FDNListLookup()
+{
+  delete[] Entry;
+}
+
+
+void FDNListLookup::Perform(FrontDoorNode & Nodelist)
+{
+  FDNFind Match;
+
+  Entries = 0;
+  switch(Type){
+    case FDNListZones  : Nodelist.GetZones(Match); break;
+    case FDNListNets   : Nodelist.GetNets(Match, Address[0]); break;
+    case FDNListNodes  : Nodelist.GetNodes(Match, Address[0], Address[1]); break;
+    case FDNListPoints : Nodelist.GetPoints(Match, Address[0], Address[1], Address[2]); break;
+    default            : return;
+  }
+  while(Match && Entries < MaxEntries){
+    Entry[Entries].Zone   = Match.GetZone();
+    Entry[Entries].Net    = Match.GetNet();
+    Entry[Entries].Node   = Match.GetNode();
+    Entry[Entries].Point  = Match.GetPoint();
+    Entry[Entries].Offset = Match.GetOffset();
+    Entries++;
+    if(Entries < MaxEntries) ++Match;
+  }
+}
+
+
+/*
+**    FDNBatch
+**
+** A batch for lookups on Node, which should already be thawed. Size is the
+** number of lookups it can hold at once.
+*/
+FDNBatch::FDNBatch(FrontDoorNode & Node) : Nodelist(Node)
+{
+  Constructor(FDNBATCHSIZE);
+}
+
+
+FDNBatch::FDNBatch(FrontDoorNode & Node, int Size) : Nodelist(Node)
+{
+  Constructor(Size);
+}
+
+
+void FDNBatch::Constructor(int Size)
+{
+  int loop;
+
+  Lookups = 0;
+  Lookup = new FDNLookup *[Size];
+  MaxLookups = Lookup ? Size : 0;
+  for(loop=0; loop<FDNBATCHHASH; loop++) Bucket[loop] = NULL;
+  Wanted = NULL;
+  WantedCount = 0;
+  FileCount = 0;
+  Missed = 0;
+  Flying = 0;
+  Rounds = Reads = Completed = 0;
+#ifdef OverlappedBatch
+  for(loop=0; loop<FDNBATCHDEPTH; loop++){
+    Event[loop] = CreateEvent(NULL, TRUE, FALSE, NULL);
+    InFlight[loop] = NULL;
+  }
+#endif
+}
+
+
+FDNBatch::~FDNBatch()
+{
+  Clear();
+  delete[] Lookup;
+#ifdef OverlappedBatch
+  int loop;
+
+  for(loop=0; loop<FDNBATCHDEPTH; loop++) if(Event[loop]) CloseHandle(Event[loop]);
+#endif
+}
+
+
+/*
+**    Add
+**
+** Adds a lookup to be made by the next Run(), or by Poll(). The lookup
+** remains the caller's, and must last until it is complete. Lookups may be
+** added at any time, from Complete() among other places.
+**
+**    Returns
+**
+**    1 on success, 0 if the batch is full
+*/
+int FDNBatch::Add(FDNLookup & NewLookup)
+{
+  if(Lookups >= MaxLookups) return(0);
+  NewLookup.Done = 0;
+  NewLookup.Error = 0;
+  Lookup[Lookups++] = &NewLookup;
+  return(1);
+}
+
+
+/*
+**    Run
+**
+** Makes every lookup added since the last Run(), a round at a time.
+**
+**    Returns
+**
+**    The number of lookups made
+*/
+int FDNBatch::Run()
+{
+  long Before = Completed;
+
+  while(Poll(1));
+  return((int) (Completed - Before));
+}
+
+
+/*
+**    Poll
+**
+** Collects the reads which have finished, starts those waiting to be made,
+** and once all the reads of a round are in, runs the next round. With Wait
+** set, the reads in progress are waited for first; without it Poll() only
+** waits where there is no overlapped io, as the reads must then be made
+** there and then.
+**
+**    Returns
+**
+**    The number of lookups not yet complete
+*/
+int FDNBatch::Poll(int Wait)
+{
+  if(!Lookups) return(0);
+  Reap(Wait);
+  Start();
+  if(Wanted || Flying) return(Lookups);
+  CloseFiles();
+  Round();
+  if(Lookups) Start();
+  else Clear();
+  return(Lookups);
+}
+
+
+/*
+**    Round
+**
+** Runs each lookup not yet complete, with the nodelist class reading from
+** the batch. Those which complete leave the batch, and are then told so,
+** in the order they were added.
+**
+**    Returns
+**
+**    The number of lookups still to complete, including any added by those
+**    completed
+*/
+int FDNBatch::Round()
+{
+  FDNLookup * Finished = NULL, * Next, * Reversed;
+  int loop, Left = 0;
+
+  Attach(this);
+  for(loop=0; loop<Lookups; loop++){
+    Missed = 0;
+    Nodelist.ClearFDAStore();
+    Nodelist.ClearError();
+    Lookup[loop]->Perform(Nodelist);
+    if(Missed) Lookup[Left++] = Lookup[loop];
+    else{
+      Lookup[loop]->Done = 1;
+      Lookup[loop]->Error = Nodelist.GetError();
+      Lookup[loop]->NextDone = Finished;
+      Finished = Lookup[loop];
+    }
+  }
+  Lookups = Left;
+  Attach(NULL);
+
+  // What the runs which lacked pages left behind is of no use to anyone
+  Nodelist.ClearFDAStore();
+  Nodelist.ClearError();
+  Drop();
+  Rounds++;
+
+  for(Reversed=NULL; Finished; Finished=Next){
+    Next = Finished->NextDone;
+    Finished->NextDone = Reversed;
+    Reversed = Finished;
+  }
+  for(; Reversed; Reversed=Next){
+    Next = Reversed->NextDone;
+    Completed++;
+    Reversed->Complete();
+  }
+  return(Lookups);
+}
+
+
+/*
+**    Read
+**
+** Called by the files of the nodelist class in place of reading. A page
+** the batch holds is copied as the file would have read it. The first
+** page a run lacks is noted to be read; that and any after it are given
+** as failed reads of zeroes, which the nodelist class survives, and the
+** run is repeated once the page has been read.
+*/
+FDNPREF int FDNFUNC FDNBatch::Read(FDNFile & File, long Offset, void * address, size_t Length, int ErrSensitive)
+{
+  FDNBatchPage * Page = NULL;
+  int Slot, Success;
+
+  Slot = FileSlot(File);
+  if(Slot >= 0) Page = FindPage(Slot, Offset, Length);
+  if(Page) Page->Used = Rounds;
+  if(Page && Page->Fetched){
+    if(Page->Got) memcpy(address, Page->Data, Page->Got);
+    if(Page->Got < Length) memset((char *) address + Page->Got, 0, Length - Page->Got);
+    return(!ErrSensitive || Page->Got == Length);
+  }
+  if(!Missed){
+    if(!Page && Slot >= 0) Page = WantPage(Slot, Offset, Length);
+    if(!Page){
+      // There is no room to note it, so read it as the file would have.
+      // SetBatch() starts the position afresh, so it is put back after
+      File.SetBatch(NULL);
+      Success = File.Seek(Offset, SEEK_SET) && File.Read(address, Length, 1, ErrSensitive);
+      File.SetBatch(this);
+      File.Seek(Offset + (long) Length, SEEK_SET);
+      return(Success);
+    }
+    Missed = 1;
+  }
+  memset(address, 0, Length);
+  return(0);
+}
+
+
+/*
+**    Start
+**
+** Starts the reads of the pages noted. Under NT as many are started as
+** there is room for, to be collected by Reap(); elsewhere they are all
+** read now, in order of place in each file.
+*/
+static int ComparePages(const void * First, const void * Second)
+{
+  const FDNBatchPage * One = *(const FDNBatchPage **) First;
+  const FDNBatchPage * Two = *(const FDNBatchPage **) Second;
+
+  if(One->File != Two->File) return(One->File - Two->File);
+  if(One->Offset != Two->Offset) return(One->Offset < Two->Offset ? -1 : 1);
+  return(0);
+}
+
+
+void FDNBatch::Start()
+{
+  FDNBatchPage * Page;
+  int loop;
+
+#ifdef OverlappedBatch
+  HANDLE Handle;
+
+  for(loop=0; Wanted && loop<FDNBATCHDEPTH; loop++){
+    if(InFlight[loop] || !Event[loop]) continue;
+    Page = Wanted;
+    Wanted = Page->NextWanted;
+    Page->NextWanted = NULL;
+    WantedCount--;
+    if(Files[Page->File].Handle == NULL){
+      Files[Page->File].Handle = CreateFile(Files[Page->File].File->GetName(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                            OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+    }
+    Handle = Files[Page->File].Handle;
+    if(Handle == INVALID_HANDLE_VALUE){
+      FetchPage(Page);
+      loop--;
+      continue;
+    }
+    memset(&Request[loop], 0, sizeof(OVERLAPPED));
+    Request[loop].Offset = (DWORD) Page->Offset;
+    Request[loop].hEvent = Event[loop];
+    ResetEvent(Event[loop]);
+    if(ReadFile(Handle, Page->Data, (DWORD) Page->Length, NULL, &Request[loop]) || GetLastError() == ERROR_IO_PENDING){
+      InFlight[loop] = Page;
+      Flying++;
+    }
+    else{
+      // Past the end of the file, most likely
+      Page->Got = 0;
+      Page->Fetched = 1;
+      Reads++;
+    }
+  }
+#else
+  FDNBatchPage * Next;
+  FDNBatchPage ** Order;
+
+  if(!Wanted) return;
+  Order = new FDNBatchPage *[WantedCount];
+  if(Order){
+    for(loop=0, Page=Wanted; Page; Page=Page->NextWanted) Order[loop++] = Page;
+    qsort(Order, WantedCount, sizeof(FDNBatchPage *), ComparePages);
+    for(loop=0; loop<WantedCount; loop++) FetchPage(Order[loop]);
+    delete[] Order;
+  }
+  else{
+    for(Page=Wanted; Page; Page=Page->NextWanted) FetchPage(Page);
+  }
+  for(Page=Wanted; Page; Page=Next){
+    Next = Page->NextWanted;
+    Page->NextWanted = NULL;
+  }
+  Wanted = NULL;
+  WantedCount = 0;
+#endif
+}
+
+
+/*
+**    Reap
+**
+** Collects the overlapped reads which have finished, or with Wait set
+** waits for them all.
+*/
+void FDNBatch::Reap(int Wait)
+{
+#ifdef OverlappedBatch
+  FDNBatchPage * Page;
+  DWORD Got;
+  int loop;
+
+  for(loop=0; Flying && loop<FDNBATCHDEPTH; loop++){
+    Page = InFlight[loop];
+    if(!Page) continue;
+    if(!Wait && !HasOverlappedIoCompleted(&Request[loop])) continue;
+    if(!GetOverlappedResult(Files[Page->File].Handle, &Request[loop], &Got, TRUE)) Got = 0;
+    Page->Got = (size_t) Got;
+    Page->Fetched = 1;
+    Reads++;
+    InFlight[loop] = NULL;
+    Flying--;
+  }
+#else
+  (void) Wait;
+#endif
+}
+
+
+/*
+**    FetchPage
+**
+** Reads one page through the file object of the nodelist class. A page
+** which cannot be read is given as empty, so the lookup wanting it still
+** completes, as it would have had the read failed without the batch.
+*/
+void FDNBatch::FetchPage(FDNBatchPage * Page)
+{
+  FDNBatchFile & Entry = Files[Page->File];
+
+  Page->Got = 0;
+  Page->Fetched = 1;
+  Reads++;
+  if(!Entry.File->GetStatus()){
+    if(!Entry.File->Open()) return;
+    Entry.Opened = 1;
+  }
+  if(Entry.Size < 0) Entry.Size = Entry.File->Size();
+  if(Page->Offset >= Entry.Size) return;
+  Page->Got = Page->Length;
+  if((long) Page->Got > Entry.Size - Page->Offset) Page->Got = (size_t) (Entry.Size - Page->Offset);
+  if(!Entry.File->Seek(Page->Offset, SEEK_SET) || !Entry.File->Read(Page->Data, Page->Got, 1, 1)) Page->Got = 0;
+}
+
+
+/*
+**    CloseFiles
+**
+** Files opened only to be read from are left as they were found.
+*/
+void FDNBatch::CloseFiles()
+{
+  int loop;
+
+  for(loop=0; loop<FileCount; loop++){
+    if(Files[loop].Opened) Files[loop].File->Close();
+    Files[loop].Opened = 0;
+  }
+}
+
+
+/*
+**    Attach
+**
+** Hands the reads of the nodelist class to a batch, or with NULL back to
+** its files.
+*/
+void FDNBatch::Attach(FDNFileBatch * To)
+{
+  int loop;
+
+  Nodelist.NFDX.SetBatch(To);
+  Nodelist.UFDX.SetBatch(To);
+  Nodelist.PFDX.SetBatch(To);
+  Nodelist.PFDA.SetBatch(To);
+  for(loop=0; loop<4; loop++) Nodelist.DataFile[loop].SetBatch(To);
+}
+
+
+/*
+**    Drop
+**
+** Forgets the pages read which no lookup wanted or read this round. A
+** lookup reads its pages in the same order each run, so those it still
+** needs from pages already read are among those it read.
+*/
+void FDNBatch::Drop()
+{
+  FDNBatchPage * Page, ** Link;
+  int loop;
+
+  for(loop=0; loop<FDNBATCHHASH; loop++){
+    for(Link=&Bucket[loop]; (Page = *Link) != NULL; ){
+      if(Page->Fetched && Page->Used != Rounds){
+        *Link = Page->Next;
+        delete[] Page->Data;
+        delete Page;
+      }
+      else Link = &Page->Next;
+    }
+  }
+}
+
+
+/*
+**    Clear
+**
+** Forgets the lookups, and the pages read for them, once any reads in
+** progress have finished.
+*/
+void FDNBatch::Clear()
+{
+  FDNBatchPage * Page, * Next;
+  int loop;
+
+  Reap(1);
+  CloseFiles();
+  for(loop=0; loop<FDNBATCHHASH; loop++){
+    for(Page=Bucket[loop]; Page; Page=Next){
+      Next = Page->Next;
+      delete[] Page->Data;
+      delete Page;
+    }
+    Bucket[loop] = NULL;
+  }
+#ifdef OverlappedBatch
+  for(loop=0; loop<FileCount; loop++){
+    if(Files[loop].Handle && Files[loop].Handle != INVALID_HANDLE_VALUE) CloseHandle(Files[loop].Handle);
+  }
+#endif
+  FileCount = 0;
+  Wanted = NULL;
+  WantedCount = 0;
+  Lookups = 0;
+}
+
+
+/*
+**    FileSlot
+**
+** Finds the entry for a file in Files, adding one if need be.
+**
+**    Returns
+**
+**    The entry, or -1 if there is no room
+*/
+int FDNBatch::FileSlot(FDNFile & File)
+{
+  int loop;
+
+  for(loop=0; loop<FileCount; loop++) if(Files[loop].File == &File) return(loop);
+  if(FileCount == FDNBATCHFILES) return(-1);
+  Files[FileCount].File = &File;
+  Files[FileCount].Size = -1L;
+  Files[FileCount].Opened = 0;
+#ifdef OverlappedBatch
+  Files[FileCount].Handle = NULL;
+#endif
+  return(FileCount++);
+}
+
+
+/*
+**    FindPage, WantPage
+**
+** Find a page held or noted by the batch, or note a new one to be read.
+** A page is only ever read the same way, so it is known by where it is and
+** how long it is.
+**
+**    Returns
+**
+**    The page, or NULL if it is not held, or cannot be noted
+*/
+static unsigned PageBucket(int File, long Offset)
+{
+  return((unsigned) ((((unsigned long) Offset >> 4) ^ ((unsigned long) File * 977UL)) % FDNBATCHHASH));
+}
+
+
+FDNBatchPage * FDNBatch::FindPage(int File, long Offset, size_t Length)
+{
+  FDNBatchPage * Page;
+
+  for(Page=Bucket[PageBucket(File, Offset)]; Page; Page=Page->Next){
+    if(Page->File == File && Page->Offset == Offset && Page->Length == Length) return(Page);
+  }
+  return(NULL);
+}
+
+
+FDNBatchPage * FDNBatch::WantPage(int File, long Offset, size_t Length)
+{
+  FDNBatchPage * Page;
+  unsigned Slot = PageBucket(File, Offset);
+
+  Page = new FDNBatchPage;
+  if(!Page) return(NULL);
+  Page->Data = new char[Length];
+  if(!Page->Data){
+    delete Page;
+    return(NULL);
+  }
+  Page->File = File;
+  Page->Offset = Offset;
+  Page->Length = Length;
+  Page->Got = 0;
+  Page->Fetched = 0;
+  Page->Used = Rounds;
+  Page->Next = Bucket[Slot];
+  Bucket[Slot] = Page;
+  Page->NextWanted = Wanted;
+  Wanted = Page;
+  WantedCount++;
+  return(Page);
+}
+
+/* end of file fdnbatch.cpp */
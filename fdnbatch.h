@@ -0,0 +1,287 @@
+/*
+** Piglet Productions
+**
+** FileName       : FDNBATCH.H
+**
+** Defines        : FDNBatch, FDNLookup, FDNNodeLookup, FDNPhoneLookup,
+**                  FDNListLookup
+**
+** Description
+**
+** Runs many lookups on a FrontDoorNode together, so that the pages they
+** need are read from disc side by side rather than one at a time. Each
+** lookup reads a page of each level of an index, and then a line of the
+** nodelist, and every one of these reads waits on the one before; but the
+** reads of different lookups do not wait on each other.
+**
+** A lookup is run with the reads of the nodelist class made from pages the
+** batch holds. When it needs a page the batch does not have, the page is
+** noted and the rest of the run counts for nothing. Once each lookup has
+** been run, the pages noted are read together, and the lookups not yet
+** complete are run again, each getting one read further than before. A
+** lookup is complete when it runs with every page it needs to hand, so its
+** results are exactly those it would have had without the batch.
+**
+** Under NT the pages of each round are read with overlapped io, up to
+** FDNBATCHDEPTH at once. Elsewhere they are read in order of their place in
+** each file, so at least no page is read twice and the heads move one way.
+**
+** A program with its own loop of events may add lookups as they arise and
+** call Poll() from the loop, rather than Run(); each lookup is told when it
+** is complete through Complete(). The batch keeps only the pages the
+** lookups still running have used, so it may be fed without end.
+**
+**
+** Copyright applies on this file, and distribution may be limited.
+*/
+
+#ifndef _FDN_FDNBATCH
+#define _FDN_FDNBATCH
+
+#include "fdnode.h"
+
+#if defined(__NT__)
+#define OverlappedBatch
+#include <windows.h>
+#endif
+
+#define FDNBATCHSIZE    256           // Lookups a batch holds, by default
+#define FDNBATCHDEPTH   64            // Reads in flight at once under NT
+#define FDNBATCHHASH    509           // Buckets for the pages held
+#define FDNBATCHFILES   8             // The indices, PHONE.FDA and the data files
+#define FDNLOOKUPTEXT   128
+
+
+// A lookup to be run by a FDNBatch. Perform() is called with the batch
+// supplying the reads of the nodelist class, perhaps several times, and
+// must do the same each time. It should copy what it wants from the class
+// into the derived class, as only the results of the last run count.
+// Complete() is called once the results are in, with the nodelist class
+// free again; it may Add() further lookups to the batch, or delete this one.
+
+class FDNLookup {
+
+  // Data
+
+  protected :
+
+    int           Done;               // The lookup has run with all it needed
+    int           Error;              // The nodelist class error after that run
+    FDNLookup     * NextDone;         // Completed in the same round
+
+  // Implementation
+
+  public :
+
+    FDNLookup() { Done = Error = 0; }
+    virtual ~FDNLookup() {}
+
+               int  IsDone()   { return(Done); }
+               int  GetError() { return(Error); }
+
+    virtual   void  Perform(FrontDoorNode & Nodelist) = 0;
+    virtual   void  Complete() {}
+
+  friend class FDNBatch;
+};
+
+
+// Finds a node by address, or by the name of its sysop (surname first, as
+// for FrontDoorNode::Find()), and keeps its details.
+
+class FDNNodeLookup : public FDNLookup {
+
+  // Data
+
+  protected :
+
+    int            ByName;
+    unsigned short Address[4];
+    char           UserName[FDNLOOKUPTEXT];
+
+  public :
+
+    int            Found;
+    long           Offset;
+    unsigned long  Speed;
+    unsigned short Zone, Net, Node, Point;
+    char           SysName[FDNLOOKUPTEXT];
+    char           Location[FDNLOOKUPTEXT];
+    char           Sysop[FDNLOOKUPTEXT];
+    char           Number[FDNLOOKUPTEXT];     // Translated for dialling, empty if there is none
+    char           Flags[FDNLOOKUPTEXT];
+
+  // Implementation
+
+  public :
+
+    FDNNodeLookup(unsigned short zone, unsigned short net, unsigned short node, unsigned short point);
+    FDNNodeLookup(const char * username);
+
+    virtual   void  Perform(FrontDoorNode & Nodelist);
+};
+
+
+// Finds a node by address, and the cost of calling it and the number to
+// dial, as FrontDoorNode::GetPhoneData().
+
+class FDNPhoneLookup : public FDNLookup {
+
+  // Data
+
+  protected :
+
+    unsigned short Address[4];
+
+  public :
+
+    int            Found;
+    unsigned short Cost;              // 0xFFFF if there is none
+    char           Number[FDNLOOKUPTEXT];     // Translated for dialling, empty if there is none
+
+  // Implementation
+
+  public :
+
+    FDNPhoneLookup(unsigned short zone, unsigned short net, unsigned short node, unsigned short point);
+
+    virtual   void  Perform(FrontDoorNode & Nodelist);
+};
+
+
+// Lists the zones, the nets of a zone, the nodes of a net or the points of
+// a node, as FrontDoorNode::GetZones() and the like, up to a given number.
+
+#define FDNListZones    2             // As the search types of FDNFind
+#define FDNListNets     3
+#define FDNListNodes    4
+#define FDNListPoints   5
+
+struct FDNListEntry {
+  unsigned short Zone, Net, Node, Point;
+  long           Offset;
+};
+
+class FDNListLookup : public FDNLookup {
+
+  // Data
+
+  protected :
+
+    int            Type;
+    unsigned short Address[3];
+    int            MaxEntries;
+
+  public :
+
+    FDNListEntry   * Entry;
+    int            Entries;
+
+  // Implementation
+
+  public :
+
+    // The address gives the zone, net and node the list is of, as needed
+    FDNListLookup(int type, unsigned short zone, unsigned short net, unsigned short node, int max);
+    virtual ~FDNListLookup();
+
+    virtual   void  Perform(FrontDoorNode & Nodelist);
+};
+
+
+// A page read, or to be read, by a batch
+
+struct FDNBatchPage {
+  FDNBatchPage * Next;                // In its bucket
+  FDNBatchPage * NextWanted;          // Still to be read
+  int            File;                // Entry in FDNBatch::Files
+  long           Offset;
+  size_t         Length;              // Bytes wanted
+  size_t         Got;                 // Bytes read, once Fetched
+  int            Fetched;
+  long           Used;                // The last round to want or read it
+  char           * Data;
+};
+
+// A file of the nodelist class the batch has been asked to read from
+
+struct FDNBatchFile {
+  FDNFile        * File;
+  long           Size;                // -1 until known
+  int            Opened;              // Opened by the batch, to be closed after the round
+#ifdef OverlappedBatch
+  HANDLE         Handle;              // Opened for overlapped io, or INVALID_HANDLE_VALUE
+#endif
+};
+
+
+class FDNBatch : public FDNFileBatch {
+
+  // Data
+
+  protected :
+
+    FrontDoorNode & Nodelist;
+    FDNLookup     ** Lookup;
+    int           Lookups;
+    int           MaxLookups;
+    FDNBatchPage  * Bucket[FDNBATCHHASH];
+    FDNBatchPage  * Wanted;           // The pages to be read this round
+    int           WantedCount;
+    FDNBatchFile  Files[FDNBATCHFILES];
+    int           FileCount;
+    int           Missed;             // The run in progress lacks a page
+    int           Flying;             // Reads in progress
+    long          Rounds, Reads, Completed;
+  #ifdef OverlappedBatch
+    HANDLE        Event[FDNBATCHDEPTH];
+    OVERLAPPED    Request[FDNBATCHDEPTH];
+    FDNBatchPage  * InFlight[FDNBATCHDEPTH];
+  #endif
+
+  // Implementation
+
+  public :
+
+    FDNBatch(FrontDoorNode & Node);
+    FDNBatch(FrontDoorNode & Node, int Size);
+    virtual ~FDNBatch();
+
+    // Lookups are added, and then run together. Add() returns 0 when the
+    // batch is full. Run() returns once every lookup is complete, and
+    // leaves the batch empty again. Poll() does what can be done without
+    // waiting, or with Wait set what one wait allows, and returns the
+    // lookups still pending; it is for programs with a loop of their own.
+               int  Add(FDNLookup & NewLookup);
+               int  IsFull()  { return(Lookups >= MaxLookups); }
+               int  Pending() { return(Lookups); }
+               int  Run();
+               int  Poll(int Wait);
+
+    // Rounds of reads made, pages read, and lookups completed, since the
+    // batch was created
+              long  GetRounds()    { return(Rounds); }
+              long  GetReads()     { return(Reads); }
+              long  GetCompleted() { return(Completed); }
+
+    FDNPREF   virtual int  FDNFUNC Read(FDNFile & File, long Offset, void * address, size_t Length, int ErrSensitive);
+
+  protected :
+
+              void  Constructor(int Size);
+               int  Round();
+              void  Start();
+              void  Reap(int Wait);
+              void  FetchPage(FDNBatchPage * Page);
+              void  CloseFiles();
+              void  Attach(FDNFileBatch * To);
+              void  Drop();
+              void  Clear();
+               int  FileSlot(FDNFile & File);
+      FDNBatchPage  *FindPage(int File, long Offset, size_t Length);
+      FDNBatchPage  *WantPage(int File, long Offset, size_t Length);
+};
+
+#endif
+
+/* end of file fdnbatch.h */
@@ -0,0 +1,552 @@
+/*
+** Piglet Productions
+**
+** FileName       : FDNCACHE.CPP
+**
+** Implements     : FDNCachedNode <- FrontDoorNode
+**
+** Description
+**
+** Page cache for the FrontDoor Nodelist reading code, shared between
+** programs where the platform allows. See FDNCACHE.H.
+**
+**
+** Copyright applies on this file, and distribution may be limited.
+*/
+
+#include "fdncache.h"
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+/*
+**    FDNCachedNode
+**
+** The constructors match those of FrontDoorNode, with the addition of one
+** allowing the number of pages to cache to be chosen. Where the cache is
+** already in use by another program its size is taken from there.
+**
+** The base class is always created frozen, so that the cache is in place
+** before the index is first opened.
+*/
+FDNCachedNode::FDNCachedNode(const char FDNDATA *pathname, const char FDNDATA *path2, unsigned short NewTask)
+  : FrontDoorNode(pathname, path2, FDNodeCreateFrozen, NewTask)
+{
+  Header = NULL;
+  NFDXSum = UFDXSum = NULL;
+  Abandoned = 0;
+  ConfigureDefaults();
+  Thaw();
+}
+
+
+FDNCachedNode::FDNCachedNode(const char FDNDATA *pathname, const char FDNDATA *path2, unsigned short setflags, unsigned short NewTask)
+  : FrontDoorNode(pathname, path2, (unsigned short) (setflags | FDNodeCreateFrozen), NewTask)
+{
+  Header = NULL;
+  NFDXSum = UFDXSum = NULL;
+  Abandoned = 0;
+  ConfigureDefaults();
+  if(!(setflags & FDNodeCreateFrozen)) Thaw();
+}
+
+
+FDNCachedNode::FDNCachedNode(const char FDNDATA *pathname, const char FDNDATA *path2, unsigned short setflags, unsigned short NewTask,
+                             unsigned int nfdxCacheSize, unsigned int ufdxCacheSize)
+  : FrontDoorNode(pathname, path2, (unsigned short) (setflags | FDNodeCreateFrozen), NewTask)
+{
+  Header = NULL;
+  NFDXSum = UFDXSum = NULL;
+  Abandoned = 0;
+  NFDXCacheSize = nfdxCacheSize;
+  UFDXCacheSize = ufdxCacheSize;
+  if(!(setflags & FDNodeCreateFrozen)) Thaw();
+}
+
+
+/*
+**    ~FDNCachedNode
+**
+** Leaves the cache to any other program still using it.
+*/
+FDNCachedNode::~FDNCachedNode()
+{
+  Freeze();
+  Detach();
+  DropSums();
+}
+
+
+/*
+**    ConfigureDefaults
+**
+** Chooses a cache size to suit the platform.
+*/
+void FDNCachedNode::ConfigureDefaults()
+{
+  #if defined(__DOS__) && !defined(__386__)
+  NFDXCacheSize = 16;
+  UFDXCacheSize = 16;
+  #else
+  NFDXCacheSize = 256;
+  UFDXCacheSize = 256;
+  #endif
+}
+
+
+/*
+**    OnThaw
+**
+** Notes the index set now in use, and its page sums if it has any, and
+** attaches to the cache for the nodelist directory if not already
+** attached to it. FrontDoor's own compiler leaves the compile time at
+** zero, so there the size and date of the index files tell one set from
+** the next.
+*/
+FDNPREF void FDNFUNC FDNCachedNode::OnThaw(const char * )
+{
+  unsigned long NewKey = Hash(GetNLDir(), 0);
+
+  Stamp = Hash(GetIndexDir(), GetCompileTime());
+  if(!GetCompileTime()){
+    Stamp = FileStamp("NODELIST.FDX", Stamp);
+    Stamp = FileStamp("USERLIST.FDX", Stamp);
+  }
+  LoadSums();
+  if(Header && NewKey != Key) Detach();
+  Key = NewKey;
+  if(!Header) Attach();
+}
+
+
+/*
+**    LoadSums
+**
+** Reads the page sums of NODELIST.FDX and USERLIST.FDX from SUMFILE, if
+** it was written for the index set in use.
+*/
+void FDNCachedNode::LoadSums()
+{
+  FDN_FileObject Sums;
+  SumHeader Info;
+  char filename[PATHLENGTH];
+  int  success;
+
+  DropSums();
+  if(!GetCompileTime()) return;
+  strcpy(filename, GetIndexDir());
+  strcat(filename, SUMFILE);
+  Sums.SetName(filename);
+  if(!Sums.Open()) return;
+  success = Sums.Read(&Info, sizeof(SumHeader), 1, 1) && !memcmp(Info.Magic, "FDNS", 4) &&
+            Info.CompileTime == GetCompileTime() && Info.Pages[0] > 0 && Info.Pages[1] > 0;
+  if(success){
+    NFDXSum = new unsigned long[(size_t) Info.Pages[0]];
+    UFDXSum = new unsigned long[(size_t) Info.Pages[1]];
+    success = NFDXSum && UFDXSum && Sums.Read(NFDXSum, sizeof(unsigned long), (size_t) Info.Pages[0], 1) &&
+              Sums.Read(UFDXSum, sizeof(unsigned long), (size_t) Info.Pages[1], 1);
+  }
+  Sums.Close();
+  if(!success){
+    DropSums();
+    return;
+  }
+  NFDXSums = Info.Pages[0];
+  UFDXSums = Info.Pages[1];
+}
+
+
+void FDNCachedNode::DropSums()
+{
+  delete [] NFDXSum;
+  delete [] UFDXSum;
+  NFDXSum = UFDXSum = NULL;
+  NFDXSums = UFDXSums = 0;
+}
+
+
+/*
+**    PageStamp
+**
+** What a page must be stored with to be of use to this program: its sum
+** where there is one, or else the index set in use.
+*/
+unsigned long FDNCachedNode::PageStamp(const unsigned long * Sum, long Sums, long page)
+{
+  if(Sum && page > 0 && page < Sums) return(Sum[page]);
+  return(Stamp);
+}
+
+
+/*
+**    ReadStamp
+**
+** What a page just read from disc is stored with: its own sum where there
+** is one, rather than the sum it should have. A page read while the index
+** set was being rewritten in place is then only ever taken for itself.
+*/
+unsigned long FDNCachedNode::ReadStamp(const unsigned long * Sum, long Sums, long page, const void * value, unsigned Length)
+{
+  if(Sum && page > 0 && page < Sums) return(FDNPageSum(value, Length));
+  return(Stamp);
+}
+
+
+/*
+**    FileStamp
+**
+** Adds the size and date of an index file in the set in use to Start.
+*/
+unsigned long FDNCachedNode::FileStamp(const char * Name, unsigned long Start)
+{
+  struct stat Info;
+  char filename[PATHLENGTH];
+
+  strcpy(filename, GetIndexDir());
+  strcat(filename, Name);
+  if(stat(filename, &Info)) return(Start);
+  Start = (Start ^ (unsigned long) Info.st_size) * 0x01000193UL;
+  Start = (Start ^ (unsigned long) Info.st_mtime) * 0x01000193UL;
+  return(Start & 0xFFFFFFFFUL);
+}
+
+
+/*
+**    Attach
+**
+** Finds the shared cache for the nodelist directory, creating it if this
+** is the first program to want it. Failing that, or where memory cannot
+** be shared, a cache private to this program is used instead. If even
+** that cannot be had, pages are simply read from disc as usual.
+*/
+void FDNCachedNode::Attach()
+{
+  unsigned long Size;
+
+  if(!NFDXCacheSize || !UFDXCacheSize) return;
+  Size = sizeof(FDNCacheHeader) + (NFDXCacheSize + UFDXCacheSize) * (unsigned long) sizeof(FDNCacheSlot)
+       + NFDXCacheSize * (unsigned long) sizeof(NFDXPage) + UFDXCacheSize * (unsigned long) sizeof(UFDXPage);
+
+#if defined(__NT__)
+  char Name[24];
+
+  sprintf(Name, "FDNCACHE.%08lX", Key);
+  Mapping = NULL;
+  Guard = CreateMutex(NULL, FALSE, Name);
+  if(Guard && Lock(1)){
+    strcat(Name, ".MEM");
+    Mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, Size, Name);
+    if(Mapping) Header = (FDNCacheHeader *) MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if(Header) Initialise();
+    Unlock();
+  }
+  if(!Header){
+    if(Mapping) CloseHandle(Mapping);
+    if(Guard) CloseHandle(Guard);
+    Mapping = Guard = NULL;
+  }
+#elif defined(__OS2__)
+  char Name[24];
+  PVOID Memory = NULL;
+  APIRET rc;
+
+  sprintf(Name, "\\SEM32\\FDNC%08lX", Key);
+  Guard = 0;
+  rc = DosCreateMutexSem((PSZ) Name, &Guard, 0, FALSE);
+  if(rc == ERROR_DUPLICATE_NAME){
+    Guard = 0;
+    rc = DosOpenMutexSem((PSZ) Name, &Guard);
+  }
+  if(!rc && Lock(1)){
+    sprintf(Name, "\\SHAREMEM\\FDNC%08lX", Key);
+    rc = DosAllocSharedMem(&Memory, (PSZ) Name, Size, PAG_COMMIT | PAG_READ | PAG_WRITE);
+    if(rc == ERROR_ALREADY_EXISTS) rc = DosGetNamedSharedMem(&Memory, (PSZ) Name, PAG_READ | PAG_WRITE);
+    if(!rc){
+      Header = (FDNCacheHeader *) Memory;
+      Initialise();
+    }
+    Unlock();
+  }
+  if(!Header && Guard){
+    DosCloseMutexSem(Guard);
+    Guard = 0;
+  }
+#endif
+
+  // A private cache is better than none
+  if(!Header){
+    Header = (FDNCacheHeader *) new char[(size_t) Size];
+    if(!Header) return;
+    Header->Magic = 0;
+    Initialise();
+  }
+}
+
+
+/*
+**    Initialise
+**
+** Prepares a newly created cache, or takes the layout of one another
+** program has already prepared. The caller must hold the cache lock.
+** If it was left by a program that died, the cache is emptied.
+*/
+void FDNCachedNode::Initialise()
+{
+  unsigned int loop;
+
+  if(Header->Magic != FDNCACHEMAGIC){
+    Header->NFDXSlots = NFDXCacheSize;
+    Header->UFDXSlots = UFDXCacheSize;
+  }
+  NFDXCacheSize = Header->NFDXSlots;
+  UFDXCacheSize = Header->UFDXSlots;
+
+  NFDXSlot  = (FDNCacheSlot *) (Header + 1);
+  UFDXSlot  = NFDXSlot + NFDXCacheSize;
+  NFDXCache = (NFDXPage *) (UFDXSlot + UFDXCacheSize);
+  UFDXCache = (UFDXPage *) (NFDXCache + NFDXCacheSize);
+
+  if(Header->Magic != FDNCACHEMAGIC){
+    for(loop = 0; loop < NFDXCacheSize; loop++){
+      NFDXSlot[loop].Sequence = 0;
+      NFDXSlot[loop].Page = -1;
+    }
+    for(loop = 0; loop < UFDXCacheSize; loop++){
+      UFDXSlot[loop].Sequence = 0;
+      UFDXSlot[loop].Page = -1;
+    }
+    Header->Magic = FDNCACHEMAGIC;
+  }
+  if(Abandoned) Reset();
+}
+
+
+/*
+**    Reset
+**
+** Empties the cache, after a program died holding the lock, perhaps half
+** way through replacing a page. Each slot is given a new even sequence
+** number, so that a copy being taken from it meanwhile is not used. The
+** caller must hold the cache lock.
+*/
+void FDNCachedNode::Reset()
+{
+  unsigned int loop;
+
+  for(loop = 0; loop < NFDXCacheSize; loop++){
+    NFDXSlot[loop].Page = -1;
+    NFDXSlot[loop].Sequence = (NFDXSlot[loop].Sequence | 1) + 1;
+  }
+  for(loop = 0; loop < UFDXCacheSize; loop++){
+    UFDXSlot[loop].Page = -1;
+    UFDXSlot[loop].Sequence = (UFDXSlot[loop].Sequence | 1) + 1;
+  }
+  Abandoned = 0;
+}
+
+
+/*
+**    Detach
+**
+** Lets go of the cache. Shared memory is released by the system once the
+** last program has let go of it.
+*/
+void FDNCachedNode::Detach()
+{
+  if(!Header) return;
+#if defined(__NT__)
+  if(Guard){
+    UnmapViewOfFile(Header);
+    CloseHandle(Mapping);
+    CloseHandle(Guard);
+    Mapping = Guard = NULL;
+    Header = NULL;
+    return;
+  }
+#elif defined(__OS2__)
+  if(Guard){
+    DosFreeMem(Header);
+    DosCloseMutexSem(Guard);
+    Guard = 0;
+    Header = NULL;
+    return;
+  }
+#endif
+  delete [] (char *) Header;
+  Header = NULL;
+}
+
+
+/*
+**    Lock, Unlock
+**
+** Serialise the replacement of pages between programs. Unless Wait is
+** set, Lock() gives up at once if another program holds the lock. A lock
+** left by a program that died is ours all the same, but the cache is
+** emptied, straight away or once attached to, as a page may have been
+** left half stored.
+**
+**    Returns
+**
+**    1 if the lock is held, 0 otherwise
+*/
+int FDNCachedNode::Lock(int Wait)
+{
+#if defined(__NT__)
+  DWORD Result;
+
+  if(!Guard) return(1);
+  Result = WaitForSingleObject(Guard, Wait ? INFINITE : 0);
+  if(Result == WAIT_ABANDONED){
+    Abandoned = 1;
+    if(Header) Reset();
+    return(1);
+  }
+  return(Result == WAIT_OBJECT_0);
+#elif defined(__OS2__)
+  APIRET rc;
+
+  if(!Guard) return(1);
+  rc = DosRequestMutexSem(Guard, Wait ? SEM_INDEFINITE_WAIT : SEM_IMMEDIATE_RETURN);
+  if(rc == ERROR_SEM_OWNER_DIED){
+    Abandoned = 1;
+    if(Header) Reset();
+    return(1);
+  }
+  return(!rc);
+#else
+  (void) Wait;
+  return(1);
+#endif
+}
+
+
+void FDNCachedNode::Unlock()
+{
+#if defined(__NT__)
+  if(Guard) ReleaseMutex(Guard);
+#elif defined(__OS2__)
+  if(Guard) DosReleaseMutexSem(Guard);
+#endif
+}
+
+
+/*
+**    CheckSlot
+**
+** Copies a cached page out if it is the one wanted, stored with Want (see
+** PageStamp()). No lock is taken: if the page was being replaced before or during
+** the copy, the sequence number will show it and the copy is not used.
+**
+**    Returns
+**
+**    1 if tofill now holds the page, 0 otherwise
+*/
+int FDNCachedNode::CheckSlot(FDNCacheSlot * Slot, void * tofill, const void * Cached, unsigned Length, long page, unsigned long Want)
+{
+  unsigned long Before;
+
+#if defined(__NT__)
+  Before = (unsigned long) InterlockedExchangeAdd((LONG *) &Slot->Sequence, 0);
+#else
+  Before = Slot->Sequence;
+#endif
+  if((Before & 1) || Slot->Page != page || Slot->Stamp != Want) return(0);
+  memcpy(tofill, Cached, Length);
+#if defined(__NT__)
+  return((unsigned long) InterlockedExchangeAdd((LONG *) &Slot->Sequence, 0) == Before);
+#else
+  return(Slot->Sequence == Before);
+#endif
+}
+
+
+/*
+**    CommitSlot
+**
+** Stores a page just read from disc, unless another program is busy
+** storing one, in which case it does not matter that this one is not.
+*/
+void FDNCachedNode::CommitSlot(FDNCacheSlot * Slot, const void * value, void * Cached, unsigned Length, long page, unsigned long Want)
+{
+  if(!Lock(0)) return;
+#if defined(__NT__)
+  InterlockedIncrement((LONG *) &Slot->Sequence);
+  memcpy(Cached, value, Length);
+  Slot->Page = page;
+  Slot->Stamp = Want;
+  InterlockedIncrement((LONG *) &Slot->Sequence);
+#else
+  Slot->Sequence++;
+  memcpy(Cached, value, Length);
+  Slot->Page = page;
+  Slot->Stamp = Want;
+  Slot->Sequence++;
+#endif
+  Unlock();
+}
+
+
+/*
+**    CheckNFDXCache, CommitNFDXCache, CheckUFDXCache, CommitUFDXCache
+**
+** The cache hooks of FrontDoorNode. Each page has one place it may be
+** kept, chosen by its number.
+*/
+FDNPREF int FDNFUNC FDNCachedNode::CheckNFDXCache(NFDXPage & tofill, long page)
+{
+  unsigned int Entry;
+
+  if(!Header) return(0);
+  Entry = (unsigned int) (page % NFDXCacheSize);
+  return(CheckSlot(NFDXSlot + Entry, &tofill, NFDXCache + Entry, sizeof(NFDXPage), page, PageStamp(NFDXSum, NFDXSums, page)));
+}
+
+
+FDNPREF void FDNFUNC FDNCachedNode::CommitNFDXCache(NFDXPage & value, long page)
+{
+  unsigned int Entry;
+
+  if(!Header) return;
+  Entry = (unsigned int) (page % NFDXCacheSize);
+  CommitSlot(NFDXSlot + Entry, &value, NFDXCache + Entry, sizeof(NFDXPage), page, ReadStamp(NFDXSum, NFDXSums, page, &value, sizeof(NFDXPage)));
+}
+
+
+FDNPREF int FDNFUNC FDNCachedNode::CheckUFDXCache(UFDXPage & tofill, long page)
+{
+  unsigned int Entry;
+
+  if(!Header) return(0);
+  Entry = (unsigned int) (page % UFDXCacheSize);
+  return(CheckSlot(UFDXSlot + Entry, &tofill, UFDXCache + Entry, sizeof(UFDXPage), page, PageStamp(UFDXSum, UFDXSums, page)));
+}
+
+
+FDNPREF void FDNFUNC FDNCachedNode::CommitUFDXCache(UFDXPage & value, long page)
+{
+  unsigned int Entry;
+
+  if(!Header) return;
+  Entry = (unsigned int) (page % UFDXCacheSize);
+  CommitSlot(UFDXSlot + Entry, &value, UFDXCache + Entry, sizeof(UFDXPage), page, ReadStamp(UFDXSum, UFDXSums, page, &value, sizeof(UFDXPage)));
+}
+
+
+/*
+**    Hash
+**
+** Reduces a path, regardless of case, to a number identifying it.
+*/
+unsigned long FDNCachedNode::Hash(const char * Text, unsigned long Start)
+{
+  unsigned long Value = Start ^ 0x811C9DC5UL;
+
+  while(*Text){
+    Value = (Value ^ (unsigned char) toupper(*Text++)) * 0x01000193UL;
+  }
+  return(Value & 0xFFFFFFFFUL);
+}
+
+/* end of file fdncache.cpp */
@@ -0,0 +1,147 @@
+/*
+** Piglet Productions
+**
+** FileName       : FDNCACHE.H
+**
+** Defines        : FDNCachedNode <- FrontDoorNode
+**
+** Description
+**
+** Page cache for the FrontDoor Nodelist reading code, shared by every
+** program on the machine that reads the same nodelist directory, so that
+** index pages are read from disc once per machine rather than once per
+** program.
+**
+** Under NT and OS/2 the cache lives in named shared memory, found from
+** the nodelist directory, which every program must therefore give in the
+** same form. Elsewhere it is simply private to the program.
+**
+** Each page is stored with the index set it came from, so programs still
+** using an older set (see FDNSnapshots) never see pages of a newer one.
+** Where the set has page sums (see WFDNodeChecksum) a page is stored with
+** the sum of what was read instead, so that pages a compile left alone
+** are still found in the cache afterwards, by programs on either set, and
+** a page read part way through being rewritten is never taken for another.
+** Looking up a page takes no lock: a page being replaced is marked as
+** such while it is copied, and the reader checks the mark before and
+** after copying it. Pages are replaced under a mutex, and a program that
+** finds the mutex held simply does not store its page. Should a program
+** die holding it, the next to take it empties the cache.
+**
+**
+** Copyright applies on this file, and distribution may be limited.
+*/
+
+#ifndef _FDN_FDNCACHE
+#define _FDN_FDNCACHE
+
+#include "fdnode.h"
+
+#if defined(__NT__)
+#define SharedCache
+#include <windows.h>
+#elif defined(__OS2__)
+#define SharedCache
+#define INCL_DOSMEMMGR
+#define INCL_DOSSEMAPHORES
+#define INCL_DOSERRORS
+#include <os2.h>
+#endif
+
+// Marks the start of an initialised cache
+
+#define FDNCACHEMAGIC   0x43444E46UL
+
+
+// The start of the cache, followed by a FDNCacheSlot for each NFDX and
+// then each UFDX page, and then the pages themselves
+
+struct FDNCacheHeader {
+  unsigned long Magic;
+  unsigned int  NFDXSlots;
+  unsigned int  UFDXSlots;
+};
+
+struct FDNCacheSlot {
+  volatile unsigned long Sequence;    // Odd while the page is being replaced
+  volatile long          Page;
+  volatile unsigned long Stamp;       // The index set the page belongs to
+};
+
+
+class FDNCachedNode : public FrontDoorNode {
+
+  // Data
+
+  protected :
+
+    unsigned int    NFDXCacheSize;
+    unsigned int    UFDXCacheSize;
+
+    FDNCacheHeader  * Header;         // NULL if there is no cache
+    FDNCacheSlot    * NFDXSlot;
+    FDNCacheSlot    * UFDXSlot;
+    NFDXPage        * NFDXCache;
+    UFDXPage        * UFDXCache;
+
+    unsigned long   Key;              // Identifies the nodelist directory
+    unsigned long   Stamp;            // Identifies the index set in use
+
+    unsigned long   * NFDXSum;        // Page sums of the index set in use, or NULL
+    unsigned long   * UFDXSum;
+    long            NFDXSums;
+    long            UFDXSums;
+
+    int             Abandoned;        // The lock was left by a program that died
+
+  #if defined(__NT__)
+    HANDLE          Mapping;
+    HANDLE          Guard;            // Held while pages are replaced
+  #elif defined(__OS2__)
+    HMTX            Guard;
+  #endif
+
+  // Implementation
+
+  public :
+
+    FDNCachedNode(const char FDNDATA *pathname, const char FDNDATA *path2, unsigned short NewTask);
+    FDNCachedNode(const char FDNDATA *pathname, const char FDNDATA *path2, unsigned short setflags, unsigned short NewTask);
+    FDNCachedNode(const char FDNDATA *pathname, const char FDNDATA *path2, unsigned short setflags, unsigned short NewTask,
+                  unsigned int nfdxCacheSize, unsigned int ufdxCacheSize);
+
+    virtual ~FDNCachedNode();
+
+    // A class derived from this one must call this from its own OnThaw()
+    FDNPREF    virtual void FDNFUNC OnThaw(const char * Semaphore);
+
+  protected :
+
+    FDNPREF    virtual int  FDNFUNC CheckNFDXCache(NFDXPage & tofill, long page);
+    FDNPREF    virtual void FDNFUNC CommitNFDXCache(NFDXPage & value, long page);
+    FDNPREF    virtual int  FDNFUNC CheckUFDXCache(UFDXPage & tofill, long page);
+    FDNPREF    virtual void FDNFUNC CommitUFDXCache(UFDXPage & value, long page);
+
+                      void  ConfigureDefaults();
+                      void  Attach();
+                      void  Detach();
+                      void  Initialise();
+                      void  Reset();
+                       int  Lock(int Wait);
+                      void  Unlock();
+
+                      void  LoadSums();
+                      void  DropSums();
+             unsigned long  PageStamp(const unsigned long * Sum, long Sums, long page);
+             unsigned long  ReadStamp(const unsigned long * Sum, long Sums, long page, const void * value, unsigned Length);
+             unsigned long  FileStamp(const char * Name, unsigned long Start);
+
+                       int  CheckSlot(FDNCacheSlot * Slot, void * tofill, const void * Cached, unsigned Length, long page, unsigned long Want);
+                      void  CommitSlot(FDNCacheSlot * Slot, const void * value, void * Cached, unsigned Length, long page, unsigned long Want);
+
+    static   unsigned long  Hash(const char * Text, unsigned long Start);
+};
+
+#endif
+
+/* end of file fdncache.h */
@@ -1,4 +1,7 @@
 #include "fdnode.h"
+#ifdef FDN_USESTD
+#include <io.h>
+#endif
 
 /****************************************************************************/
 /*                                                                          */
@@ -18,7 +21,8 @@
 
 // FDNFile::FDNFile()
 // If it is required that you initialise data you may do so in this section
-// You /should/ initialise Status = Error = 0, and ensure FileName is empty.
+// You /should/ initialise Status = Error = 0, and ensure FileName is empty,
+// and that there is no memory Image.
 
 #ifdef FDN_USESTD
 
@@ -26,6 +30,10 @@ FDNFile::FDNFile()
 {
   Status=Error=Flags=0;
   *FileName=0;
+  Image=NULL;
+  Batch=NULL;
+  ImageSize=ImageUsed=ImagePos=0;
+  ImageDirty=0;
   Data = NULL;
 }
 
@@ -35,6 +43,10 @@ FDNFile::FDNFile()
 {
   Status=Error=Flags=0;
   *FileName=0;
+  Image=NULL;
+  Batch=NULL;
+  ImageSize=ImageUsed=ImagePos=0;
+  ImageDirty=0;
 }
 
 #elif defined(FDN_USEHAND)
@@ -43,6 +55,10 @@ FDNFile::FDNFile()
 {
   Status=Error=Flags=0;
   *FileName=0;
+  Image=NULL;
+  Batch=NULL;
+  ImageSize=ImageUsed=ImagePos=0;
+  ImageDirty=0;
   Data = 0;
 }
 
@@ -52,6 +68,7 @@ FDNFile::FDNFile()
 // int FDNFile::Open()
 // Attempt to open the file pointed to in filename and connects it to Data
 // Status should be set to 1 on a successful open.
+// If FDNFileMemory is set the file is then read into memory.
 // Returns 0 on failure, non zero on success.
 
 #ifdef FDN_USESTD
@@ -92,6 +109,7 @@ FDNPREF int  FDNFUNC FDNFile::Open()
   }
   fseek(Data, 0, SEEK_SET);
   Status=1;
+  if(Flags & FDNFileMemory) LoadImage();
   return(1);
 }
 
@@ -126,7 +144,8 @@ FDNPREF int  FDNFUNC FDNFile::Open()
     SignalError(errno);
     return(0);
   }
-  else return(1);
+  if(Flags & FDNFileMemory) LoadImage();
+  return(1);
 }
 
 #elif defined(FDN_USEHAND)
@@ -162,6 +181,7 @@ FDNPREF int  FDNFUNC FDNFile::Open()
   }
   Data = flag;
   Status=1;
+  if(Flags & FDNFileMemory) LoadImage();
   return(1);
 }
 
@@ -170,6 +190,7 @@ FDNPREF int  FDNFUNC FDNFile::Open()
 
 // int FDNFile::Close();
 // Attempts to close the file in use
+// A file held in memory is written back first.
 // Status should be set to zero on successful closure.
 // returns 0 on failure, non zero otherwise.
 
@@ -177,11 +198,13 @@ FDNPREF int  FDNFUNC FDNFile::Open()
 
 FDNPREF int  FDNFUNC FDNFile::Close()
 {
-  int flag;
+  int flag, saved=1;
+  if(Image) saved=SaveImage();
   if(Data) flag=fclose(Data); else return(0);
+  Data=NULL;
   if(!flag){
     Status=0;
-    return(1);
+    return(saved);
   }
   SignalError(errno);
   return(0);
@@ -191,20 +214,24 @@ FDNPREF int  FDNFUNC FDNFile::Close()
 
 FDNPREF int  FDNFUNC FDNFile::Close()
 {
+  int saved=1;
+  if(Image) saved=SaveImage();
   Data.close();
   Status=0;
-  return(1);
+  return(saved);
 }
 
 #elif defined(FDN_USEHAND)
 
 FDNPREF int  FDNFUNC FDNFile::Close()
 {
-  int flag;
+  int flag, saved=1;
+  if(Image) saved=SaveImage();
   if(Data) flag=close(Data); else return(0);
+  Data=0;
   if(!flag){
     Status=0;
-    return(1);
+    return(saved);
   }
   SignalError(errno);
   return(0);
@@ -222,6 +249,7 @@ FDNPREF int  FDNFUNC FDNFile::Close()
 
 FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 {
+  if(Image) return(ImageSeek(offset, whence));
   int flag;
   flag = fseek(Data, offset, whence);
   if(flag){
@@ -236,6 +264,7 @@ FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 
 FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 {
+  if(Image) return(ImageSeek(offset, whence));
   ios::seek_dir s;
   switch(whence){
     case SEEK_SET : s = ios::beg; break;
@@ -256,6 +285,7 @@ FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 
 FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 {
+  if(Image) return(ImageSeek(offset, whence));
   long flag;
   flag = lseek(Data, offset, whence);
   if(flag==-1){
@@ -276,6 +306,7 @@ FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 FDNPREF long int FDNFUNC FDNFile::Size()
 {
   long Extent, Current;
+  if(Image) return(ImageUsed);
   Current = ftell(Data);
   fseek(Data, 0, SEEK_END);
   Extent  = ftell(Data);
@@ -289,6 +320,7 @@ FDNPREF long int FDNFUNC FDNFile::Size()
 FDNPREF long int FDNFUNC FDNFile::Size()
 {
   streampos Extent, Current;
+  if(Image) return(ImageUsed);
   Current = Data.tellp();
   Data.seekg(0, ios::end);
   Extent  = Data.tellp();
@@ -302,6 +334,7 @@ FDNPREF long int FDNFUNC FDNFile::Size()
 FDNPREF long int FDNFUNC FDNFile::Size()
 {
   long Extent, Current;
+  if(Image) return(ImageUsed);
   Current = tell(Data);
   lseek(Data, 0, SEEK_END);
   Extent  = tell(Data);
@@ -312,6 +345,53 @@ FDNPREF long int FDNFUNC FDNFile::Size()
 
 #endif
 
+
+// int FDNFile::Extend(long Length)
+// Sets the length of the file before a memory image is written back, so that
+// the space is allocated at once rather than a little with each write.
+// Returns 0 on failure, 1 otherwise.
+
+#ifdef FDN_USESTD
+
+FDNPREF int  FDNFUNC FDNFile::Extend(long Length)
+{
+  fflush(Data);
+  if(chsize(fileno(Data), Length)){
+    SignalError(errno);
+    return(0);
+  }
+  return(1);
+}
+
+#elif defined(FDN_USEIOS)
+
+FDNPREF int  FDNFUNC FDNFile::Extend(long Length)
+{
+  char Zero = 0;
+  if(Length <= Size()) return(1);
+  Data.seekp(Length - 1L, ios::beg);
+  Data.write(&Zero, 1);
+  if(Data.rdstate()){
+    SignalError(errno);
+    Data.clear();
+    return(0);
+  }
+  return(1);
+}
+
+#elif defined(FDN_USEHAND)
+
+FDNPREF int  FDNFUNC FDNFile::Extend(long Length)
+{
+  if(chsize(Data, Length)){
+    SignalError(errno);
+    return(0);
+  }
+  return(1);
+}
+
+#endif
+
 // int FDNFile::Read(void * address, size_t size, size_t items)
 // This function attempts to read "items" objects of size "size" into the memory
 // location pointed to be address.
@@ -322,6 +402,7 @@ FDNPREF long int FDNFUNC FDNFile::Size()
 
 FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, int ErrSensitive)
 {
+  if(Image) return(ImageRead(address, size, items, ErrSensitive));
   size_t noread;
   noread = fread(address, size, items, Data);
   if(ErrSensitive && (noread!=items)){
@@ -336,6 +417,7 @@ FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, in
 
 FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, int ErrSensitive)
 {
+  if(Image) return(ImageRead(address, size, items, ErrSensitive));
   Data.read((char *) address, (int) (size * items));
   if(ErrSensitive && Data.rdstate()){
     SignalError(errno);
@@ -350,6 +432,7 @@ FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, in
 
 FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, int ErrSensitive)
 {
+  if(Image) return(ImageRead(address, size, items, ErrSensitive));
   int flag;
   flag = read(Data, address, (unsigned int) (size * items));
   // Were we able to read in all values?
@@ -378,6 +461,7 @@ FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, in
 
 FDNPREF int  FDNFUNC FDNFile::Write(void * address, size_t size, size_t items, int ErrSensitive)
 {
+  if(Image) return(ImageWrite(address, size, items, ErrSensitive));
   size_t nowritten;
   nowritten = fwrite(address, size, items, Data);
   if(ErrSensitive && (nowritten!=items)){
@@ -392,6 +476,7 @@ FDNPREF int  FDNFUNC FDNFile::Write(void * address, size_t size, size_t items, i
 
 FDNPREF int  FDNFUNC FDNFile::Write(void * address, size_t size, size_t items, int ErrSensitive)
 {
+  if(Image) return(ImageWrite(address, size, items, ErrSensitive));
   Data.write((char *) address, (int) (size * items));
   if(ErrSensitive && Data.rdstate()){
     SignalError(errno);
@@ -407,6 +492,7 @@ FDNPREF int  FDNFUNC FDNFile::Write(void * address, size_t size, size_t items, i
 
 FDNPREF int  FDNFUNC FDNFile::Write(void * address, size_t size, size_t items, int ErrSensitive)
 {
+  if(Image) return(ImageWrite(address, size, items, ErrSensitive));
   int flag;
   flag = write(Data, address, (unsigned int) (size * items));
   // Were we able to read in all values?
@@ -435,3 +521,159 @@ FDNFile::~FDNFile()
 #endif
 
 
+/****************************************************************************/
+/*                                                                          */
+/*                P R O T E C T E D   F U N C T I O N S                     */
+/*                                                                          */
+/****************************************************************************/
+
+// The memory image functions below do not depend on the file system, other
+// than through the public functions above.
+
+#if defined(FDN_USEHAND) || defined(FDN_USEIOS) || defined(FDN_USESTD)
+
+// int FDNFile::LoadImage()
+// Reads the whole of the open file into memory. After this Seek(), Read(),
+// Write() and Size() act on the image until it is written back by Close().
+// Returns 0 if the file could not be held in memory, in which case it is
+// left to ordinary file io; 1 otherwise.
+
+FDNPREF int  FDNFUNC FDNFile::LoadImage()
+{
+  char * Buffer;
+  long   Length = Size();
+
+  if(Length < 0 || !GrowImage(Length)) return(0);
+
+  // Read from the file itself, not the image
+  Buffer = Image;
+  Image  = NULL;
+  if(Length && (!Seek(0, SEEK_SET) || !Read(Buffer, (size_t) Length, 1, 1))){
+    delete[] Buffer;
+    ImageSize = 0;
+    return(0);
+  }
+  Image      = Buffer;
+  ImageUsed  = Length;
+  ImagePos   = 0;
+  ImageDirty = 0;
+  return(1);
+}
+
+
+// int FDNFile::SaveImage()
+// Writes the image back over the file, if it has been changed, in a single
+// write, and releases it. Further io goes to the file itself.
+// Returns 0 on failure, 1 otherwise.
+
+FDNPREF int  FDNFUNC FDNFile::SaveImage()
+{
+  char * Buffer = Image;
+  int    success = 1;
+
+  if(!Buffer) return(1);
+  Image = NULL;
+  if(ImageDirty){
+    success = Extend(ImageUsed) && Seek(0, SEEK_SET);
+    if(success && ImageUsed) success = Write(Buffer, (size_t) ImageUsed, 1, 1);
+  }
+  delete[] Buffer;
+  ImageSize = ImageUsed = ImagePos = 0;
+  ImageDirty = 0;
+  return(success);
+}
+
+
+// int FDNFile::GrowImage(long Length)
+// Ensures the image has room for Length bytes, doubling its size from
+// FDNIMAGEBLOCK until it does.
+// Returns 0 if there is not the memory (or address space), 1 otherwise.
+
+FDNPREF int  FDNFUNC FDNFile::GrowImage(long Length)
+{
+  long   NewSize;
+  char * NewImage;
+
+  if(Image && Length <= ImageSize) return(1);
+  NewSize = ImageSize ? ImageSize : FDNIMAGEBLOCK;
+  while(NewSize < Length) NewSize *= 2L;
+  if((long) (size_t) NewSize != NewSize) return(0);
+
+  NewImage = new char[(size_t) NewSize];
+  if(!NewImage) return(0);
+  if(Image){
+    memcpy(NewImage, Image, (size_t) ImageUsed);
+    delete[] Image;
+  }
+  Image     = NewImage;
+  ImageSize = NewSize;
+  return(1);
+}
+
+
+// int FDNFile::ImageSeek(long offset, int whence)
+// As Seek(), on the image. Seeking beyond the end is allowed, as for a file.
+
+FDNPREF int  FDNFUNC FDNFile::ImageSeek(long offset, int whence)
+{
+  long Position;
+  switch(whence){
+    case SEEK_SET : Position = offset; break;
+    case SEEK_CUR : Position = ImagePos + offset; break;
+    case SEEK_END : Position = ImageUsed + offset; break;
+    default       : Position = -1L; break;
+  }
+  if(Position < 0){
+    SignalError(EINVAL);
+    return(0);
+  }
+  ImagePos = Position;
+  return(1);
+}
+
+
+// int FDNFile::ImageRead(void * address, size_t size, size_t items, int ErrSensitive)
+// As Read(), on the image.
+
+FDNPREF int  FDNFUNC FDNFile::ImageRead(void * address, size_t size, size_t items, int ErrSensitive)
+{
+  size_t noread = 0;
+  if(size && ImagePos < ImageUsed){
+    noread = (size_t) ((ImageUsed - ImagePos) / (long) size);
+    if(noread > items) noread = items;
+    memcpy(address, Image + ImagePos, noread * size);
+    ImagePos += (long) (noread * size);
+  }
+  if(ErrSensitive && (noread!=items)){
+    SignalError(EZERO);
+    return(0);
+  }
+  return(1);
+}
+
+
+// int FDNFile::ImageWrite(void * address, size_t size, size_t items, int ErrSensitive)
+// As Write(), on the image. If the image cannot grow to take the data it is
+// written back, and the file used directly from then on.
+
+FDNPREF int  FDNFUNC FDNFile::ImageWrite(void * address, size_t size, size_t items, int ErrSensitive)
+{
+  long Position = ImagePos;
+  long End = ImagePos + (long) (size * items);
+
+  if(End > ImageSize && !GrowImage(End)){
+    if(!SaveImage() || !Seek(Position, SEEK_SET)) return(0);
+    return(Write(address, size, items, ErrSensitive));
+  }
+  // Fill any gap left by seeking beyond the end
+  if(Position > ImageUsed) memset(Image + ImageUsed, 0, (size_t) (Position - ImageUsed));
+  memcpy(Image + Position, address, size * items);
+  ImagePos = End;
+  if(End > ImageUsed) ImageUsed = End;
+  ImageDirty = 1;
+  return(1);
+}
+
+#endif
+
+
@@ -32,13 +32,50 @@
 #elif defined(__OS2__) || defined(OS2)
 #  define FDN_OS2
 #  define INCL_DOSNLS
+#  define INCL_DOSPROCESS
 #  include <os2.h>
 #endif
 
+// Under NT the system can tell us when a directory changes (FDNodeWatch)
+#if defined(__NT__) && !defined(FDN_WINDOWS)
+#  define FDN_WATCH
+#  include <windows.h>
+#endif
+
 #ifndef  FDN_CustomCheckFile
 #include <dos.h>
 #endif
 
+// CreateInstance() needs an exclusive create, and a process id to scatter
+// the instances of different processes
+#if (defined(FDN_USESTD) || defined(FDN_INST_USESTD))
+#  include <io.h>
+#  include <fcntl.h>
+#endif
+#include <process.h>
+
+// The warm start image is checked against the index files with stat()
+#include <stdio.h>
+#include <sys/stat.h>
+
+// The warm start image, followed by the NFDX, UFDX and PFDX root pages.
+// Length and Stamp hold the size and time of NODELIST.FDX, USERLIST.FDX,
+// PHONE.FDX and PHONE.FDA when it was written.
+struct WarmHeader {
+  char           Magic[4];                    // "FDNW", written last
+  unsigned short Size;
+  long           Length[4];
+  long           Stamp[4];
+  FirstPage      first_n, first_u, first_p;
+  NLinfoRec      NLInfo;
+  char           NodeExt[4];
+  short          swedish;
+  long           INTLOffset, DOMOffset;
+};
+
+// The instance semaphore CreateInstance() tries first, -1 until one is needed
+static int NextInstance = -1;
+
 static char *ListFileName[]={
   "NODELIST.XXX",
   "FDNODE.FDA",
@@ -558,7 +595,7 @@ FDNPREF char FDNFUNC *FrontDoorNode::GetNLine(long offset)
   }    
     
 
-  if(Reopen[file]) DataFile[file].Open();
+  if(Reopen[file] || !DataFile[file].GetStatus()) DataFile[file].Open();
   if(!DataFile[file].GetStatus()){
     SignalError(file+18); // Unable to open specified file
     ClearFDAStore();
@@ -989,6 +1026,7 @@ FDNPREF FrontDoorNode::FrontDoorNode(const char FDNDATA *pathname, const char *p
 FDNPREF FrontDoorNode::~FrontDoorNode()
 {
   Freeze(); // Close handles etc.
+  StopWatch();
   delete FDAStore;
   if(!(Flags & FDNodeNoCacheP)){
     delete proot;
@@ -1016,6 +1054,10 @@ FDNPREF void FDNFUNC FrontDoorNode::SetNLDir(const char FDNDATA *pathname)
   if(!IsFrozen()) return;       // Not frozen!
   strcpy(NodelistDir, pathname);
   AddTrail(NodelistDir);
+  if(Flags & FDNodeWatch){
+    StopWatch();
+    StartWatch();
+  }
 }
 
 
@@ -1035,6 +1077,11 @@ FDNPREF void FDNFUNC FrontDoorNode::SetSemDir(const char FDNDATA *pathname)
   Flags = Flags & ~ FDNodeNoSem;
   strcpy(SemaphoreDir, pathname);
   AddTrail(SemaphoreDir);
+  MakeSemFiles();
+  if(Flags & FDNodeWatch){
+    StopWatch();
+    StartWatch();
+  }
 }
 
 
@@ -1058,6 +1105,9 @@ FDNPREF void FDNFUNC FrontDoorNode::Freeze()
   PFDX.Close();
   PFDA.Close();
   for(loop=0; loop<4; loop++) DataFile[loop].Close();
+  delete[] Resident;
+  Resident = NULL;
+  ResidentSize = 0;
   if(!(Flags & FDNodeNoSem) && ((unsigned) Instance != 0xFFFF)) DeleteInstance();
 
   Frozen = 1;
@@ -1140,6 +1190,12 @@ FDNPREF void FDNFUNC FrontDoorNode::ClearError()
 ** the class. The application using the class should attempt to call
 ** this function periodically.
 **
+** With FDNodeWatch, and where the system can report changes to a
+** directory, the semaphores are only looked for after something in the
+** semaphore or nodelist directory has changed, so that calling this
+** often costs next to nothing. WaitForChange() allows a thread to
+** sleep until then.
+**
 **    Returns
 **
 **    0   No change - index remains closed
@@ -1150,22 +1206,10 @@ FDNPREF void FDNFUNC FrontDoorNode::ClearError()
 */
 FDNPREF int FDNFUNC FrontDoorNode::AutoFreezeThaw()
 {
-  int ShouldFreeze = 0;
-  char filename[72];
-  char buffer[17];
-
-  itoa(Task, buffer, 10);
+  int ShouldFreeze = FreezeWanted();
 
-  strcpy(filename, SemaphoreDir);
-  strcat(filename, "FDNC.NOW");
-  ShouldFreeze |= CheckFile(filename);
-  strcpy(filename, SemaphoreDir);
-  strcat(filename, "FDNLFREZ.ALL");
-  ShouldFreeze |= CheckFile(filename);
-  strcpy(filename, SemaphoreDir);
-  strcat(filename, "FDNLFREZ.");
-  strcat(filename, buffer);
-  ShouldFreeze |= CheckFile(filename);
+  // Nothing can have been created or published since we last looked
+  if(ShouldFreeze < 0) return(IsFrozen() ? 0 : 1);
   
   if(ShouldFreeze){
     if(IsFrozen()) return(0);
@@ -1179,17 +1223,209 @@ FDNPREF int FDNFUNC FrontDoorNode::AutoFreezeThaw()
       if(Thaw()) return(3); else return(4);
    }
     else{
+      // Move over to a newly published index set
+      if(IsStale()){
+        Freeze();
+        if(Thaw()) return(3); else return(4);
+      }
       return(1);
     }
   }
 }
 
 
+/*
+**    FreezeWanted
+**
+** The test AutoFreezeThaw() makes, for a caller which must freeze and
+** thaw in its own way (see FDNSnapshots). Nothing is frozen or thawed.
+**
+**    Returns
+**
+**    -1  Nothing has changed since the last call (see FDNodeWatch)
+**     0  The freeze semaphores are absent
+**     1  The freeze semaphores are present
+*/
+FDNPREF int FDNFUNC FrontDoorNode::FreezeWanted()
+{
+  if(!Changed()) return(-1);
+  return((CheckFile(SemFile[0]) | CheckFile(SemFile[1]) | CheckFile(SemFile[2])) ? 1 : 0);
+}
+
+
+/*
+**    IsStale
+**
+** Checks whether an index set newer than the one in use has been
+** published (see WFDNodePublish in the writer).
+**
+**    Returns
+**
+**    1 if a newer set has been published, 0 otherwise
+*/
+FDNPREF int FDNFUNC FrontDoorNode::IsStale()
+{
+  char name[13];
+
+  return(ReadGeneration(name) && stricmp(name, Generation));
+}
+
+
+/*
+**    WaitForChange
+**
+** Sleeps until something in the semaphore or nodelist directory
+** changes, or Timeout milliseconds pass, so that a thread can call
+** AutoFreezeThaw() as soon as there is something to act on. Without
+** FDNodeWatch, or where changes cannot be reported (only NT can), this
+** simply sleeps for Timeout, so that a thread calling it in a loop polls
+** at that interval.
+**
+**    Returns
+**
+**    1 if AutoFreezeThaw() should be called, 0 on timeout
+*/
+FDNPREF int FDNFUNC FrontDoorNode::WaitForChange(unsigned long Timeout)
+{
+  if(Notified) return(1);
+#ifdef FDN_WATCH
+  HANDLE Handles[2];
+  DWORD  Count = 0, Result;
+
+  if(Watch[0]){
+    Handles[Count++] = (HANDLE) Watch[0];
+    if(Watch[1]) Handles[Count++] = (HANDLE) Watch[1];
+    Result = WaitForMultipleObjects(Count, Handles, FALSE, Timeout);
+    return(Result != WAIT_TIMEOUT);
+  }
+#endif
+
+  // Nothing is watched, so wait out the time and let AutoFreezeThaw() look
+#if defined(__NT__)
+  Sleep(Timeout);
+#elif defined(FDN_OS2)
+  DosSleep(Timeout);
+#elif defined(FDN_DOS)
+  for(; Timeout > 60000UL; Timeout -= 60000UL) delay(60000U);
+  delay((unsigned) Timeout);
+#else
+  (void) Timeout;
+#endif
+  return(1);
+}
+
+
 //***************************************************************************
 //*                 P R I V A T E   F U N C T I O N S                       *
 //***************************************************************************
 
 
+/*
+**    MakeSemFiles
+**
+** Builds the names of the semaphores AutoFreezeThaw() looks for, which
+** only change with the semaphore directory or the task.
+*/
+FDNPREF void FDNFUNC FrontDoorNode::MakeSemFiles()
+{
+  char buffer[17];
+
+  itoa(Task, buffer, 10);
+
+  strcpy(SemFile[0], SemaphoreDir);
+  strcat(SemFile[0], "FDNC.NOW");
+  strcpy(SemFile[1], SemaphoreDir);
+  strcat(SemFile[1], "FDNLFREZ.ALL");
+  strcpy(SemFile[2], SemaphoreDir);
+  strcat(SemFile[2], "FDNLFREZ.");
+  strcat(SemFile[2], buffer);
+}
+
+
+/*
+**    StartWatch
+**
+** Asks to be told of files being created, deleted or written in the
+** semaphore and nodelist directories. If either cannot be watched
+** neither is, and AutoFreezeThaw() looks every time.
+*/
+FDNPREF void FDNFUNC FrontDoorNode::StartWatch()
+{
+#ifdef FDN_WATCH
+  char path[PATHLENGTH];
+  int  loop, length;
+
+  for(loop=0; loop<2; loop++){
+    strcpy(path, loop ? NodelistDir : SemaphoreDir);
+    if(loop && !stricmp(NodelistDir, SemaphoreDir)) break;
+    // The directory is wanted without its trailing backslash, save for a root
+    length = strlen(path);
+    if(!length) strcpy(path, ".");
+    else if(length > 1 && path[length-1] == '\\' && path[length-2] != ':') path[length-1] = 0;
+    Watch[loop] = (void *) FindFirstChangeNotification(path, FALSE,
+                    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    if((HANDLE) Watch[loop] == INVALID_HANDLE_VALUE){
+      Watch[loop] = NULL;
+      StopWatch();
+      break;
+    }
+  }
+#endif
+  // Whatever is there already still has to be looked at once
+  Notified = 1;
+}
+
+
+/*
+**    StopWatch
+**
+** Closes any change notifications opened by StartWatch().
+*/
+FDNPREF void FDNFUNC FrontDoorNode::StopWatch()
+{
+#ifdef FDN_WATCH
+  int loop;
+
+  for(loop=0; loop<2; loop++){
+    if(Watch[loop]) FindCloseChangeNotification((HANDLE) Watch[loop]);
+    Watch[loop] = NULL;
+  }
+#endif
+}
+
+
+/*
+**    Changed
+**
+** Checks, without waiting, whether anything has changed in the watched
+** directories since the last call, and rearms the notifications.
+**
+**    Returns
+**
+**    1 if the semaphores should be looked for, 0 if nothing has changed
+*/
+FDNPREF int FDNFUNC FrontDoorNode::Changed()
+{
+  int changed = Notified;
+
+#ifdef FDN_WATCH
+  int loop;
+
+  if(!Watch[0]) return(1);
+  for(loop=0; loop<2; loop++){
+    if(Watch[loop] && WaitForSingleObject((HANDLE) Watch[loop], 0) == WAIT_OBJECT_0){
+      FindNextChangeNotification((HANDLE) Watch[loop]);
+      changed = 1;
+    }
+  }
+#else
+  changed = 1;
+#endif
+  Notified = 0;
+  return(changed);
+}
+
+
 #ifndef  FDN_CustomCheckFile
 
 /*
@@ -1219,6 +1455,37 @@ FDNPREF int FDNFUNC FrontDoorNode::CheckFile(char *FileName)
 #endif
 
 
+/*
+**    ReadGeneration
+**
+** Reads the name of the directory holding the published index set from
+** GENERATIONFILE in the nodelist directory (see WFDNodePublish in the
+** writer). If there is no such file the index set is in the nodelist
+** directory itself, and name is left empty.
+**
+**    Returns
+**
+**    1 if a published set was named, 0 otherwise
+*/
+FDNPREF int FDNFUNC FrontDoorNode::ReadGeneration(char *name)
+{
+  FDN_FileObject Pointer;
+  char filename[PATHLENGTH];
+  int  loop;
+
+  memset(name, 0, 13);
+  strcpy(filename, NodelistDir);
+  strcat(filename, GENERATIONFILE);
+  Pointer.SetName(filename);
+  if(!Pointer.Open()) return(0);
+  Pointer.Read(name, 1, 12, 0);
+  Pointer.Close();
+  for(loop=0; loop<12 && name[loop]>' '; loop++);
+  name[loop]=0;
+  return(*name!=0);
+}
+
+
 /*
 **    AddTrail
 **
@@ -1233,6 +1500,26 @@ FDNPREF char FDNFUNC *FrontDoorNode::AddTrail(char *rawfile)
 }
 
 
+/*
+**    FirstInstance
+**
+** Chooses the instance semaphore CreateInstance() should try first.
+** The first in each process is taken from its process id, so that
+** programs started together do not all fight over FDNODE0, and later
+** ones follow on from the last instance taken.
+*/
+FDNPREF int  FDNFUNC FrontDoorNode::FirstInstance(void)
+{
+  unsigned int Hash;
+
+  if(NextInstance == -1){
+    Hash = (unsigned int) getpid();
+    NextInstance = (int) ((Hash ^ (Hash >> 8) ^ (Hash >> 16)) & 0xFF);
+  }
+  return(NextInstance);
+}
+
+
 /*
 **    CreateInstance
 **
@@ -1244,7 +1531,11 @@ FDNPREF char FDNFUNC *FrontDoorNode::AddTrail(char *rawfile)
 ** <Task> is set to BSY if no Task was passed to the class.
 **
 ** Instance is a unique value for this task, and may change
-** during a Freeze/Thaw cycle.
+** during a Freeze/Thaw cycle. Each process starts looking at a
+** different instance (see FirstInstance), and the semaphore is
+** created only if it does not already exist, in one operation, so
+** that starting up usually takes a single attempt, and two programs
+** can never take the same instance.
 **
 ** It is possible to define your own CreateInstance body, see
 ** FDNUSER.H and FDNODE.DOC for details.
@@ -1256,8 +1547,8 @@ FDNPREF int  FDNFUNC FrontDoorNode::CreateInstance(void)
 {
   char Store[6]="BSY";
   char Buffer[20];
-  int instance = 0, quit = 0, error = 0;
-  FILE *Test;
+  int instance, tries = 0, quit = 0, error = 0;
+  int Test;
 
   if(!strlen(SemaphoreDir)){
     SignalError(17);
@@ -1267,6 +1558,7 @@ FDNPREF int  FDNFUNC FrontDoorNode::CreateInstance(void)
 
   // Get extension of busy semaphore
   if(Task) itoa(Task, Store, 10);
+  instance = FirstInstance();
 
   while(!quit){
     // Form prospective Semaphore name
@@ -1278,24 +1570,23 @@ FDNPREF int  FDNFUNC FrontDoorNode::CreateInstance(void)
     strcat(InstanceSemaphore, Store);
 
     // Now attempt to create the semaphore
-    Test=fopen(InstanceSemaphore, "rb");
-    if(!Test){
-      Test=fopen(InstanceSemaphore, "wb");
-      fclose(Test);
+    Test=open(InstanceSemaphore, O_WRONLY | O_CREAT | O_EXCL, S_IREAD | S_IWRITE);
+    if(Test != -1){
+      close(Test);
       quit=1;
     }
-    else fclose(Test);
 
-    if(!quit && instance==0xFF){
+    if(!quit && ++tries==0x100){
       error=1;
       quit=1;
     }
-   if(!quit) instance++;
+   if(!quit) instance = (instance + 1) & 0xFF;
   }
   if(error){
     instance = 0xFFFF;
     SignalError(16);
   }  
+  else NextInstance = (instance + 1) & 0xFF;
   return(instance);
 }
 
@@ -1322,7 +1613,7 @@ FDNPREF int  FDNFUNC FrontDoorNode::CreateInstance(void)
 {
   char Store[6]="BSY";
   char Buffer[20];
-  int instance = 0, quit = 0, error = 0;
+  int instance, tries = 0, quit = 0, error = 0;
   int Test;
 
   if(!strlen(SemaphoreDir)){
@@ -1334,6 +1625,7 @@ FDNPREF int  FDNFUNC FrontDoorNode::CreateInstance(void)
 
   // Get extension of busy semaphore
   if(Task) itoa(Task, Store, 10);
+  instance = FirstInstance();
 
   while(!quit){
     // Form prospective Semaphore name
@@ -1350,16 +1642,17 @@ FDNPREF int  FDNFUNC FrontDoorNode::CreateInstance(void)
       close(Test);
     }
 
-    if(!quit && instance==0xFF){
+    if(!quit && ++tries==0x100){
     error=1;
       quit=1;
     }
-  if(!quit) instance++;
+  if(!quit) instance = (instance + 1) & 0xFF;
   }
   if(error){
     instance = 0xFFFF;
     SignalError(16);
   }
+  else NextInstance = (instance + 1) & 0xFF;
   return(instance);
 }
 
@@ -1382,7 +1675,7 @@ FDNPREF int  FDNFUNC FrontDoorNode::CreateInstance(void)
 {
   char Store[6]="BSY";
   char Buffer[20];
-  int instance = 0, quit = 0, error = 0;
+  int instance, tries = 0, quit = 0, error = 0;
   ofstream Test;
 
   if(!strlen(SemaphoreDir)){
@@ -1394,6 +1687,7 @@ FDNPREF int  FDNFUNC FrontDoorNode::CreateInstance(void)
 
   // Get extension of busy semaphore
   if(Task) itoa(Task, Store, 10);
+  instance = FirstInstance();
 
   while(!quit){
     // Form prospective Semaphore name
@@ -1412,16 +1706,17 @@ FDNPREF int  FDNFUNC FrontDoorNode::CreateInstance(void)
      }
      else Test.clear();
 
-   if(!quit && instance==0xFF){
+   if(!quit && ++tries==0x100){
       error=1;
       quit=1;
     }
-    if(!quit) instance++;
+    if(!quit) instance = (instance + 1) & 0xFF;
   }
   if(error){
     instance = 0xFFFF;
      SignalError(16);
   }
+  else NextInstance = (instance + 1) & 0xFF;
  
   return(instance);
 }
@@ -1454,6 +1749,8 @@ FDNPREF int  FDNFUNC FrontDoorNode::DeleteInstance(void)
 */
 FDNPREF void FDNFUNC FrontDoorNode::Constructor(const char FDNDATA *NLPath, const char *SemPath, unsigned short setflags, unsigned short NewTask)
 {
+  int loop;
+
   Frozen = 1;
   Flags=setflags;
   Task=NewTask;
@@ -1464,6 +1761,24 @@ FDNPREF void FDNFUNC FrontDoorNode::Constructor(const char FDNDATA *NLPath, cons
   NLInfo.CountryCode = 0;
   error=0;
   InstanceSemaphore[0] = '\0';
+  *Generation = 0;
+  strcpy(IndexDir, NodelistDir);
+  MakeSemFiles();
+  Watch[0] = Watch[1] = NULL;
+  Notified = 1;
+  if(Flags & FDNodeWatch) StartWatch();
+  Resident = NULL;
+  ResidentSize = 0;
+  WarmStart = 0;
+  // Files held in memory are never reopened
+  if(Flags & FDNodeInMemory) Flags = Flags & ~(FDNodeNFDX | FDNodeUFDX | FDNodeNode | FDNodePvt | FDNodePoint | FDNodeFDA | FDNodePhone | FDNodePFDX);
+  if(Flags & FDNodeShared){
+    NFDX.SetFlags(FDNFileShared);
+    UFDX.SetFlags(FDNFileShared);
+    PFDX.SetFlags(FDNFileShared);
+    PFDA.SetFlags(FDNFileShared);
+    for(loop=0; loop<4; loop++) DataFile[loop].SetFlags(FDNFileShared);
+  }
   
   if(Flags & FDNodeNoCacheN) nroot=NULL; // Cache is disabled.
   else{
@@ -1514,16 +1829,108 @@ FDNPREF int FDNFUNC FrontDoorNode::InitClass()
 {
   // returns 1 if class is ready for use
   // returns 0 otherwise
-  unsigned short TempCountryCode = NLInfo.CountryCode;
   char filename[PATHLENGTH];
-  ExtendedPage ExtPage;
+  int Warm;
 
   if(!(Flags & FDNodeNoSem)) Instance=CreateInstance();
   Reopen[0]=Reopen[1]=Reopen[2]=Reopen[3]=1;
 
-  // NODELIST.FDX
+  // The index set may have been published in a directory of its own
+  strcpy(IndexDir, NodelistDir);
+  if(ReadGeneration(Generation)){
+    strcat(IndexDir, Generation);
+    AddTrail(IndexDir);
+  }
+
+  // A warm start image saves reading the headers and roots again
+  Warm = WarmStart && LoadWarm();
+  if(!Warm && !ReadIndices()) return(0);
 
+  // Now open the data files as required by the flags, or leave
+  // them to GetNLine() to open when first needed
+  if(Flags & FDNodeShared) Reopen[0]=Reopen[1]=Reopen[2]=Reopen[3]=0;
   strcpy(filename, NodelistDir);
+  strcat(filename, ListFileName[0]);
+  DataFile[0].SetName(filename);
+  if(!(Flags & (FDNodeNode | FDNodeShared))){
+    if(!DataFile[0].Open()){
+      if(!(isdigit(NodeExt[0]) && isdigit(NodeExt[1]) && isdigit(NodeExt[2]))){
+        SignalError(18);
+      }
+      else{
+        SignalError(3); // The file /should/ be openable. Fatal error.
+        Freeze();
+        return(0);
+      }
+    }
+    else Reopen[0]=0;
+  }
+
+  strcpy(filename, NodelistDir);
+  strcat(filename, ListFileName[1]);
+  DataFile[1].SetName(filename);
+  if(!(Flags & (FDNodeFDA | FDNodeShared))){
+    if(!DataFile[1].Open()) SignalError(4);
+    else Reopen[1]=0;
+  }
+
+  strcpy(filename, IndexDir);
+  strcat(filename, ListFileName[2]);
+  DataFile[2].SetName(filename);
+  if(!(Flags & (FDNodePvt | FDNodeShared))){
+    if(!DataFile[2].Open()) SignalError(5);
+    else Reopen[2]=0;
+  }
+
+  strcpy(filename, IndexDir);
+  strcat(filename, ListFileName[3]);
+  DataFile[3].SetName(filename);
+  if(!(Flags & (FDNodePoint | FDNodeShared))){
+    if(!DataFile[3].Open()) SignalError(6);
+    else Reopen[3]=0;
+  }
+
+  strcpy(filename, IndexDir);
+  strcat(filename, "PHONE.FDA");
+  PFDA.SetName(filename);
+  if(!(Flags & FDNodePhone)){
+    if(!PFDA.Open()) SignalError(12);
+  }
+
+  if(Flags & FDNodeInMemory) LoadResident();
+
+  // We need to fetch the location of default dial translations
+  if(!Warm){
+    GetPFDXData("INTL", NULL, first_p.index);
+    GetPFDXData("DOM", NULL, first_p.index);
+    if(WarmStart) SaveWarm();
+  }
+  NLCurOffset=0;
+  UnixStamp=time(NULL);
+
+  return(1);
+}
+
+
+/*
+**    ReadIndices
+**
+** Opens the three FDX files, reading and validating their headers,
+** and loads the root pages into the mini caches.
+**
+**    Returns
+**
+**    1 on success, 0 on failure.
+*/
+FDNPREF int FDNFUNC FrontDoorNode::ReadIndices()
+{
+  unsigned short TempCountryCode = NLInfo.CountryCode;
+  char filename[PATHLENGTH];
+  ExtendedPage ExtPage;
+
+  // NODELIST.FDX
+
+  strcpy(filename, IndexDir);
   strcat(filename, "NODELIST.FDX");
   NFDX.SetName(filename);
   if(!NFDX.Open()){
@@ -1564,7 +1971,7 @@ FDNPREF int FDNFUNC FrontDoorNode::InitClass()
   if(Flags & FDNodeNFDX) NFDX.Close();
 
   // USERLIST.FDX
-  strcpy(filename, NodelistDir);
+  strcpy(filename, IndexDir);
   strcat(filename, "USERLIST.FDX");
   UFDX.SetName(filename);
   if(!UFDX.Open()){
@@ -1588,7 +1995,7 @@ FDNPREF int FDNFUNC FrontDoorNode::InitClass()
   if(Flags & FDNodeUFDX) UFDX.Close();
 
   // PHONE.FDX
-  strcpy(filename, NodelistDir);
+  strcpy(filename, IndexDir);
   strcat(filename, "PHONE.FDX");
  PFDX.SetName(filename);
   if(!PFDX.Open()){
@@ -1611,61 +2018,222 @@ FDNPREF int FDNFUNC FrontDoorNode::InitClass()
   }
   if(Flags & FDNodePFDX) PFDX.Close();
 
-  // Now open the data files as required by the flags
-  strcpy(filename, NodelistDir);
-  strcat(filename, ListFileName[0]);
-  DataFile[0].SetName(filename);
-  if(!(Flags & FDNodeNode)){
-    if(!DataFile[0].Open()){
-      if(!(isdigit(NodeExt[0]) && isdigit(NodeExt[1]) && isdigit(NodeExt[2]))){
-        SignalError(18);
-      }
-      else{
-        SignalError(3); // The file /should/ be openable. Fatal error.
-        Freeze();
-        return(0);
-      }
-    }
-    else Reopen[0]=0;
+  return(1);
+}
+
+
+/*
+**    WarmStamp
+**
+** Notes the length and time of each of the files a warm start image
+** depends on, so that an image can be checked against them.
+**
+**    Returns
+**
+**    1 on success, 0 if any of the files could not be found.
+*/
+FDNPREF int FDNFUNC FrontDoorNode::WarmStamp(long * Length, long * Stamp)
+{
+  static const char * WarmFile[4]={
+    "NODELIST.FDX",
+    "USERLIST.FDX",
+    "PHONE.FDX",
+    "PHONE.FDA"
+  };
+  char filename[PATHLENGTH];
+  struct stat Info;
+  int loop;
+
+  for(loop=0; loop<4; loop++){
+    strcpy(filename, IndexDir);
+    strcat(filename, WarmFile[loop]);
+    if(stat(filename, &Info)) return(0);
+    Length[loop] = (long) Info.st_size;
+    Stamp[loop]  = (long) Info.st_mtime;
   }
+  return(1);
+}
 
-  strcpy(filename, NodelistDir);
-  strcat(filename, ListFileName[1]);
-  DataFile[1].SetName(filename);
-  if(!(Flags & FDNodeFDA)){
-    if(!DataFile[1].Open()) SignalError(4);
-    else Reopen[1]=0;
+
+/*
+**    LoadWarm
+**
+** Takes the headers, root pages and dial translation offsets from the
+** warm start image, if it was made from the index files as they are
+** now, and opens the FDX files as InitClass() would. Only the compile
+** time is read from NODELIST.FDX, to be sure it has not been rewritten
+** within the resolution of the file time. Older databases have no
+** compile time, and so no image. If the image cannot be used, any file
+** it opened is closed again, so that ReadIndices() starts afresh.
+**
+**    Returns
+**
+**    1 on success, 0 if the image cannot be used.
+*/
+FDNPREF int FDNFUNC FrontDoorNode::LoadWarm()
+{
+  char filename[PATHLENGTH];
+  long Length[4], Stamp[4];
+  WarmHeader Header;
+  NLinfoRec Info;
+  FDN_FileObject Image;
+  int loop, success;
+
+  if(Flags & (FDNodeNoCacheN | FDNodeNoCacheU | FDNodeNoCacheP)) return(0);
+  if(!WarmStamp(Length, Stamp)) return(0);
+
+  strcpy(filename, IndexDir);
+  strcat(filename, WARMFILE);
+  Image.SetName(filename);
+  if(!Image.Open()) return(0);
+  success = Image.Read(&Header, sizeof(WarmHeader), 1, 1) && !memcmp(Header.Magic, "FDNW", 4)
+         && Header.Size == sizeof(WarmHeader);
+  for(loop=0; success && loop<4; loop++){
+    if(Header.Length[loop] != Length[loop] || Header.Stamp[loop] != Stamp[loop]) success = 0;
+  }
+  // The extension is copied as a string below
+  if(success && !memchr(Header.NodeExt, 0, sizeof(Header.NodeExt))) success = 0;
+  if(success){
+    success = Image.Read(nroot, sizeof(NFDXPage), 1, 1) && Image.Read(uroot, sizeof(UFDXPage), 1, 1)
+           && Image.Read(proot, sizeof(PFDXPage), 1, 1);
   }
+  Image.Close();
+  if(!success) return(0);
 
-  strcpy(filename, NodelistDir);
-  strcat(filename, ListFileName[2]);
-  DataFile[2].SetName(filename);
-  if(!(Flags & FDNodePvt)){
-    if(!DataFile[2].Open()) SignalError(5);
-    else Reopen[2]=0;
+  strcpy(filename, IndexDir);
+  strcat(filename, "NODELIST.FDX");
+  NFDX.SetName(filename);
+  if(!NFDX.Open()) return(0);
+  NFDX.Seek(0x110, SEEK_SET);
+  if(!NFDX.Read(&Info, sizeof(NLinfoRec), 1, 1) || Info.CompileTime != Header.NLInfo.CompileTime){
+    NFDX.Close();
+    return(0);
+  }
+  if(Flags & FDNodeNFDX) NFDX.Close();
+
+  strcpy(filename, IndexDir);
+  strcat(filename, "USERLIST.FDX");
+  UFDX.SetName(filename);
+  if(!(Flags & FDNodeUFDX) && !UFDX.Open()){
+    if(NFDX.GetStatus()) NFDX.Close();
+    return(0);
+  }
+
+  strcpy(filename, IndexDir);
+  strcat(filename, "PHONE.FDX");
+  PFDX.SetName(filename);
+  if(!(Flags & FDNodePFDX) && !PFDX.Open()){
+    if(NFDX.GetStatus()) NFDX.Close();
+    if(UFDX.GetStatus()) UFDX.Close();
+    return(0);
+  }
+
+  memcpy(&first_n, &Header.first_n, sizeof(FirstPage));
+  memcpy(&first_u, &Header.first_u, sizeof(FirstPage));
+  memcpy(&first_p, &Header.first_p, sizeof(FirstPage));
+  memcpy(&NLInfo, &Header.NLInfo, sizeof(NLinfoRec));
+  NLDBRevision=1;
+  strcpy(NodeExt, Header.NodeExt);
+  swedish = Header.swedish;
+  strcpy(ListFileName[0], "NODELIST.");
+  strcat(ListFileName[0], NodeExt);
+  INTLOffset = Header.INTLOffset;
+  DOMOffset = Header.DOMOffset;
+
+  // As ReadIndices() would have found
+  if(!nroot->records || !first_n.index) SignalError(23);
+  if(!uroot->records || !first_u.index) SignalError(24);
+  if(!proot->records || !first_p.index) SignalError(25);
+  return(1);
+}
+
+
+/*
+**    SaveWarm
+**
+** Writes a warm start image of the headers, root pages and dial
+** translation offsets just read. The image is written under another name
+** and then renamed, so that a program starting meanwhile never takes a
+** part written image, nor one half overwritten by another program.
+** Failing to write the image does not matter, it is simply not used.
+*/
+FDNPREF void FDNFUNC FrontDoorNode::SaveWarm()
+{
+  char filename[PATHLENGTH], tempname[PATHLENGTH];
+  WarmHeader Header;
+  FILE * Image;
+  int success;
+
+  if((Flags & (FDNodeNoCacheN | FDNodeNoCacheU | FDNodeNoCacheP)) || !NLDBRevision) return;
+
+  memset(&Header, 0, sizeof(WarmHeader));
+  memcpy(Header.Magic, "FDNW", 4);
+  Header.Size = sizeof(WarmHeader);
+  if(!WarmStamp(Header.Length, Header.Stamp)) return;
+  memcpy(&Header.first_n, &first_n, sizeof(FirstPage));
+  memcpy(&Header.first_u, &first_u, sizeof(FirstPage));
+  memcpy(&Header.first_p, &first_p, sizeof(FirstPage));
+  memcpy(&Header.NLInfo, &NLInfo, sizeof(NLinfoRec));
+  strcpy(Header.NodeExt, NodeExt);
+  Header.swedish = (short) swedish;
+  Header.INTLOffset = INTLOffset;
+  Header.DOMOffset = DOMOffset;
+
+  strcpy(filename, IndexDir);
+  strcat(filename, WARMFILE);
+  strcpy(tempname, IndexDir);
+  strcat(tempname, WARMTEMP);
+  Image = fopen(tempname, "wb");
+  if(!Image) return;
+  success = fwrite(&Header, sizeof(WarmHeader), 1, Image) && fwrite(nroot, sizeof(NFDXPage), 1, Image)
+         && fwrite(uroot, sizeof(UFDXPage), 1, Image) && fwrite(proot, sizeof(PFDXPage), 1, Image);
+  if(fclose(Image)) success = 0;
+  // The old image goes first, as rename() will not replace a file
+  if(success){
+    remove(filename);
+    success = !rename(tempname, filename);
   }
+  if(!success) remove(tempname);
+}
 
-  strcpy(filename, NodelistDir);
-  strcat(filename, ListFileName[3]);
-  DataFile[3].SetName(filename);
-  if(!(Flags & FDNodePoint)){
-    if(!DataFile[3].Open()) SignalError(6);
-    else Reopen[3]=0;
-  }
 
-  strcpy(filename, NodelistDir);
-  strcat(filename, "PHONE.FDA");
-  PFDA.SetName(filename);
-  if(!(Flags & FDNodePhone)){
-    if(!PFDA.Open()) SignalError(12);
+/*
+**    LoadResident
+**
+** Reads every file the class has open into a single block of memory,
+** and closes them, so that from then on no lookup need touch the disc.
+** A file which cannot be read is left to be used from disc as before.
+** The block is released by Freeze(). See GetResidentSize().
+**
+**    Returns
+**
+**    1 if the files are now held in memory, 0 otherwise
+*/
+FDNPREF int FDNFUNC FrontDoorNode::LoadResident()
+{
+  FDN_FileObject * File[8];
+  long Length[8], Total = 0;
+  int  loop;
+
+  File[0] = &NFDX;
+  File[1] = &UFDX;
+  File[2] = &PFDX;
+  File[3] = &PFDA;
+  for(loop=0; loop<4; loop++) File[4+loop] = &DataFile[loop];
+
+  for(loop=0; loop<8; loop++){
+    Length[loop] = File[loop]->GetStatus() ? File[loop]->Size() : 0L;
+    if(Length[loop] < 0) Length[loop] = 0;
+    Total += Length[loop];
   }
+  // Too much to address at once
+  if(!Total || (long) (size_t) Total != Total) return(0);
 
-  // We need to fetch the location of default dial translations
-  GetPFDXData("INTL", NULL, first_p.index);
-  GetPFDXData("DOM", NULL, first_p.index);
-  NLCurOffset=0;
-  UnixStamp=time(NULL);
-
+  Resident = new char[(size_t) Total];
+  if(!Resident) return(0);
+  for(loop=0; loop<8; loop++){
+    if(Length[loop] && File[loop]->Hold(Resident + ResidentSize)) ResidentSize += Length[loop];
+  }
   return(1);
 }
 
@@ -2761,10 +3329,10 @@ FDNPREF int FDNFUNC FrontDoorNode::GetNFDXPage(NFDXPage & nd, long pageno)
   // Try to get from virtual cache system
   if(CheckNFDXCache(nd, pageno)) return(1);
 
-  // No luck, we must fetch directly
+  // No luck, we must fetch directly. A page which could not be read, or
+  // which a FDNBatch does not have yet, is not to be cached.
   NFDX.Seek(first_n.pagelen*pageno, SEEK_SET);
-  NFDX.Read(&nd, (size_t) first_n.pagelen, 1, 1);
-  CommitNFDXCache(nd, pageno);
+  if(NFDX.Read(&nd, (size_t) first_n.pagelen, 1, 1)) CommitNFDXCache(nd, pageno);
   return(1);
 };
 
@@ -2796,7 +3364,7 @@ FDNPREF int FDNFUNC FrontDoorNode::GetUFDXPage(UFDXPage & ud, long pageno)
 
   // No luck, we must fetch directly
   UFDX.Seek(first_u.pagelen*pageno, SEEK_SET);
-  UFDX.Read(&ud, (size_t) first_u.pagelen, 1, 1);
+  if(!UFDX.Read(&ud, (size_t) first_u.pagelen, 1, 1)) return(1);
 
   // Allow virtual cache system to see fetched page
   CommitUFDXCache(ud, pageno);
@@ -3124,6 +3692,257 @@ FDNPREF int FDNFUNC FDNFind::SetIndexOffset(long newoffset, FrontDoorNode & NewP
 }
 
 
+/****************************************************************************/
+/*                                                                          */
+/* Class: FDNSnapshots                                                      */
+/* Purpose: Keeps searches going across the publication of a new index set */
+/*                                                                          */
+/* Related Classes: FrontDoorNode                                           */
+/*                                                                          */
+/****************************************************************************/
+
+/****************************************************************************/
+/*                                                                          */
+/*                   P U B L I C   F U N C T I O N S                        */
+/*                                                                          */
+/****************************************************************************/
+
+// FDNSnapshots(directory name, semaphore directory, flags, task)
+// The parameters are those of the FrontDoorNode constructor, and are used
+// for each set opened, save FDNodeShared, as sets may be searched by
+// several threads at once. Unless FDNodeCreateFrozen is given the current
+// set is opened straight away.
+FDNSnapshots::FDNSnapshots(const char FDNDATA *pathname, const char FDNDATA *path2, unsigned short setflags, unsigned short NewTask)
+{
+  register int loop;
+
+  for(loop=0; loop<SNAPSHOTS; loop++){
+    Set[loop]=NULL;
+    Users[loop]=0;
+  }
+  strcpy(NodelistDir, pathname);
+  strcpy(SemaphoreDir, path2);
+  Flags=(unsigned short) (setflags & ~(FDNodeCreateFrozen | FDNodeShared));
+  Task=NewTask;
+  error=0;
+  if(!(setflags & FDNodeCreateFrozen)) Reload();
+}
+
+
+// ~FDNSnapshots()
+// Closes every set, whether it has been released or not.
+FDNSnapshots::~FDNSnapshots()
+{
+  register int loop;
+
+  for(loop=0; loop<SNAPSHOTS; loop++){
+    if(Set[loop]) delete Set[loop];
+    Set[loop]=NULL;
+  }
+}
+
+
+/*
+**    Acquire
+**
+** Returns the current index set, opening it if need be, for use until
+** it is handed back with Release(). Searches started with it must be
+** continued with it.
+**
+**    Returns
+**
+**    The set, or NULL if it could not be opened (see GetError()).
+*/
+FDNPREF FrontDoorNode FDNFUNC *FDNSnapshots::Acquire()
+{
+  FrontDoorNode * Current;
+
+  if(!Set[0]) Reload();
+  Lock();
+  Current=Set[0];
+  if(Current) Users[0]++;
+  Unlock();
+  return(Current);
+}
+
+
+/*
+**    Release
+**
+** Hands back a set returned by Acquire(). Once an older set is no longer
+** in use by anyone it is closed.
+*/
+FDNPREF void FDNFUNC FDNSnapshots::Release(FrontDoorNode * Snapshot)
+{
+  register int loop;
+
+  Lock();
+  for(loop=0; loop<SNAPSHOTS; loop++){
+    if(Set[loop] && Set[loop]==Snapshot){
+      if(Users[loop]) Users[loop]--;
+      if(loop && !Users[loop]){
+        delete Set[loop];
+        Set[loop]=NULL;
+      }
+      break;
+    }
+  }
+  Unlock();
+}
+
+
+/*
+**    Reload
+**
+** Opens the current index set afresh, and makes it the one returned by
+** Acquire(). The set it replaces is kept open while it is in use. The
+** new set is opened before anything is locked, so searches carry on
+** meanwhile.
+**
+**    Returns
+**
+**    1 on success, 0 on failure, in which case the old set remains in
+**    use.
+*/
+FDNPREF int FDNFUNC FDNSnapshots::Reload()
+{
+  FrontDoorNode * Fresh;
+
+  Fresh=CreateSet(Flags);
+  if(!Fresh || Fresh->IsFrozen()){
+    SignalError(Fresh ? Fresh->GetError() : 10);
+    if(Fresh) delete Fresh;
+    return(0);
+  }
+  return(Install(Fresh));
+}
+
+
+/*
+**    AutoReload
+**
+** The counterpart of FrontDoorNode::AutoFreezeThaw(), to be called
+** periodically. If a new index set has been published it is loaded.
+**
+** An index set which has never been published is rewritten in place by
+** the compiler, so there the freeze semaphores are obeyed instead, as
+** by a single FrontDoorNode. While they are present the current set is
+** replaced by a closed one, and once they are gone by a fresh one. A set
+** replaced while in use is only closed when it is released, so searches
+** under way are never left with its files closed under them, but should
+** be finished promptly, as the compiler is rewriting those files.
+**
+**    Returns
+**
+**    0   No set could be opened, or the set is closed
+**    1   No change
+**    2   The set has just been closed
+**    3   A newly published set has been loaded, or the set reopened
+**    4   A new set has been published, but could not be loaded
+*/
+FDNPREF int FDNFUNC FDNSnapshots::AutoReload()
+{
+  FrontDoorNode * Closed;
+  int Stale, Wanted = -1, Frozen = 0;
+
+  Lock();
+  Stale = Set[0] ? Set[0]->IsStale() : -1;
+  if(!Stale && !Set[0]->IsPublished()){
+    Wanted = Set[0]->FreezeWanted();
+    Frozen = Set[0]->IsFrozen();
+  }
+  Unlock();
+
+  switch(Stale){
+    case -1 : return(Reload() ? 3 : 0);
+    case  0 : break;
+    default : return(Reload() ? 3 : 4);
+  }
+  if(Wanted < 0 || Wanted == Frozen) return(Frozen ? 0 : 1);
+  if(!Wanted) return(Reload() ? 3 : 4);
+
+  Closed=CreateSet((unsigned short) (Flags | FDNodeCreateFrozen));
+  if(!Closed){
+    SignalError(10);
+    return(1);
+  }
+  return(Install(Closed) ? 2 : 1);
+}
+
+
+/*
+**    GetSets
+**
+** Returns the number of index sets open, the current one and any older
+** ones still in use.
+*/
+FDNPREF int FDNFUNC FDNSnapshots::GetSets()
+{
+  register int loop, count=0;
+
+  Lock();
+  for(loop=0; loop<SNAPSHOTS; loop++) if(Set[loop]) count++;
+  Unlock();
+  return(count);
+}
+
+
+/****************************************************************************/
+/*                                                                          */
+/*             I M P L E M E N T A T I O N  F U N C T I O N S               */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+**    CreateSet
+**
+** Opens an index set, with setflags as given to the FrontDoorNode
+** constructor. A derived class may override this to use a class derived
+** from FrontDoorNode.
+*/
+FDNPREF FrontDoorNode FDNFUNC *FDNSnapshots::CreateSet(unsigned short setflags)
+{
+  return(new FrontDoorNode(NodelistDir, SemaphoreDir, setflags, Task));
+}
+
+
+/*
+**    Install
+**
+** Makes Fresh the set returned by Acquire(). The set it replaces is kept
+** while it is in use, and closed otherwise.
+**
+**    Returns
+**
+**    1 on success; 0 if there is nowhere to keep the old set, in which
+**    case Fresh is closed and the old set remains in use.
+*/
+FDNPREF int FDNFUNC FDNSnapshots::Install(FrontDoorNode * Fresh)
+{
+  int slot=0;
+
+  Lock();
+  if(Set[0] && Users[0]){
+    // Somewhere to keep the old set until it is released
+    for(slot=1; slot<SNAPSHOTS && Set[slot]; slot++);
+    if(slot==SNAPSHOTS){
+      Unlock();
+      delete Fresh;
+      SignalError(32);
+      return(0);
+    }
+    Set[slot]=Set[0];
+    Users[slot]=Users[0];
+  }
+  else if(Set[0]) delete Set[0];
+  Set[0]=Fresh;
+  Users[0]=0;
+  Unlock();
+  return(1);
+}
+
+
+
 /****************************************************************************/
 /*                                                                          */
 /* Class: FDNFile                                                           */
@@ -3149,7 +3968,10 @@ FDNPREF int FDNFUNC FDNFind::SetIndexOffset(long newoffset, FrontDoorNode & NewP
 FDNFile::FDNFile()
 {
   Status=Error=0;
+  Flags=0;
   *FileName=0;
+  Image=NULL;
+  Batch=NULL;
   Data = NULL;
 }
 
@@ -3158,7 +3980,10 @@ FDNFile::FDNFile()
 FDNFile::FDNFile()
 {
   Status=Error=0;
+  Flags=0;
   *FileName=0;
+  Image=NULL;
+  Batch=NULL;
 }
 
 #elif defined(FDN_USEHAND)
@@ -3166,7 +3991,10 @@ FDNFile::FDNFile()
 FDNFile::FDNFile()
 {
   Status=Error=0;
+  Flags=0;
   *FileName=0;
+  Image=NULL;
+  Batch=NULL;
   Data = 0;
 }
 
@@ -3176,7 +4004,8 @@ FDNFile::FDNFile()
 // int FDNFile::Open()
 // Attempt to open the file pointed to in filename and connects it to Data
 // Status should be set to 1 on a successful open.
-// Returns 0 on failure, non zero on success.
+// Returns 0 on failure, non zero on success. A file already open, as one
+// a search gave up on may be, is left as it is.
 
 #ifdef FDN_USESTD
 
@@ -3188,6 +4017,8 @@ FDNPREF int  FDNFUNC FDNFile::Open()
   AnsiToOem(FileName, AnsiFileName);
   pFileName=AnsiFileName;
 #endif
+  if(Status) return(1);
+  if(Flags & FDNFileShared) return(OpenShared());
   Data = _fsopen(pFileName, "rb", SH_DENYWR);
   if(!Data){
     SignalError(errno);
@@ -3207,13 +4038,15 @@ FDNPREF int  FDNFUNC FDNFile::Open()
   AnsiToOem(FileName, AnsiFileName);
   pFileName=AnsiFileName;
 #endif
+  if(Status) return(1);
   Data.open(pFileName, ios::binary | ios::in | ios::nocreate , SH_DENYWR);
   if(!Data){
     // I don't know if we can do this next bit...
     SignalError(errno);
     return(0);
   }
-  else return(1);
+  Status=1;
+  return(1);
 }
 
 #elif defined(FDN_USEHAND)
@@ -3227,6 +4060,8 @@ FDNPREF int  FDNFUNC FDNFile::Open()
   AnsiToOem(FileName, AnsiFileName);
   pFileName=AnsiFileName;
 #endif
+  if(Status) return(1);
+  if(Flags & FDNFileShared) return(OpenShared());
   flag = sopen(pFileName, O_RDONLY | O_BINARY, SH_DENYWR);
   if(flag==-1){
     SignalError(errno);
@@ -3250,7 +4085,10 @@ FDNPREF int  FDNFUNC FDNFile::Open()
 FDNPREF int  FDNFUNC FDNFile::Close()
 {
   int flag;
+  if(Image) return(Release());
+  if((Flags & FDNFileShared) && LeaveShared()) return(1);
   if(Data) flag=fclose(Data); else return(0);
+  Data=NULL;
   if(!flag){
     Status=0;
     return(1);
@@ -3263,6 +4101,7 @@ FDNPREF int  FDNFUNC FDNFile::Close()
 
 FDNPREF int  FDNFUNC FDNFile::Close()
 {
+  if(Image) return(Release());
   Data.close();
   Status=0;
   return(1);
@@ -3273,7 +4112,10 @@ FDNPREF int  FDNFUNC FDNFile::Close()
 FDNPREF int  FDNFUNC FDNFile::Close()
 {
   int flag;
+  if(Image) return(Release());
+  if((Flags & FDNFileShared) && LeaveShared()) return(1);
   if(Data) flag=close(Data); else return(0);
+  Data=0;
   if(!flag){
     Status=0;
     return(1);
@@ -3295,6 +4137,8 @@ FDNPREF int  FDNFUNC FDNFile::Close()
 FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 {
   int flag;
+  if(Image) return(ImageSeek(offset, whence));
+  if(Batch) return(BatchSeek(offset, whence));
   flag = fseek(Data, offset, whence);
   if(flag){
     SignalError(errno);
@@ -3309,6 +4153,8 @@ FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 {
   ios::seek_dir s;
+  if(Image) return(ImageSeek(offset, whence));
+  if(Batch) return(BatchSeek(offset, whence));
   switch(whence){
     case SEEK_SET : s = ios::beg; break;
     case SEEK_CUR : s = ios::cur; break;
@@ -3329,6 +4175,8 @@ FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 {
   long flag;
+  if(Image) return(ImageSeek(offset, whence));
+  if(Batch) return(BatchSeek(offset, whence));
   flag = lseek(Data, offset, whence);
   if(flag==-1){
     SignalError(errno);
@@ -3352,6 +4200,8 @@ FDNPREF int  FDNFUNC FDNFile::Seek(long offset, int whence)
 FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, int ErrSensitive)
 {
   size_t noread;
+  if(Image) return(ImageRead(address, size, items, ErrSensitive));
+  if(Batch) return(BatchRead(address, size, items, ErrSensitive));
   noread = fread(address, size, items, Data);
   if(ErrSensitive && (noread!=items)){
     SignalError(EZERO);
@@ -3365,6 +4215,8 @@ FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, in
 
 FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, int ErrSensitive)
 {
+  if(Image) return(ImageRead(address, size, items, ErrSensitive));
+  if(Batch) return(BatchRead(address, size, items, ErrSensitive));
   Data.read((char *) address, (int) (size * items));
   if(ErrSensitive && Data.rdstate()){
     SignalError(errno);
@@ -3380,9 +4232,11 @@ FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, in
 FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, int ErrSensitive)
 {
   int flag;
+  if(Image) return(ImageRead(address, size, items, ErrSensitive));
+  if(Batch) return(BatchRead(address, size, items, ErrSensitive));
   flag = read(Data, address, (unsigned int) (size * items));
   // Were we able to read in all values?
-  if(ErrSensitive && (flag <= (int) (items * size))){
+  if(ErrSensitive && (flag != (int) (items * size))){
     SignalError(EZERO);
     return(0);
   }
@@ -3397,6 +4251,55 @@ FDNPREF int  FDNFUNC FDNFile::Read(void * address, size_t size, size_t items, in
 
 #endif
 
+
+
+// long int FDNFile::Size()
+// This functions determines the size of the opened file
+
+#ifdef FDN_USESTD
+
+FDNPREF long int FDNFUNC FDNFile::Size()
+{
+  long Extent, Current;
+  if(Image) return(ImageUsed);
+  Current = ftell(Data);
+  fseek(Data, 0, SEEK_END);
+  Extent  = ftell(Data);
+  fseek(Data, Current, SEEK_SET);
+
+  return(Extent);
+}
+
+#elif defined FDN_USEIOS
+
+FDNPREF long int FDNFUNC FDNFile::Size()
+{
+  streampos Extent, Current;
+  if(Image) return(ImageUsed);
+  Current = Data.tellg();
+  Data.seekg(0, ios::end);
+  Extent  = Data.tellg();
+  Data.seekg(Current, ios::beg);
+
+  return((long int) Extent);
+}
+
+#elif defined FDN_USEHAND
+
+FDNPREF long int FDNFUNC FDNFile::Size()
+{
+  long Extent, Current;
+  if(Image) return(ImageUsed);
+  Current = tell(Data);
+  lseek(Data, 0, SEEK_END);
+  Extent  = tell(Data);
+  lseek(Data, Current, SEEK_SET);
+
+  return(Extent);
+}
+
+#endif
+
 #if defined(FDN_USEHAND) || defined(FDN_USEIOS) || defined(FDN_USESTD)
 FDNFile::~FDNFile()
 {
@@ -3404,4 +4307,205 @@ FDNFile::~FDNFile()
   Status=0;
 }
 
+
+// int FDNFile::Hold(char * Buffer)
+// Reads the whole of the open file into Buffer, which must have room for
+// Size() bytes, and closes it. Seek(), Read() and Size() then act on Buffer
+// until Close(). Buffer remains the caller's, see FDNodeInMemory.
+// Returns 0 if the file could not be read, in which case it is left open;
+// 1 otherwise.
+
+FDNPREF int  FDNFUNC FDNFile::Hold(char * Buffer)
+{
+  long Length = Size();
+
+  if(Length < 0) return(0);
+  if(Length && (!Seek(0, SEEK_SET) || !Read(Buffer, (size_t) Length, 1, 1))) return(0);
+  Close();
+  Image      = Buffer;
+  ImageSize  = ImageUsed = Length;
+  ImagePos   = 0;
+  ImageDirty = 0;
+  Status     = 1;
+  return(1);
+}
+
+
+// int FDNFile::Release()
+// Lets go of the Buffer given to Hold(), as Close() would close the file.
+
+FDNPREF int  FDNFUNC FDNFile::Release()
+{
+  Image  = NULL;
+  ImageSize = ImageUsed = ImagePos = 0;
+  Status = 0;
+  return(1);
+}
+
+
+// int FDNFile::ImageSeek(long offset, int whence)
+// As Seek(), on the held copy.
+
+FDNPREF int  FDNFUNC FDNFile::ImageSeek(long offset, int whence)
+{
+  long Position;
+  switch(whence){
+    case SEEK_SET : Position = offset; break;
+    case SEEK_CUR : Position = ImagePos + offset; break;
+    case SEEK_END : Position = ImageUsed + offset; break;
+    default       : Position = -1L; break;
+  }
+  if(Position < 0){
+    SignalError(EINVAL);
+    return(0);
+  }
+  ImagePos = Position;
+  return(1);
+}
+
+
+// int FDNFile::ImageRead(void * address, size_t size, size_t items, int ErrSensitive)
+// As Read(), on the held copy. As with fread() a part item at the end is
+// still copied, which FCRGetS() relies on for the last line of a file.
+
+FDNPREF int  FDNFUNC FDNFile::ImageRead(void * address, size_t size, size_t items, int ErrSensitive)
+{
+  long Length = 0;
+  if(ImagePos < ImageUsed){
+    Length = ImageUsed - ImagePos;
+    if(Length > (long) (size * items)) Length = (long) (size * items);
+    memcpy(address, Image + ImagePos, (size_t) Length);
+    ImagePos += Length;
+  }
+  if(ErrSensitive && (Length != (long) (size * items))){
+    SignalError(EZERO);
+    return(0);
+  }
+  return(1);
+}
+
+
+// int FDNFile::BatchSeek(long offset, int whence)
+// As Seek(), while reads are made from a batch. Only the position is kept.
+
+FDNPREF int  FDNFUNC FDNFile::BatchSeek(long offset, int whence)
+{
+  long Position;
+  switch(whence){
+    case SEEK_SET : Position = offset; break;
+    case SEEK_CUR : Position = BatchPos + offset; break;
+    case SEEK_END : Position = Size() + offset; break;
+    default       : Position = -1L; break;
+  }
+  if(Position < 0){
+    SignalError(EINVAL);
+    return(0);
+  }
+  BatchPos = Position;
+  return(1);
+}
+
+
+// int FDNFile::BatchRead(void * address, size_t size, size_t items, int ErrSensitive)
+// As Read(), from the pages the batch holds.
+
+FDNPREF int  FDNFUNC FDNFile::BatchRead(void * address, size_t size, size_t items, int ErrSensitive)
+{
+  long Position = BatchPos;
+
+  BatchPos += (long) (size * items);
+  return(Batch->Read(*this, Position, address, size * items, ErrSensitive));
+}
+
+#endif
+
+
+// Files shared between FDNFile objects, see FDNFileShared. Entries with no
+// Users are free. The io stream system cannot share its objects, so files
+// are never shared under it.
+
+#if defined(FDN_USEHAND) || defined(FDN_USESTD)
+
+static struct {
+  char  Name[PATHLENGTH];
+  int   Users;
+  #ifdef FDN_USESTD
+  FILE * Data;
+  #else
+  int   Data;
+  #endif
+} FilePool[FILEPOOL];
+
+
+// int FDNFile::OpenShared()
+// Takes the handle of the file from the pool if it is already open, or
+// opens it and adds it to the pool, if there is room. As others may have
+// moved it, the file is left at its start.
+// Returns 0 on failure, non zero on success.
+
+FDNPREF int  FDNFUNC FDNFile::OpenShared()
+{
+  int loop, entry = -1, opened;
+
+  for(loop=0; loop<FILEPOOL; loop++){
+    if(FilePool[loop].Users && !stricmp(FilePool[loop].Name, FileName)){
+      FilePool[loop].Users++;
+      Data = FilePool[loop].Data;
+      Status = 1;
+      return(Seek(0, SEEK_SET));
+    }
+    if(!FilePool[loop].Users && entry == -1) entry = loop;
+  }
+
+  // Not open yet, so open it as usual
+  Flags = Flags & ~FDNFileShared;
+  opened = Open();
+  Flags = Flags | FDNFileShared;
+  if(opened && entry != -1){
+    strcpy(FilePool[entry].Name, FileName);
+    FilePool[entry].Data = Data;
+    FilePool[entry].Users = 1;
+  }
+  return(opened);
+}
+
+
+// int FDNFile::LeaveShared()
+// Gives up this object's use of a file from the pool.
+// Returns 1 if others are still using it, and it must not be closed, or
+// 0 if it should now be closed as usual.
+
+FDNPREF int  FDNFUNC FDNFile::LeaveShared()
+{
+  int loop;
+
+  if(!Status) return(0);
+  for(loop=0; loop<FILEPOOL; loop++){
+    if(FilePool[loop].Users && FilePool[loop].Data == Data){
+      if(!--FilePool[loop].Users) return(0);
+      #ifdef FDN_USESTD
+      Data = NULL;
+      #else
+      Data = 0;
+      #endif
+      Status = 0;
+      return(1);
+    }
+  }
+  return(0);
+}
+
+#elif defined(FDN_USEIOS)
+
+FDNPREF int  FDNFUNC FDNFile::OpenShared()
+{
+  Flags = Flags & ~FDNFileShared;
+  return(Open());
+}
+
+FDNPREF int  FDNFUNC FDNFile::LeaveShared()
+{
+  return(0);
+}
+
 #endif
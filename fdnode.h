@@ -122,6 +122,27 @@
 
 #define MAXHEIGHT 5
 
+/* Number of consecutive insertions at one edge of a leaf before the writer */
+/* treats the input as sorted and splits pages lopsidedly (see GetSplitPoint)*/
+
+#define ADAPTSPLITRUN 4
+
+/* A page with fewer records than this after a deletion is merged with, or  */
+/* borrows records from, a neighbouring page.                               */
+
+#define MINRECORDS 16
+
+/* Offset in the stub page of the writer's chain of free (deleted) pages.   */
+/* This lies in the area FrontDoor leaves zeroed, before the StubInfo.      */
+
+#define FREEPAGEOFFSET 248
+
+/* Offset in the NODELIST.FDX stub page of the writer's table of source     */
+/* segments (see FDWNSegment), well clear of the StubInfo at 256.           */
+
+#define SEGMENTOFFSET 384
+#define SEGMENTS      4
+
 /* Maximum length of nodelist line to be allowed */
 
 #define NODELINELENGTH  255
@@ -130,6 +151,28 @@
 
 #define PATHLENGTH      72
 
+/* A published index set (see WFDNodePublish) lies in one of GENERATIONS  */
+/* directories below the nodelist directory, GENERATIONDIR "0", "1" and   */
+/* so on, each set being built in the one after the set in use. There is  */
+/* one more than the sets FDNSnapshots keeps open, so that the next set   */
+/* is not built where a reader still has one open. GENERATIONFILE in the  */
+/* nodelist directory names the one in use; as the names differ only in   */
+/* their last character, switching between them is the write of a single  */
+/* byte. COPYBLOCK is the size of block in which an index set is copied   */
+/* when it is staged for updating. WARMFILE, beside the index set, holds  */
+/* what the reader needs to start on it quickly (see                      */
+/* FrontDoorNode::SetWarmStart), and is written as WARMTEMP first.        */
+/* SUMFILE, also beside the set, holds a check sum of each page of the    */
+/* FDX files (see WFDNodeChecksum).                                       */
+
+#define GENERATIONFILE  "FDNODE.GEN"
+#define GENERATIONDIR   "FDNGEN."
+#define GENERATIONS     3
+#define COPYBLOCK       16384U
+#define WARMFILE        "FDNODE.WRM"
+#define WARMTEMP        "FDNODE.WR$"
+#define SUMFILE         "FDNODE.SUM"
+
 /* Some flags used by C++ class, most of these give control over what files */
 /* will be held open for the lifetime of the class, and which will be       */
 /* opened only on requirement. The more you keep open the greater the speed */
@@ -146,7 +189,10 @@ const int FDNodePFDX          =0x0080;  /* Reopen PHONE.FDX each time */
 const int FDNodeNoCacheN      =0x0100;  /* Don't keep NODELIST.FDX root in memory */
 const int FDNodeNoCacheU      =0x0200;  /* Don't keep USERLIST.FDX root in memory */
 const int FDNodeNoCacheP      =0x0400;  /* Don't keep PHONE.FDX root in memory */
+const int FDNodeShared        =0x0800;  /* Open data files when first needed, sharing handles with other objects, from one thread only */
 const int FDNodeNoSem         =0x1000;  /* Don't support FDNODE*.* semaphores */
+const int FDNodeWatch         =0x2000;  /* Only look for semaphores after a change, see AutoFreezeThaw() */
+const int FDNodeInMemory      =0x4000;  /* Hold the index and data files in memory while thawed */
 const int FDNodeCreateFrozen  =0x8000;  /* Initialise Class in "Frozen" form */
 
 /* Useful combinations */
@@ -316,6 +362,26 @@ struct NLinfoRec
   unsigned long   CompileTime;
   char            RESERVED[26];
 };
+
+/* SUMFILE starts with this structure, followed by FDNPageSum() of each  */
+/* page of NODELIST.FDX, then of USERLIST.FDX, then of PHONE.FDX. A page */
+/* whose sum is unchanged after a compile need not be read again.        */
+
+struct SumHeader
+{
+  char            Magic[4];           /* "FDNS", written last            */
+  unsigned long   CompileTime;        /* As in NODELIST.FDX              */
+  long            Pages[3];           /* Of each file, counting the stub */
+};
+
+inline unsigned long FDNPageSum(const void * Page, unsigned Length)
+{
+  const unsigned char * Byte = (const unsigned char *) Page;
+  unsigned long Sum = 0x811C9DC5UL;
+
+  while(Length--) Sum = ((Sum ^ *Byte++) * 0x01000193UL) & 0xFFFFFFFFUL;
+  return(Sum);
+}
   
 
 #ifdef FDN_PACK
@@ -529,10 +595,38 @@ class FDN_FileObject;
 // clean the source code with respect to the three different file systems
 // and also allows a derived class to trap errors in file io.
 
+// Files opened with FDNFileMemory are read into memory on opening and all
+// io takes place there, the file being written back in one piece on closing.
+// The image starts at FDNIMAGEBLOCK bytes and doubles as it grows; if it
+// cannot grow the file drops back to ordinary file io.
+
+// The reader may open files with FDNFileShared, in which case a file already
+// open through another object in the program is not opened again, but its
+// handle used by both. FILEPOOL is the number of files which may be shared.
+// The pool, and the position of each handle in it, are not guarded, so
+// objects sharing files must all be used from one thread at a time.
+
+// The reader's files may also be handed to a FDNFileBatch for a while, in
+// which case Seek() and Read() act on the pages the batch holds rather than
+// on the file (see FDNBATCH.H).
+
+#define FDNIMAGEBLOCK 32768L
+#define FILEPOOL      16
+
 #ifdef FDN_FULL_PACK
 #pragma pack(1)
 #endif
 
+class FDNFile;
+
+class FDNFileBatch {
+
+  public :
+
+    // Supplies Length bytes at Offset in File, returning as Read() does
+    FDNPREF   virtual int  FDNFUNC Read(FDNFile & File, long Offset, void * address, size_t Length, int ErrSensitive) = 0;
+};
+
 class FDNFile {
 
   protected :
@@ -541,6 +635,13 @@ class FDNFile {
     int   Status;                    // Whether the file is open, etc.
     int   Error;                     // The last error code. 0 = no error.
     int   Flags;                     // Flags data
+    char * Image;                    // Contents of the file, if held in memory
+    long  ImageSize;                 // Bytes allocated for Image
+    long  ImageUsed;                 // Length of the file held in Image
+    long  ImagePos;                  // Current position in Image
+    int   ImageDirty;                // Image has been written to
+    FDNFileBatch * Batch;            // Reads are made from this batch, if set
+    long  BatchPos;                  // Current position while they are
 
   public :
 
@@ -566,6 +667,28 @@ class FDNFile {
     FDNPREF            int FDNFUNC Seek(long offset, int whence);
     FDNPREF            int FDNFUNC Read(void * address, size_t size, size_t items, int ErrSensitive);
     FDNPREF            int FDNFUNC Write(void * address, size_t size, size_t items, int ErrSensitive);
+    FDNPREF            int FDNFUNC InMemory() { return(Image!=NULL); }
+    FDNPREF            int FDNFUNC Hold(char * Buffer);                       // Reader only, see FDNodeInMemory
+    FDNPREF           void FDNFUNC SetBatch(FDNFileBatch * NewBatch) { Batch = NewBatch; BatchPos = 0; } // Reader only
+    FDNPREF     const char FDNFUNC *GetName() { return(FileName); }
+
+  protected :
+
+    // Memory image support, independent of the file system
+    FDNPREF            int FDNFUNC LoadImage();
+    FDNPREF            int FDNFUNC SaveImage();
+    FDNPREF            int FDNFUNC GrowImage(long Length);
+    FDNPREF            int FDNFUNC ImageSeek(long offset, int whence);
+    FDNPREF            int FDNFUNC ImageRead(void * address, size_t size, size_t items, int ErrSensitive);
+    FDNPREF            int FDNFUNC ImageWrite(void * address, size_t size, size_t items, int ErrSensitive);
+    FDNPREF            int FDNFUNC Extend(long Length);
+    FDNPREF            int FDNFUNC Release();
+    FDNPREF            int FDNFUNC OpenShared();
+    FDNPREF            int FDNFUNC LeaveShared();
+    FDNPREF            int FDNFUNC BatchSeek(long offset, int whence);
+    FDNPREF            int FDNFUNC BatchRead(void * address, size_t size, size_t items, int ErrSensitive);
+
+  public :
 
     // Constructors etc.
     FDNFile();
@@ -689,7 +812,15 @@ class FrontDoorNode {
     int                Frozen;
     char               NodelistLine[NODELINELENGTH];
     char               NodelistDir[PATHLENGTH], SemaphoreDir[PATHLENGTH];
+    char               IndexDir[PATHLENGTH];                             // Where the index set is, see GENERATIONFILE
+    char               Generation[13];                                   // The published set in use, if any
     char               InstanceSemaphore[PATHLENGTH];
+    char               SemFile[3][PATHLENGTH+13];                        // The semaphores AutoFreezeThaw() looks for
+    void *             Watch[2];                                         // Change notifications on SemaphoreDir and NodelistDir
+    int                Notified;                                         // A change is waiting to be looked at
+    char *             Resident;                                         // The files held in memory, see FDNodeInMemory
+    long               ResidentSize;
+    int                WarmStart;                                        // Start from WARMFILE when it is current
     long               NLCurOffset;
     long               INTLOffset, DOMOffset;
     NFDXPage FDNDATA   *nroot;
@@ -805,8 +936,16 @@ class FrontDoorNode {
     FDNPREF            int FDNFUNC Thaw();
     FDNPREF            int FDNFUNC IsFrozen();
     FDNPREF            int FDNFUNC AutoFreezeThaw();
+    FDNPREF            int FDNFUNC FreezeWanted();
+    FDNPREF            int FDNFUNC IsStale();
+    FDNPREF            int FDNFUNC IsPublished() { return(*Generation != 0); }
+    FDNPREF            int FDNFUNC WaitForChange(unsigned long Timeout);
     FDNPREF           void FDNFUNC SetCountry(unsigned short cc) { NLInfo.CountryCode=cc; }
-    FDNPREF           void FDNFUNC SetTask(int NewTask) { if(IsFrozen()) Task=NewTask; }
+    FDNPREF           void FDNFUNC SetTask(int NewTask) { if(IsFrozen()){ Task=NewTask; MakeSemFiles(); } }
+    FDNPREF           char FDNFUNC *GetNLDir() { return(NodelistDir); }
+    FDNPREF           char FDNFUNC *GetIndexDir() { return(IndexDir); }
+    FDNPREF           long FDNFUNC GetResidentSize() { return(ResidentSize); }
+    FDNPREF           void FDNFUNC SetWarmStart(int On) { if(IsFrozen()) WarmStart=On; }
 
     FDNPREF   virtual void FDNFUNC OnFreeze() { return; }
     FDNPREF   virtual void FDNFUNC OnThaw(const char * ) { return; }
@@ -818,19 +957,31 @@ class FrontDoorNode {
   private:
     FDNPREF           void FDNFUNC Constructor(const char *pathname, const char *path2, unsigned short setflags, unsigned short NewTask);
     FDNPREF            int FDNFUNC InitClass();
+    FDNPREF            int FDNFUNC LoadResident();
+    FDNPREF            int FDNFUNC ReadIndices();
+    FDNPREF            int FDNFUNC WarmStamp(long * Length, long * Stamp);
+    FDNPREF            int FDNFUNC LoadWarm();
+    FDNPREF           void FDNFUNC SaveWarm();
     FDNPREF           void FDNFUNC ConvertToC(char FDNDATA *string);
     FDNPREF           char FDNFUNC *AddTrail(char *rawfile);
+    FDNPREF            int FDNFUNC FirstInstance(void);
     FDNPREF            int FDNFUNC CreateInstance(void);
     FDNPREF            int FDNFUNC DeleteInstance(void);
     FDNPREF           char FDNFUNC *FCRGetS(char FDNDATA * buffer, int maxlength, FDN_FileObject & file);
     FDNPREF           char FDNFUNC ToUpper(char c);
     FDNPREF            int FDNFUNC CheckFile(char *filename);
+    FDNPREF            int FDNFUNC ReadGeneration(char *name);
+    FDNPREF           void FDNFUNC MakeSemFiles();
+    FDNPREF           void FDNFUNC StartWatch();
+    FDNPREF           void FDNFUNC StopWatch();
+    FDNPREF            int FDNFUNC Changed();
   
   protected :
 
     FDNPREF   virtual void FDNFUNC SignalError(int newerr) { error=newerr; }
 
   friend class FDNFind;
+  friend class FDNBatch;
 
 };
 
@@ -878,6 +1029,7 @@ class FrontDoorNode {
 /* 29    Frozen - Cannot process                                          */
 /* 30    Error reading PHONE.FDX                                          */
 /* 31    Error reading PHONE.FDA                                          */
+/* 32    FDNSnapshots has too many index sets still in use to load another */
 /*                                                                        */
 /* The class should attempt to limit damage if it encounters an error     */
 /* condition, by terminating a search, freezing itself, or otherwise      */
@@ -890,8 +1042,64 @@ class FrontDoorNode {
 /**************************************************************************/
 
 /**************************************************************************/
-/* This new class is a prototype for writing FD Index files. Eventually I */
-/* hope to support alteration and deletion of records, but not for now.   */
+/* FDNSnapshots keeps a FrontDoorNode open on the current published index */
+/* set (see WFDNodePublish). When a new set is published, Reload() opens  */
+/* it alongside the old one; searches begun on the old set carry on with */
+/* it until it is released, when it is closed. Lookups thus never find    */
+/* the index frozen, unless it has never been published, when            */
+/* AutoReload() obeys the freeze semaphores instead.                      */
+/*                                                                        */
+/* Acquire() returns the current set and Release() gives it back. An      */
+/* FDNFind belongs to the set it was started with, and must be continued  */
+/* with that set. Searches need not be released between calls, but a set */
+/* is only closed when every Acquire() has been matched by a Release().   */
+/*                                                                        */
+/* The class is not itself thread safe; override Lock() and Unlock() to   */
+/* share it between threads. As the sets are then searched at the same    */
+/* time, FDNodeShared is not used for them.                               */
+/**************************************************************************/
+
+/* The most index sets FDNSnapshots holds open at once, one fewer than    */
+/* the generation directories the writer builds them in                   */
+
+#define SNAPSHOTS (GENERATIONS - 1)
+
+class FDNSnapshots
+{
+  // Attributes
+  protected :
+    FrontDoorNode *    Set[SNAPSHOTS];      // Set[0] is the current set, the rest are retired
+    int                Users[SNAPSHOTS];    // Outstanding Acquire()s of each
+    char               NodelistDir[PATHLENGTH], SemaphoreDir[PATHLENGTH];
+    unsigned short     Flags, Task;
+    int                error;
+
+  // Implementation
+  public :
+    FDNSnapshots(const char FDNDATA *pathname, const char FDNDATA *path2, unsigned short setflags, unsigned short NewTask);
+    virtual ~FDNSnapshots();
+
+    FDNPREF FrontDoorNode FDNFUNC *Acquire();
+    FDNPREF           void FDNFUNC Release(FrontDoorNode * Snapshot);
+    FDNPREF            int FDNFUNC Reload();
+    FDNPREF            int FDNFUNC AutoReload();
+    FDNPREF            int FDNFUNC GetSets();
+
+    FDNPREF            int FDNFUNC GetError()   { return(error); }
+    FDNPREF           void FDNFUNC ClearError() { error=0; }
+
+  protected :
+    FDNPREF   virtual FrontDoorNode FDNFUNC *CreateSet(unsigned short setflags);
+    FDNPREF            int FDNFUNC Install(FrontDoorNode * Fresh);
+    FDNPREF   virtual void FDNFUNC Lock() { return; }
+    FDNPREF   virtual void FDNFUNC Unlock() { return; }
+    FDNPREF   virtual void FDNFUNC SignalError(int newerr) { error=newerr; }
+};
+
+
+/**************************************************************************/
+/* This class writes FD Index files. Records may be added to a new or an  */
+/* existing index set, altered in place, and deleted.                     */
 /**************************************************************************/
 
 const int WFDNodeOverWrite = 0x0001;  // Implemented - but no overwrite not tested
@@ -902,6 +1110,11 @@ const int WFDNodeNoNCache  = 0x0010;
 const int WFDNodeNoUCache  = 0x0020;
 const int WFDNodeNoPCache  = 0x0040;
 const int WFDNodeUseDupes  = 0x0100;
+const int WFDNodeAdaptSplit = 0x0200; // Tree flag, split point follows insertion pattern
+const int WFDNodeWriteBehind = 0x0400; // FDWCachedNode writes dirty pages back on a thread, where there are threads
+const int WFDNodeInMemory  = 0x0800;  // Build the files in memory, writing each once on Freeze()
+const int WFDNodePublish   = 0x1000;  // Build in a staging directory, published on Freeze() (see GENERATIONFILE)
+const int WFDNodeChecksum  = 0x2000;  // Write a sum of each page on Freeze(), so caches may keep unchanged pages (see SUMFILE)
 //const int WFDNodeIsFrozen  = 0x8000;  // Implemented
 const int WFDNodeCreateFrozen = 0x8000;
 
@@ -912,6 +1125,8 @@ const long int WFDNInternal     = 0x01000000UL;
 
 const      int FDNFileDestroy  = 0x0001U;     // Open file destructively
 const      int FDNFileUpdate   = 0x0002U;     // Open file for update
+const      int FDNFileMemory   = 0x0004U;     // Hold file in memory, write it on Close()
+const      int FDNFileShared   = 0x0008U;     // Share the handle with other objects on the file (reader only)
 
 const     char NFDXIndex = 1;
 const     char UFDXIndex = 2;
@@ -921,6 +1136,11 @@ const     char PFDXIndex = 3;
 
 class FDWNTreeInfo;
 class FDWNInsert;
+class FDWNTreeQuality;
+class FDWNCompactReport;
+class FDWNBatchReport;
+class FDWNSegment;
+class FDWNPageImage;
 class FDNFile;
 class FrontDoorWNode;
 
@@ -939,6 +1159,9 @@ class FDWNTreeInfo
   long Records;       // The number of records in the index (unreliable, as above)
   long Flags;
   char PromoteRecord; // The record which should be promoted when a page splits (default is 16)
+  long AppendRun;     // Consecutive insertions at the right hand edge of a leaf
+  long PrependRun;    // Consecutive insertions at the left hand edge of a leaf
+  long FreePage;      // First page of the chain of pages released by deletion (0 if none)
 
   // Constructor
   FDWNTreeInfo();
@@ -960,6 +1183,66 @@ class FDWNInsert
 };
 
 
+class FDWNTreeQuality
+{
+  public :
+
+  int  Height;        // Number of levels from the root to the leaves
+  long Pages;         // Number of pages reachable from the root
+  long LeafPages;     // Number of those pages which are leaves
+  long Records;       // Number of records in the tree
+  int  FillFactor;    // Percentage of record slots in use over all pages
+  int  LeafFill;      // Percentage of record slots in use over leaf pages
+};
+
+
+class FDWNCompactReport
+{
+  public :
+
+  FDWNTreeQuality Before;       // Shape of the tree before compaction
+  FDWNTreeQuality After;        // Shape of the tree after compaction
+  long            BytesBefore;  // Size of the index file before compaction
+  long            BytesAfter;   // Size of the index file after compaction
+  unsigned long   ProbeBefore;  // clock() ticks to look up every key before
+  unsigned long   ProbeAfter;   // clock() ticks to look up every key after
+};
+
+
+class FDWNBatchReport
+{
+  public :
+
+  long Added;         // Records with a key new to the index
+  long Replaced;      // Records which replaced one with the same key
+  long Skipped;       // Duplicates dropped, as the index does not take them
+};
+
+
+class FDWNSegment
+{
+  public :
+
+  unsigned long Hash;       // Of the source file last compiled, 0 for none
+  long          Entries;    // Number of entries compiled from it
+  long          Shadowed;   // Entries which replaced those from an earlier source
+};
+
+
+class FDWNPageImage
+{
+  public :
+
+  int  Count;         // Number of records in the page
+  long Links[33];     // The backref followed by the link of each record
+  union {
+    NFDXRecord nodes[32];
+    UFDXRecord names[32];
+    PFDXRecord phones[32];
+  } Records;          // The records, in the format of whichever tree
+};
+
+
 class FrontDoorWNode
 {
   // Attributes
@@ -971,7 +1254,10 @@ class FrontDoorWNode
     unsigned short CountryCode;
     char           NodeExt[4];
     char           NodelistDir[PATHLENGTH];
+    char           IndexDir[PATHLENGTH];     // Where the index files are, see WFDNodePublish
+    char           Generation[13];           // The set being built for publication, if any
     char           Frozen;
+    char           CacheFill;     // Set while ReadPage() offers a freshly read page to the cache
     FDN_FileObject NFDX, UFDX, PFDX;
     FDN_FileObject PFDA;
     NFDXPage       NRoot;
@@ -981,18 +1267,31 @@ class FrontDoorWNode
     FDWNTreeInfo   NInfo, UInfo, PInfo;
     FDWNInsert     InsertPoint;
     StubInfo       DefaultInfo;
+    FDWNSegment    Segment[SEGMENTS];
+    unsigned long  *PageSum[3];       // From SUMFILE, for each page of each tree as thawed, or NULL
+    long           SumPages[3];
 
   public :
     FDNPREF           void FDNFUNC SetNLDir(const char FDNDATA *dirname);
     FDNPREF           void FDNFUNC SetCountry(unsigned short int newCode)  {if(IsFrozen()) CountryCode = newCode;}
     FDNPREF           void FDNFUNC SetNLExt(const char FDNDATA *nlExt);
+    FDNPREF           char FDNFUNC *GetNodeExt()  {return(NodeExt);}
+    FDNPREF           char FDNFUNC *GetIndexDir() {return(IndexDir);}
     FDNPREF           void FDNFUNC SetFlags(long newFlags)  {Flags = newFlags;}
 
     // Sophisticated tweaking
     FDNPREF           void FDNFUNC SetTreeFlags(char Index, long Flags, char PromoteRecord);
     FDNPREF   FDWNTreeInfo FDNFUNC *GetTreeFlags(char Index);
+    FDNPREF            int FDNFUNC GetTreeQuality(char Index, FDWNTreeQuality & Report);
+    FDNPREF            int FDNFUNC Compact(char Index, FDWNCompactReport & Report);
+
+    // Source segments, one for each Whence
+    FDNPREF            int FDNFUNC GetSegment(long Whence, FDWNSegment & Info);
+    FDNPREF            int FDNFUNC SetSegment(long Whence, FDWNSegment & Info);
+    FDNPREF           long FDNFUNC DeleteSegment(long Whence);
 
     FDNPREF           void FDNFUNC Freeze();
+    FDNPREF           void FDNFUNC Discard();
     FDNPREF            int FDNFUNC Thaw();
 //    FDNPREF     inline int FDNFUNC IsFrozen() {return((int) (Flags & WFDNodeIsFrozen)); }    
     FDNPREF     inline int FDNFUNC IsFrozen() {return(Frozen); }    
@@ -1005,6 +1304,8 @@ class FrontDoorWNode
 
     FDNPREF   virtual void FDNFUNC OnFreeze() { return; }
     FDNPREF   virtual void FDNFUNC OnThaw() { return; }
+    FDNPREF   virtual void FDNFUNC LockFiles() { return; }
+    FDNPREF   virtual void FDNFUNC UnlockFiles() { return; }
     
   // Services
   public :
@@ -1020,6 +1321,24 @@ class FrontDoorWNode
                                              const char * UserName, char Status, long int Whence, long int Offset);    
     FDNPREF            int FDNFUNC AddRecord(PFDXRecord & PData);
     FDNPREF            int FDNFUNC AddRecord(const char * ToMatch, const char * XLT, unsigned short Cost);        
+
+    FDNPREF            int FDNFUNC AddRecords(NFDXRecord * NData, long Count, FDWNBatchReport & Report);
+    FDNPREF            int FDNFUNC AddRecords(UFDXRecord * UData, long Count, FDWNBatchReport & Report);
+    FDNPREF            int FDNFUNC AddRecords(PFDXRecord * PData, long Count, FDWNBatchReport & Report);
+
+    FDNPREF            int FDNFUNC UpdateRecord(NFDXRecord & NData);
+    FDNPREF            int FDNFUNC UpdateRecord(UFDXRecord & UData);
+    FDNPREF            int FDNFUNC UpdateRecord(PFDXRecord & PData);
+
+    FDNPREF            int FDNFUNC DeleteRecord(NFDXRecord & NData);
+    FDNPREF            int FDNFUNC DeleteRecord(UFDXRecord & UData);
+    FDNPREF            int FDNFUNC DeleteRecord(PFDXRecord & PData);
+    FDNPREF            int FDNFUNC DeleteRecord(unsigned short Zone, unsigned short Net, unsigned short Node, unsigned short Point,
+                                                const char * UserName);
+    FDNPREF            int FDNFUNC DeleteRecord(const char * ToMatch);
+
+    FDNPREF            int FDNFUNC GetRecord(NFDXRecord & NData, long int Whence);
+    FDNPREF            int FDNFUNC GetRecord(UFDXRecord & UData, long int Whence);
   
   protected :
 
@@ -1057,6 +1376,28 @@ class FrontDoorWNode
     FDNPREF            int FDNFUNC AddRecord(UFDXRecord & UData, long LeftChild, long RightChild);
     FDNPREF            int FDNFUNC GetInsertPoint(PFDXRecord & PData);
     FDNPREF            int FDNFUNC AddRecord(PFDXRecord & PData, long LeftChild, long RightChild);
+    FDNPREF           void FDNFUNC NoteInsertPoint(FDWNTreeInfo & Info);
+    FDNPREF            int FDNFUNC GetSplitPoint(FDWNTreeInfo & Info, int InsertRecord);
+    FDNPREF            int FDNFUNC AddBatch(char Index, char * Records, long Count, FDWNBatchReport & Report);
+    FDNPREF           void FDNFUNC SortBatch(char Index, char * Records, long * Order, long Count);
+    FDNPREF            int FDNFUNC CompareRecords(char Index, const char * Record1, const char * Record2);
+    FDNPREF            int FDNFUNC GetPageLinks(char Index, long PageNo, long * Links, char * Records);
+    FDNPREF            int FDNFUNC PutPageRecords(char Index, long PageNo, char * Records, int Count, long * Links, int Direct);
+    FDNPREF            int FDNFUNC ReadImage(char Index, long PageNo, FDWNPageImage & Image);
+    FDNPREF            int FDNFUNC WriteImage(char Index, long PageNo, FDWNPageImage & Image);
+    FDNPREF           long FDNFUNC AllocPage(char Index);
+    FDNPREF            int FDNFUNC FreePage(char Index, long PageNo);
+    FDNPREF            int FDNFUNC SetRoot(char Index, long PageNo);
+    FDNPREF            int FDNFUNC DeleteFromTree(char Index, char * Record);
+    FDNPREF            int FDNFUNC GetSuccessor(char Index, char * Found, int Strict);
+    FDNPREF           void FDNFUNC RemoveFromImage(FDWNPageImage & Image, int Position, int RecSize);
+    FDNPREF           long FDNFUNC GetTreeRecords(char Index, char * Store);
+    FDNPREF            int FDNFUNC GetRecordSize(char Index);
+    FDNPREF           void FDNFUNC ProbeRecord(char Index, char * Record);
+    FDNPREF FDN_FileObject FDNFUNC *GetIndexFile(char Index);
+    FDNPREF            int FDNFUNC ReopenIndex(char Index);
+    FDNPREF            int FDNFUNC FileMode() { return((Flags & WFDNodeInMemory) ? FDNFileMemory : 0); }
+    FDNPREF            int FDNFUNC GetSegmentSlot(long Whence);
 
     FDNPREF            int FDNFUNC CompareKey(const char * key1, const char * key2, int MaxLen);
     FDNPREF           void FDNFUNC FormUserName(const char * In, char * Out);
@@ -1065,6 +1406,18 @@ class FrontDoorWNode
 
     FDNPREF           char FDNFUNC *AddTrail(char *rawfile);
     FDNPREF  unsigned long FDNFUNC Time(unsigned long * Pointer);
+
+    // Publication of the index set, see WFDNodePublish
+    FDNPREF            int FDNFUNC ReadGeneration(char * Name);
+    FDNPREF            int FDNFUNC StageIndex(const char * Current);
+    FDNPREF            int FDNFUNC CopyIndexFile(const char * From, const char * To);
+    FDNPREF            int FDNFUNC Publish();
+
+    // Page sums, see WFDNodeChecksum
+    FDNPREF            int FDNFUNC ReadSums();
+    FDNPREF            int FDNFUNC WriteSums();
+    FDNPREF           void FDNFUNC DropSums();
+    FDNPREF            int FDNFUNC KnownPage(char Index, long PageNo, const void * Page);
   
   // Implementation
 
@@ -1121,6 +1474,8 @@ class FrontDoorWNode
 /* 34    Invalid page in PHONE.FDX                                        */
 /* 100    Current nodelist extension invalid in OverWrite mode            */
 /* 101    String too long                                                 */
+/* 102    Unable to stage or publish the index set (WFDNodePublish)       */
+/* 103    Unable to write out an index file on Freeze()                   */
 /*                                                                        */
 /* The class should attempt to limit damage if it encounters an error     */
 /* condition, by terminating a search, freezing itself, or otherwise      */
@@ -0,0 +1,778 @@
+/*
+** Piglet Productions
+**
+** FileName       : FDNPIPE.CPP
+**
+** Implements     : FDNPipeServer, FDNPipeClient
+**
+** Description
+**
+** Nodelist lookups served over a named pipe. See FDNPIPE.H.
+**
+**
+** Copyright applies on this file, and distribution may be limited.
+*/
+
+#include "fdnpipe.h"
+#include <stdio.h>
+#include <ctype.h>
+
+
+// A connection being served, handed to the thread which serves it
+
+struct FDNPipeConnection {
+  FDNPipeServer * Server;
+  FDNPipeConnection * Next;
+#if defined(__NT__)
+  HANDLE          Pipe;
+#elif defined(__OS2__)
+  HPIPE           Pipe;
+#endif
+};
+
+
+/*
+**    FDNPipeName
+**
+** Forms the name of the pipe served for a nodelist directory, from the
+** directory regardless of case.
+*/
+void FDNPipeName(const char * nldir, char * Name)
+{
+  unsigned long Key = 0x811C9DC5UL;
+
+  while(*nldir){
+    Key = ((Key ^ (unsigned char) toupper(*nldir++)) * 0x01000193UL) & 0xFFFFFFFFUL;
+  }
+#if defined(__NT__)
+  sprintf(Name, "\\\\.\\pipe\\FDNODE.%08lX", Key);
+#else
+  sprintf(Name, "\\PIPE\\FDNODE.%08lX", Key);
+#endif
+}
+
+
+/*
+**    Pipe io
+**
+** Reads whatever is waiting, up to Length bytes, or writes all of a
+** buffer, to a pipe.
+**
+**    Returns
+**
+**    0 on failure or once the other end has closed, the bytes read or 1
+**    otherwise
+*/
+#if defined(__NT__)
+
+static unsigned ReadPipe(HANDLE Pipe, char * Buffer, unsigned Length)
+{
+  DWORD Got;
+
+  if(!ReadFile(Pipe, Buffer, Length, &Got, NULL)) return(0);
+  return((unsigned) Got);
+}
+
+
+static int WritePipe(HANDLE Pipe, const char * Buffer, unsigned Length)
+{
+  DWORD Put;
+
+  while(Length){
+    if(!WriteFile(Pipe, Buffer, Length, &Put, NULL) || !Put) return(0);
+    Buffer += Put;
+    Length -= (unsigned) Put;
+  }
+  return(1);
+}
+
+#elif defined(__OS2__)
+
+static unsigned ReadPipe(HFILE Pipe, char * Buffer, unsigned Length)
+{
+  ULONG Got;
+
+  if(DosRead(Pipe, Buffer, Length, &Got)) return(0);
+  return((unsigned) Got);
+}
+
+
+static int WritePipe(HFILE Pipe, const char * Buffer, unsigned Length)
+{
+  ULONG Put;
+
+  while(Length){
+    if(DosWrite(Pipe, (PVOID) Buffer, Length, &Put) || !Put) return(0);
+    Buffer += Put;
+    Length -= (unsigned) Put;
+  }
+  return(1);
+}
+
+#endif
+
+
+/*
+**    FDNPipeServer
+**
+** Serves lookups on a nodelist already set up by the caller. The pipe is
+** named from the nodelist directory of Node, and the caller should not
+** use Node itself while Run() is serving it. Node is only used by one
+** thread at a time, but as files shared with FDNodeShared are not
+** guarded, no other object in the program may share them with it.
+*/
+FDNPipeServer::FDNPipeServer(FrontDoorNode & Node) : Nodelist(Node)
+{
+  FDNPipeName(Nodelist.GetNLDir(), Name);
+  Stopping = 0;
+  Clients = NULL;
+#if defined(__NT__)
+  InitializeCriticalSection(&Guard);
+  Idle = CreateEvent(NULL, TRUE, TRUE, NULL);
+#elif defined(__OS2__)
+  Guard = 0;
+  Idle = 0;
+  DosCreateMutexSem(NULL, &Guard, 0, FALSE);
+  DosCreateEventSem(NULL, &Idle, 0, TRUE);
+#endif
+}
+
+
+/*
+**    ~FDNPipeServer
+**
+** Cuts off any clients still being served, and waits for their threads
+** to finish with the server.
+*/
+FDNPipeServer::~FDNPipeServer()
+{
+  Drop();
+#if defined(__NT__)
+  if(Idle) CloseHandle(Idle);
+  DeleteCriticalSection(&Guard);
+#elif defined(__OS2__)
+  if(Idle) DosCloseEventSem(Idle);
+  if(Guard) DosCloseMutexSem(Guard);
+#endif
+}
+
+
+/*
+**    Run
+**
+** Waits for clients, serving each on a thread of its own, until Stop() is
+** called. If a thread cannot be had the client is served before the next
+** is waited for. Before returning, any clients still being served are
+** cut off, and their threads waited for.
+**
+**    Returns
+**
+**    1 once stopped, 0 if the pipe could not be created
+*/
+int FDNPipeServer::Run()
+{
+#if defined(__NT__)
+  FDNPipeConnection * Connection;
+  HANDLE Pipe, Thread;
+  DWORD  Id;
+  int    Created = 1;
+
+  while(!Stopping){
+    Pipe = CreateNamedPipe(Name, PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+                           PIPE_UNLIMITED_INSTANCES, FDNPIPEOUT, FDNPIPEIN, 0, NULL);
+    if(Pipe == INVALID_HANDLE_VALUE){
+      Created = 0;
+      break;
+    }
+    if((!ConnectNamedPipe(Pipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED) || Stopping){
+      CloseHandle(Pipe);
+      continue;
+    }
+    Connection = new FDNPipeConnection;
+    if(!Connection){
+      CloseHandle(Pipe);
+      continue;
+    }
+    Connection->Server = this;
+    Connection->Pipe = Pipe;
+    Join(Connection);
+    Thread = CreateThread(NULL, 0, ServeThread, Connection, 0, &Id);
+    if(Thread) CloseHandle(Thread);
+    else ServeThread(Connection);
+  }
+  Drop();
+  return(Created);
+#elif defined(__OS2__)
+  FDNPipeConnection * Connection;
+  HPIPE Pipe;
+  TID   Thread;
+  int   Created = 1;
+
+  while(!Stopping){
+    if(DosCreateNPipe((PSZ) Name, &Pipe, NP_ACCESS_DUPLEX, NP_WAIT | NP_TYPE_BYTE | NP_READMODE_BYTE | NP_UNLIMITED_INSTANCES,
+                      FDNPIPEOUT, FDNPIPEIN, 0)){
+      Created = 0;
+      break;
+    }
+    if(DosConnectNPipe(Pipe) || Stopping){
+      DosClose(Pipe);
+      continue;
+    }
+    Connection = new FDNPipeConnection;
+    if(!Connection){
+      DosClose(Pipe);
+      continue;
+    }
+    Connection->Server = this;
+    Connection->Pipe = Pipe;
+    Join(Connection);
+    if(DosCreateThread(&Thread, (PFNTHREAD) ServeThread, (ULONG) Connection, 0, 32768)) ServeThread((ULONG) Connection);
+  }
+  Drop();
+  return(Created);
+#else
+  return(0);
+#endif
+}
+
+
+/*
+**    Stop
+**
+** Asks Run() to return, connecting to the pipe to wake it if it is
+** waiting for a client. Clients already connected are cut off by Run()
+** before it returns.
+*/
+void FDNPipeServer::Stop()
+{
+#if defined(__NT__)
+  HANDLE Wake;
+
+  Stopping = 1;
+  Wake = CreateFile(Name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+  if(Wake != INVALID_HANDLE_VALUE) CloseHandle(Wake);
+#elif defined(__OS2__)
+  HFILE Wake;
+  ULONG Action;
+
+  Stopping = 1;
+  if(!DosOpen((PSZ) Name, &Wake, &Action, 0, FILE_NORMAL, OPEN_ACTION_OPEN_IF_EXISTS,
+              OPEN_ACCESS_READWRITE | OPEN_SHARE_DENYNONE, NULL)) DosClose(Wake);
+#else
+  Stopping = 1;
+#endif
+}
+
+
+#if defined(__NT__)
+
+DWORD WINAPI FDNPipeServer::ServeThread(LPVOID Connection)
+{
+  FDNPipeConnection * Client = (FDNPipeConnection *) Connection;
+
+  Client->Server->Serve(Client);
+  Client->Server->Leave(Client);
+  DisconnectNamedPipe(Client->Pipe);
+  CloseHandle(Client->Pipe);
+  delete Client;
+  return(0);
+}
+
+#elif defined(__OS2__)
+
+void APIENTRY FDNPipeServer::ServeThread(ULONG Connection)
+{
+  FDNPipeConnection * Client = (FDNPipeConnection *) Connection;
+
+  Client->Server->Serve(Client);
+  Client->Server->Leave(Client);
+  DosDisConnectNPipe(Client->Pipe);
+  DosClose(Client->Pipe);
+  delete Client;
+}
+
+#endif
+
+
+/*
+**    Join, Leave
+**
+** Keep the list of clients being served. The last to leave sets Idle
+** while still holding the lock, so that the server is not destroyed
+** before it has let go.
+*/
+void FDNPipeServer::Join(FDNPipeConnection * Connection)
+{
+#if defined(__OS2__)
+  ULONG Posts;
+#endif
+
+  Lock();
+  Connection->Next = Clients;
+  Clients = Connection;
+#if defined(__NT__)
+  ResetEvent(Idle);
+#elif defined(__OS2__)
+  DosResetEventSem(Idle, &Posts);
+#endif
+  Unlock();
+}
+
+
+void FDNPipeServer::Leave(FDNPipeConnection * Connection)
+{
+  FDNPipeConnection ** Link;
+
+  Lock();
+  for(Link = &Clients; *Link; Link = &(*Link)->Next){
+    if(*Link == Connection){
+      *Link = Connection->Next;
+      break;
+    }
+  }
+#if defined(__NT__)
+  if(!Clients) SetEvent(Idle);
+#elif defined(__OS2__)
+  if(!Clients) DosPostEventSem(Idle);
+#endif
+  Unlock();
+}
+
+
+/*
+**    Drop
+**
+** Disconnects every client still being served, which ends the read or
+** write its thread is waiting on, and waits for the threads to leave.
+*/
+void FDNPipeServer::Drop()
+{
+#ifdef PipeServer
+  FDNPipeConnection * Client;
+
+  Lock();
+  for(Client = Clients; Client; Client = Client->Next){
+  #if defined(__NT__)
+    DisconnectNamedPipe(Client->Pipe);
+  #else
+    DosDisConnectNPipe(Client->Pipe);
+  #endif
+  }
+  Unlock();
+#if defined(__NT__)
+  if(Idle) WaitForSingleObject(Idle, INFINITE);
+#else
+  if(Idle) DosWaitEventSem(Idle, SEM_INDEFINITE_WAIT);
+#endif
+  // Let the last client out of Leave()
+  Lock();
+  Unlock();
+#endif
+}
+
+
+/*
+**    Serve
+**
+** Answers the requests of one client until it closes its end of the
+** pipe, or sends something which is not a request. Every complete request
+** read is answered before the answers are written, so that a client
+** which sends several at once has their answers back in one write. The
+** nodelist is checked for a compile once for each such batch.
+*/
+void FDNPipeServer::Serve(FDNPipeConnection * Connection)
+{
+#ifdef PipeServer
+  FDNPipeRequest Request;
+  char * In  = new char[FDNPIPEIN];
+  char * Out = new char[FDNPIPEOUT];
+  unsigned Have = 0, Got, Used, Put;
+  int  Ready, Bad = 0;
+
+  while(In && Out && !Bad && (Got = ReadPipe(Connection->Pipe, In + Have, FDNPIPEIN - Have)) != 0){
+    Have += Got;
+    Used = Put = 0;
+    Lock();
+    Nodelist.AutoFreezeThaw();
+    Ready = !Nodelist.IsFrozen();
+    while(!Bad && Have - Used >= sizeof(FDNPipeRequest)){
+      memcpy(&Request, In + Used, sizeof(FDNPipeRequest));
+      if(Request.Length < sizeof(FDNPipeRequest) || Request.Length > FDNPIPEREQUEST){
+        Bad = 1;
+        break;
+      }
+      if(Have - Used < Request.Length) break;
+      if(Put + FDNPIPEANSWER > FDNPIPEOUT){
+        Unlock();
+        Bad = !WritePipe(Connection->Pipe, Out, Put);
+        Put = 0;
+        Lock();
+      }
+      Put += Answer(Request, In + Used + sizeof(FDNPipeRequest), Out + Put, Ready);
+      Used += Request.Length;
+    }
+    Unlock();
+    if(Put && !Bad) Bad = !WritePipe(Connection->Pipe, Out, Put);
+    Have -= Used;
+    memmove(In, In + Used, Have);
+  }
+  delete[] In;
+  delete[] Out;
+#else
+  (void) Connection;
+#endif
+}
+
+
+/*
+**    Answer
+**
+** Looks up one request, placing the answer in Buffer. Text is whatever
+** follows the request.
+**
+**    Returns
+**
+**    The length of the answer
+*/
+static char * PutText(char * Buffer, const char * Text)
+{
+  size_t Length = Text ? strlen(Text) : 0;
+
+  if(Length >= FDNPIPETEXT) Length = FDNPIPETEXT - 1;
+  if(Length) memcpy(Buffer, Text, Length);
+  Buffer[Length] = 0;
+  return(Buffer + Length + 1);
+}
+
+
+int FDNPipeServer::Answer(const FDNPipeRequest & Request, const char * Text, char * Buffer, int Ready)
+{
+  FDNPipeAnswer Reply;
+  FDNFind Found;
+  char   * Put = Buffer + sizeof(FDNPipeAnswer);
+  unsigned TextLength = Request.Length - sizeof(FDNPipeRequest);
+  int      Missing = 1;
+
+  memset(&Reply, 0, sizeof(FDNPipeAnswer));
+  Reply.Tag = Request.Tag;
+  Reply.Status = Ready ? FDNPipeNotFound : FDNPipeFrozen;
+  if(Ready){
+    switch(Request.Op){
+      case FDNPipeAddress :
+        Missing = Nodelist.Find(Found, Request.Zone, Request.Net, Request.Node, Request.Point);
+        break;
+      case FDNPipeUser :
+        if(TextLength && !Text[TextLength - 1]) Missing = Nodelist.Find(Found, Text);
+        else Reply.Status = FDNPipeBad;
+        break;
+      default :
+        Reply.Status = FDNPipeBad;
+        break;
+    }
+  }
+  if(!Missing){
+    Reply.Status = FDNPipeFound;
+    Reply.Offset = Found.GetOffset();
+    Reply.Speed  = Nodelist.GetSpeed(Found);
+    Reply.Zone   = Found.GetZone();
+    Reply.Net    = Found.GetNet();
+    Reply.Node   = Found.GetNode();
+    Reply.Point  = Found.GetPoint();
+    Reply.RNet   = Found.GetRNet();
+    Reply.RNode  = Found.GetRNode();
+    Put = PutText(Put, Nodelist.GetSysName(Found));
+    Put = PutText(Put, Nodelist.GetLocation(Found));
+    Put = PutText(Put, Nodelist.GetSysop(Found));
+    Put = PutText(Put, Nodelist.GetNumber(Found));
+    Put = PutText(Put, Nodelist.GetFlags(Found));
+  }
+  Reply.Length = (unsigned short) (Put - Buffer);
+  memcpy(Buffer, &Reply, sizeof(FDNPipeAnswer));
+  return(Reply.Length);
+}
+
+
+/*
+**    Lock, Unlock
+**
+** Serialise the use of the nodelist between the threads serving clients.
+*/
+void FDNPipeServer::Lock()
+{
+#if defined(__NT__)
+  EnterCriticalSection(&Guard);
+#elif defined(__OS2__)
+  if(Guard) DosRequestMutexSem(Guard, SEM_INDEFINITE_WAIT);
+#endif
+}
+
+
+void FDNPipeServer::Unlock()
+{
+#if defined(__NT__)
+  LeaveCriticalSection(&Guard);
+#elif defined(__OS2__)
+  if(Guard) DosReleaseMutexSem(Guard);
+#endif
+}
+
+
+/*
+**    FDNPipeClient
+**
+** Connects to the server for a nodelist directory, if one is running.
+*/
+FDNPipeClient::FDNPipeClient(const char FDNDATA *nldir)
+{
+  char Name[PATHLENGTH];
+
+  Open = 0;
+  Waiting = 0;
+  Queued = Held = 0;
+  FDNPipeName(nldir, Name);
+#if defined(__NT__)
+  Pipe = CreateFile(Name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+  if(Pipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY && WaitNamedPipe(Name, 1000)){
+    Pipe = CreateFile(Name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+  }
+  Open = (Pipe != INVALID_HANDLE_VALUE);
+#elif defined(__OS2__)
+  ULONG Action;
+  APIRET rc;
+
+  rc = DosOpen((PSZ) Name, &Pipe, &Action, 0, FILE_NORMAL, OPEN_ACTION_OPEN_IF_EXISTS,
+               OPEN_ACCESS_READWRITE | OPEN_SHARE_DENYNONE, NULL);
+  if(rc == ERROR_PIPE_BUSY && !DosWaitNPipe((PSZ) Name, 1000)){
+    rc = DosOpen((PSZ) Name, &Pipe, &Action, 0, FILE_NORMAL, OPEN_ACTION_OPEN_IF_EXISTS,
+                 OPEN_ACCESS_READWRITE | OPEN_SHARE_DENYNONE, NULL);
+  }
+  Open = !rc;
+#endif
+}
+
+
+FDNPipeClient::~FDNPipeClient()
+{
+  Close();
+}
+
+
+void FDNPipeClient::Close()
+{
+  if(!Open) return;
+#if defined(__NT__)
+  CloseHandle(Pipe);
+#elif defined(__OS2__)
+  DosClose(Pipe);
+#endif
+  Open = 0;
+}
+
+
+/*
+**    Ask
+**
+** Queues a request, to be answered by a later Collect() with the same
+** Tag. A user name is given surname first, as for FrontDoorNode::Find(),
+** and the first match is answered.
+**
+**    Returns
+**
+**    1 if the request was queued, 0 if FDNPIPEWINDOW requests are
+**    already waiting, or the server has gone
+*/
+int FDNPipeClient::Ask(unsigned long Tag, unsigned short Zone, unsigned short Net, unsigned short Node, unsigned short Point)
+{
+  FDNPipeRequest Request;
+
+  memset(&Request, 0, sizeof(FDNPipeRequest));
+  Request.Op    = FDNPipeAddress;
+  Request.Tag   = Tag;
+  Request.Zone  = Zone;
+  Request.Net   = Net;
+  Request.Node  = Node;
+  Request.Point = Point;
+  return(Queue(Request, NULL));
+}
+
+
+int FDNPipeClient::Ask(unsigned long Tag, const char * UserName)
+{
+  FDNPipeRequest Request;
+
+  memset(&Request, 0, sizeof(FDNPipeRequest));
+  Request.Op  = FDNPipeUser;
+  Request.Tag = Tag;
+  return(Queue(Request, UserName));
+}
+
+
+int FDNPipeClient::Queue(FDNPipeRequest & Request, const char * Text)
+{
+  unsigned Length = sizeof(FDNPipeRequest);
+  size_t   TextLength = Text ? strlen(Text) + 1 : 0;
+
+  if(!Open || Waiting >= FDNPIPEWINDOW) return(0);
+  if(TextLength > FDNPIPEREQUEST - sizeof(FDNPipeRequest)) return(0);
+  Length += (unsigned) TextLength;
+  Request.Length = (unsigned short) Length;
+  if(Queued + Length > FDNPIPEIN && !Flush()) return(0);
+  memcpy(Out + Queued, &Request, sizeof(FDNPipeRequest));
+  if(TextLength) memcpy(Out + Queued + sizeof(FDNPipeRequest), Text, TextLength);
+  Queued += Length;
+  Waiting++;
+  return(1);
+}
+
+
+/*
+**    Flush
+**
+** Sends any requests still queued.
+**
+**    Returns
+**
+**    1 on success, 0 if the server has gone
+*/
+int FDNPipeClient::Flush()
+{
+  if(!Queued) return(Open);
+  if(!Open || !Send(Out, Queued)){
+    Close();
+    return(0);
+  }
+  Queued = 0;
+  return(1);
+}
+
+
+/*
+**    Collect
+**
+** Takes the answer to the earliest request not yet collected, sending
+** any requests still queued first.
+**
+**    Returns
+**
+**    1 if Result holds an answer, 0 if nothing is waiting or the server
+**    has gone
+*/
+int FDNPipeClient::Collect(FDNPipeResult & Result)
+{
+  FDNPipeAnswer Reply;
+  char   * Text;
+  unsigned Got;
+  int      loop;
+
+  Result.Status = FDNPipeNotFound;
+  if(!Waiting || !Flush()) return(0);
+  for(;;){
+    if(Held >= sizeof(FDNPipeAnswer)){
+      memcpy(&Reply, In, sizeof(FDNPipeAnswer));
+      if(Reply.Length < sizeof(FDNPipeAnswer) || Reply.Length > FDNPIPEANSWER){
+        Close();
+        return(0);
+      }
+      if(Held >= Reply.Length) break;
+    }
+    Got = Receive(In + Held, FDNPIPEOUT - Held);
+    if(!Got){
+      Close();
+      return(0);
+    }
+    Held += Got;
+  }
+
+  memset(&Result, 0, sizeof(FDNPipeResult));
+  Result.Tag    = Reply.Tag;
+  Result.Status = Reply.Status;
+  Result.Offset = Reply.Offset;
+  Result.Speed  = Reply.Speed;
+  Result.Zone   = Reply.Zone;
+  Result.Net    = Reply.Net;
+  Result.Node   = Reply.Node;
+  Result.Point  = Reply.Point;
+  Result.RNet   = Reply.RNet;
+  Result.RNode  = Reply.RNode;
+  Text = In + sizeof(FDNPipeAnswer);
+  if(Reply.Status == FDNPipeFound){
+    char * Field[5];
+
+    Field[0] = Result.SysName;
+    Field[1] = Result.Location;
+    Field[2] = Result.Sysop;
+    Field[3] = Result.Number;
+    Field[4] = Result.Flags;
+    for(loop = 0; loop < 5 && Text < In + Reply.Length; loop++){
+      strncpy(Field[loop], Text, FDNPIPETEXT - 1);
+      Text += strlen(Text) + 1;
+    }
+  }
+
+  Held -= Reply.Length;
+  memmove(In, In + Reply.Length, Held);
+  Waiting--;
+  return(1);
+}
+
+
+/*
+**    Find
+**
+** A single lookup. Not to be mixed with requests still waiting to be
+** collected.
+**
+**    Returns
+**
+**    1 if the node was found, 0 otherwise
+*/
+int FDNPipeClient::Find(FDNPipeResult & Result, unsigned short Zone, unsigned short Net, unsigned short Node, unsigned short Point)
+{
+  Result.Status = FDNPipeNotFound;
+  if(Waiting || !Ask(0, Zone, Net, Node, Point) || !Collect(Result)) return(0);
+  return(Result.Status == FDNPipeFound);
+}
+
+
+int FDNPipeClient::Find(FDNPipeResult & Result, const char * UserName)
+{
+  Result.Status = FDNPipeNotFound;
+  if(Waiting || !Ask(0, UserName) || !Collect(Result)) return(0);
+  return(Result.Status == FDNPipeFound);
+}
+
+
+/*
+**    Send, Receive
+**
+** Write all of a buffer to the server, or read whatever it has sent, up
+** to Length bytes.
+**
+**    Returns
+**
+**    0 on failure, 1 or the bytes read otherwise
+*/
+int FDNPipeClient::Send(const char * Buffer, unsigned Length)
+{
+#ifdef PipeServer
+  return(WritePipe(Pipe, Buffer, Length));
+#else
+  (void) Buffer;
+  (void) Length;
+  return(0);
+#endif
+}
+
+
+int FDNPipeClient::Receive(char * Buffer, unsigned Length)
+{
+#ifdef PipeServer
+  return((int) ReadPipe(Pipe, Buffer, Length));
+#else
+  (void) Buffer;
+  (void) Length;
+  return(0);
+#endif
+}
+
+/* end of file fdnpipe.cpp */
@@ -0,0 +1,221 @@
+/*
+** Piglet Productions
+**
+** FileName       : FDNPIPE.H
+**
+** Defines        : FDNPipeServer, FDNPipeClient, FDNPipeResult
+**
+** Description
+**
+** Lookups served over a named pipe by a program which keeps a nodelist
+** open, so that programs which run briefly and look up one or two nodes
+** need not open and read the index for themselves. The server answers
+** from its own FrontDoorNode, already thawed, and with its caches warm.
+**
+** The pipe is found from the nodelist directory, which the server and its
+** clients must therefore give in the same form. A client may send a
+** number of requests before reading any answers, and the server answers
+** all the requests it has in one write. Answers come back in the order
+** the requests were sent, carrying the tag given with each request.
+**
+** Named pipes are available under NT and OS/2. Elsewhere no server can be
+** run, and a client never finds one; a program should then fall back to
+** using FrontDoorNode itself.
+**
+**
+** Copyright applies on this file, and distribution may be limited.
+*/
+
+#ifndef _FDN_FDNPIPE
+#define _FDN_FDNPIPE
+
+#include "fdnode.h"
+
+#if defined(__NT__)
+#define PipeServer
+#include <windows.h>
+#elif defined(__OS2__)
+#define PipeServer
+#define INCL_DOSNMPIPES
+#define INCL_DOSFILEMGR
+#define INCL_DOSPROCESS
+#define INCL_DOSSEMAPHORES
+#define INCL_DOSERRORS
+#include <os2.h>
+#endif
+
+// FDNPIPETEXT is the room for each string of an answer, longer strings
+// being cut short. A client may have at most FDNPIPEWINDOW requests
+// unanswered, so that their answers always fit in the pipe and the server
+// never waits on a client which is itself waiting to send.
+
+#define FDNPIPETEXT     128
+#define FDNPIPEWINDOW   16
+#define FDNPIPEREQUEST  (sizeof(FDNPipeRequest) + 64)
+#define FDNPIPEANSWER   (sizeof(FDNPipeAnswer) + 5 * FDNPIPETEXT)
+#define FDNPIPEIN       (FDNPIPEWINDOW * FDNPIPEREQUEST)
+#define FDNPIPEOUT      (FDNPIPEWINDOW * FDNPIPEANSWER)
+
+// Requests
+
+#define FDNPipeAddress  1             // Find a node by address
+#define FDNPipeUser     2             // Find a node by the name of its sysop
+
+// The Status of an answer
+
+#define FDNPipeNotFound 0
+#define FDNPipeFound    1
+#define FDNPipeFrozen   2             // The index is being compiled, try later
+#define FDNPipeBad      3             // The request was not understood
+
+
+// A request, followed for FDNPipeUser by the name, with its terminating NUL.
+// The fields are ordered so that no compiler pads them.
+
+struct FDNPipeRequest {
+  unsigned short Length;              // Of the whole request
+  unsigned char  Op;
+  unsigned char  Reserved;
+  unsigned long  Tag;                 // Given back with the answer
+  unsigned short Zone, Net, Node, Point;
+};
+
+// An answer, followed for FDNPipeFound by the system name, location, sysop,
+// dialling number and flags, each with its terminating NUL
+
+struct FDNPipeAnswer {
+  unsigned short Length;              // Of the whole answer
+  unsigned char  Status;
+  unsigned char  Reserved;
+  unsigned long  Tag;
+  long           Offset;
+  unsigned long  Speed;
+  unsigned short Zone, Net, Node, Point;
+  unsigned short RNet, RNode;
+};
+
+
+// An answer as given to a client
+
+class FDNPipeResult
+{
+  public :
+
+  unsigned long  Tag;
+  int            Status;
+  long           Offset;
+  unsigned long  Speed;
+  unsigned short Zone, Net, Node, Point;
+  unsigned short RNet, RNode;
+  char           SysName[FDNPIPETEXT];
+  char           Location[FDNPIPETEXT];
+  char           Sysop[FDNPIPETEXT];
+  char           Number[FDNPIPETEXT];     // Translated for dialling, empty if there is none
+  char           Flags[FDNPIPETEXT];
+};
+
+
+struct FDNPipeConnection;
+
+class FDNPipeServer
+{
+  // Data
+
+  protected :
+
+    FrontDoorNode & Nodelist;
+    char          Name[PATHLENGTH];
+    volatile int  Stopping;
+    FDNPipeConnection * Clients;      // Those being served, each on a thread
+  #if defined(__NT__)
+    CRITICAL_SECTION Guard;           // Held while the nodelist or Clients are in use
+    HANDLE        Idle;               // Set while there are no Clients
+  #elif defined(__OS2__)
+    HMTX          Guard;
+    HEV           Idle;
+  #endif
+
+  // Implementation
+
+  public :
+
+    FDNPipeServer(FrontDoorNode & Node);
+    virtual ~FDNPipeServer();
+
+    // Serves clients until Stop() is called. Returns 0 if the pipe
+    // could not be created.
+               int  Run();
+              void  Stop();
+
+  protected :
+
+              void  Serve(FDNPipeConnection * Connection);
+              void  Join(FDNPipeConnection * Connection);
+              void  Leave(FDNPipeConnection * Connection);
+              void  Drop();
+               int  Answer(const FDNPipeRequest & Request, const char * Text, char * Buffer, int Ready);
+              void  Lock();
+              void  Unlock();
+  #if defined(__NT__)
+    static     DWORD WINAPI ServeThread(LPVOID Connection);
+  #elif defined(__OS2__)
+    static    void APIENTRY ServeThread(ULONG Connection);
+  #endif
+};
+
+
+class FDNPipeClient
+{
+  // Data
+
+  protected :
+
+  #if defined(__NT__)
+    HANDLE        Pipe;
+  #elif defined(__OS2__)
+    HFILE         Pipe;
+  #endif
+    int           Open;
+    int           Waiting;            // Requests sent or queued, not yet answered
+    unsigned      Queued;             // Bytes of requests not yet sent
+    unsigned      Held;               // Bytes of answers read but not yet taken
+    char          Out[FDNPIPEIN];
+    char          In[FDNPIPEOUT];
+
+  // Implementation
+
+  public :
+
+    FDNPipeClient(const char FDNDATA *nldir);
+    virtual ~FDNPipeClient();
+
+    // Whether a server was found
+               int  IsOpen() { return(Open); }
+
+    // Requests are queued until Flush() or Collect(), or until the queue
+    // is full. Ask() returns 0 once FDNPIPEWINDOW requests are waiting,
+    // when Collect() must be called before more are asked.
+               int  Ask(unsigned long Tag, unsigned short Zone, unsigned short Net, unsigned short Node, unsigned short Point);
+               int  Ask(unsigned long Tag, const char * UserName);
+               int  Flush();
+               int  Collect(FDNPipeResult & Result);
+
+    // A single lookup, returning 1 if it was found
+               int  Find(FDNPipeResult & Result, unsigned short Zone, unsigned short Net, unsigned short Node, unsigned short Point);
+               int  Find(FDNPipeResult & Result, const char * UserName);
+
+  protected :
+
+               int  Queue(FDNPipeRequest & Request, const char * Text);
+               int  Send(const char * Buffer, unsigned Length);
+               int  Receive(char * Buffer, unsigned Length);
+              void  Close();
+};
+
+
+// The name of the pipe for a nodelist directory
+void FDNPipeName(const char * nldir, char * Name);
+
+#endif
+
+/* end of file fdnpipe.h */
@@ -14,6 +14,7 @@ FDWCachedNode::FDWCachedNode() : FrontDoorWNode()
 {
   Flags = Flags | WFDNodeOverWrite;
   Counter = 0;
+  Behind = 0;
   ConfigureDefaults();
   ConstructCache();
 }
@@ -23,6 +24,7 @@ FDWCachedNode::FDWCachedNode(const char FDNDATA *nldir, const char FDNDATA *nlex
 {
   Flags = flags;
   Counter = 0;
+  Behind = 0;
   SetNLDir(nldir);
   SetNLExt(nlext);
   SetCountry(cc);
@@ -36,6 +38,7 @@ FDWCachedNode::FDWCachedNode(const char FDNDATA *nldir, const char FDNDATA *nlex
 {
   Flags = flags;
   Counter = 0;
+  Behind = 0;
   SetNLDir(nldir);
   SetNLExt(nlext);
   SetCountry(cc);
@@ -55,6 +58,7 @@ FDWCachedNode::FDWCachedNode(const char FDNDATA *nldir, const char FDNDATA *nlex
 FDWCachedNode::~FDWCachedNode()
 {
   Freeze ();
+  StopFlusher();
   DestroyCache();
 }
 
@@ -168,6 +172,9 @@ void FDWCachedNode::DestroyCache()
 ** version, and /not/ this function. Therefore, it's essential that you call
 ** Thaw() in the derived class, and not the base if you want this called.
 **
+** Pages held over from before the last Freeze() are kept where the page
+** sums (see WFDNodeChecksum) show them to be unchanged.
+**
 */
 void FDWCachedNode::OnThaw()
 {
@@ -178,11 +185,14 @@ void FDWCachedNode::OnThaw()
   #endif
 
   for(loop = 0; loop < NFDXCacheSize; loop++){
-    NFDXPageNo[loop] = NFDXHitNo[loop] = 0;
+    if(!KnownPage(NFDXIndex, NFDXPageNo[loop], NFDXCache + loop)) NFDXPageNo[loop] = NFDXHitNo[loop] = 0;
   }
   for(loop = 0; loop < UFDXCacheSize; loop++){
-    UFDXPageNo[loop] = UFDXHitNo[loop] = 0;
+    if(!KnownPage(UFDXIndex, UFDXPageNo[loop], UFDXCache + loop)) UFDXPageNo[loop] = UFDXHitNo[loop] = 0;
   }
+
+  if(NFDXCacheSize) memset(NFDXDirtyMap, 0, (NFDXCacheSize / 8) + 1);
+  if(UFDXCacheSize) memset(UFDXDirtyMap, 0, (UFDXCacheSize / 8) + 1);
 }
 
 
@@ -193,6 +203,10 @@ void FDWCachedNode::OnThaw()
 ** which ensures that any pages not committed to disk when a Freeze (probably
 ** due to class destruction) occurs, are flushed from the Cache(s).
 **
+** The write behind thread is stopped first, so that by the time the base
+** class writes the stubs and closes the files, nothing else will touch them.
+** It is started again by the next page to be made dirty.
+**
 */
 void FDWCachedNode::OnFreeze()
 {
@@ -201,11 +215,12 @@ void FDWCachedNode::OnFreeze()
   #ifdef g_RunDebug
   Trace.Printf("%tOnFreeze()\n");
   #endif
+  StopFlusher();
   for(loop = 0; loop < NFDXCacheSize; loop++){
-    if(NFDXPageNo[loop]) RawWritePage(NFDXCache[loop], NFDXPageNo[loop]);
+    if(NFDXPageNo[loop] && GetNFDXBit(loop)) RawWritePage(NFDXCache[loop], NFDXPageNo[loop]);
   }
   for(loop = 0; loop < UFDXCacheSize; loop++){
-    if(UFDXPageNo[loop]) RawWritePage(UFDXCache[loop], UFDXPageNo[loop]);
+    if(UFDXPageNo[loop] && GetUFDXBit(loop)) RawWritePage(UFDXCache[loop], UFDXPageNo[loop]);
   }
 }
 
@@ -240,6 +255,7 @@ int FDWCachedNode::CheckCache(NFDXPage & tofill, long page)
   #ifdef g_RunDebug
   Trace.Printf("%tCheckCache - Page number %lu\n", page);
   #endif
+  LockCache();
   for(loop = 0; (loop < NFDXCacheSize) && !found; loop++){
    if(NFDXPageNo[loop] == page){
      #ifdef g_RunDebug
@@ -250,6 +266,7 @@ int FDWCachedNode::CheckCache(NFDXPage & tofill, long page)
      found = 1;
    }
   }
+  UnlockCache();
   return(found);
 }
 
@@ -280,6 +297,7 @@ int FDWCachedNode::CommitCache(NFDXPage & tocache, long page)
 
   if(!NFDXCacheSize) return(0);
    
+  LockCache();
   InsertPoint = GetNFDXCacheEntryNo(page);
 
   #ifdef g_RunDebug
@@ -287,30 +305,28 @@ int FDWCachedNode::CommitCache(NFDXPage & tocache, long page)
   Trace.Printf("%tCommitCache - Insert page %u\n", InsertPoint);
   #endif
   
-  if(NFDXPageNo[InsertPoint]){
-    // The InsertPoint is currently occupied
-    if(NFDXPageNo[InsertPoint] == page){
-      // By the page we plan to insert
-      // It will now be dirty
-      SetNFDXBit(InsertPoint);
-    }
-    else{
-      // By some other page
-      // If it's dirty we need to put it to disk before we lose it
-      if(GetNFDXBit(InsertPoint)){
-        #ifdef g_RunDebug
-        Trace.Printf("%tCommitCache - Send cache page to secondary\n");
-        #endif
-        RawWritePage(NFDXCache[InsertPoint], NFDXPageNo[InsertPoint]);
-      }
-      // The new page we load will be clean
-      ClearNFDXBit(InsertPoint);
+  if(NFDXPageNo[InsertPoint] && (NFDXPageNo[InsertPoint] != page)){
+    // The InsertPoint is currently occupied by some other page
+    // If it's dirty we need to put it to disk before we lose it
+    if(GetNFDXBit(InsertPoint)){
+      #ifdef g_RunDebug
+      Trace.Printf("%tCommitCache - Send cache page to secondary\n");
+      #endif
+      RawWritePage(NFDXCache[InsertPoint], NFDXPageNo[InsertPoint]);
     }
   }
+
+  // A page just read from disk is clean, anything else is new data and
+  // dirty, wherever it lands in the cache
+  if(CacheFill) ClearNFDXBit(InsertPoint);
+  else SetNFDXBit(InsertPoint);
      
   memcpy(&(NFDXCache[InsertPoint]), &tocache, sizeof(NFDXPage));
   NFDXHitNo[InsertPoint] = Counter++;
   NFDXPageNo[InsertPoint] = page;
+  UnlockCache();
+
+  if(!CacheFill && !Behind && (Flags & WFDNodeWriteBehind)) StartFlusher();
   return(1);
 }
 
@@ -328,6 +344,7 @@ int FDWCachedNode::CheckCache(UFDXPage & tofill, long page)
   #ifdef g_RunDebug
   Trace.Printf("%tCheckCache - Page number %lu\n", page);
   #endif
+  LockCache();
   for(loop = 0; (loop < UFDXCacheSize) && !found; loop++){
    if(UFDXPageNo[loop] == page){
      #ifdef g_RunDebug
@@ -338,6 +355,7 @@ int FDWCachedNode::CheckCache(UFDXPage & tofill, long page)
      found = 1;
    }
   }
+  UnlockCache();
   return(found);
 }
 
@@ -351,6 +369,7 @@ int FDWCachedNode::CommitCache(UFDXPage & tocache, long page)
    
   if(!UFDXCacheSize) return(0);
 
+  LockCache();
   InsertPoint = GetUFDXCacheEntryNo(page);
 
   #ifdef g_RunDebug
@@ -358,30 +377,28 @@ int FDWCachedNode::CommitCache(UFDXPage & tocache, long page)
   Trace.Printf("%tCommitCache - Insert page %u\n", InsertPoint);
   #endif
   
-  if(UFDXPageNo[InsertPoint]){
-    // The InsertPoint is currently occupied
-    if(UFDXPageNo[InsertPoint] == page){
-      // By the page we plan to insert
-      // It will now be dirty
-      SetUFDXBit(InsertPoint);
-    }
-    else{
-      // By some other page
-      // If it's dirty we need to put it to disk before we lose it
-      if(GetUFDXBit(InsertPoint)){
-        #ifdef g_RunDebug
-        Trace.Printf("%tCommitCache - Send cache page to secondary\n");
-        #endif
-        RawWritePage(UFDXCache[InsertPoint], UFDXPageNo[InsertPoint]);
-      }
-      // The new page we load will be clean
-      ClearUFDXBit(InsertPoint);
+  if(UFDXPageNo[InsertPoint] && (UFDXPageNo[InsertPoint] != page)){
+    // The InsertPoint is currently occupied by some other page
+    // If it's dirty we need to put it to disk before we lose it
+    if(GetUFDXBit(InsertPoint)){
+      #ifdef g_RunDebug
+      Trace.Printf("%tCommitCache - Send cache page to secondary\n");
+      #endif
+      RawWritePage(UFDXCache[InsertPoint], UFDXPageNo[InsertPoint]);
     }
   }
 
+  // A page just read from disk is clean, anything else is new data and
+  // dirty, wherever it lands in the cache
+  if(CacheFill) ClearUFDXBit(InsertPoint);
+  else SetUFDXBit(InsertPoint);
+
   memcpy(&(UFDXCache[InsertPoint]), &tocache, sizeof(UFDXPage));
   UFDXHitNo[InsertPoint] = Counter++;
   UFDXPageNo[InsertPoint] = page;
+  UnlockCache();
+
+  if(!CacheFill && !Behind && (Flags & WFDNodeWriteBehind)) StartFlusher();
   return(1);
 }
 
@@ -517,6 +534,260 @@ void FDWCachedNode::SetCacheSize(unsigned int nfdxCacheSize, unsigned int ufdxCa
 }
 
 
+/*
+**    StartFlusher
+**
+** Starts the write behind thread, if the platform has threads. Called when
+** a page is made dirty with WFDNodeWriteBehind set, and the thread is not
+** already running. If the thread can't be started, the flag is cleared and
+** dirty pages are simply written when they are evicted, as before.
+**
+*/
+void FDWCachedNode::StartFlusher()
+{
+#if defined(WriteBehind) && defined(__NT__)
+  DWORD Id;
+
+  InitializeCriticalSection(&Guard);
+  InitializeCriticalSection(&FileGuard);
+  Wake = CreateEvent(NULL, TRUE, FALSE, NULL);
+  Stopping = 0;
+  Behind   = 1;
+  Flusher  = Wake ? CreateThread(NULL, 0, FlushThread, this, 0, &Id) : NULL;
+  if(!Flusher){
+    Behind = 0;
+    if(Wake) CloseHandle(Wake);
+    DeleteCriticalSection(&FileGuard);
+    DeleteCriticalSection(&Guard);
+    Flags &= ~WFDNodeWriteBehind;
+  }
+#elif defined(WriteBehind) && defined(__OS2__)
+  Stopping = 0;
+  Behind   = 1;
+  Wake     = 0;
+  if(DosCreateMutexSem(NULL, &Guard, 0, FALSE)){
+    Behind = 0;
+    Flags &= ~WFDNodeWriteBehind;
+    return;
+  }
+  if(DosCreateMutexSem(NULL, &FileGuard, 0, FALSE)){
+    Behind = 0;
+    DosCloseMutexSem(Guard);
+    Flags &= ~WFDNodeWriteBehind;
+    return;
+  }
+  if(DosCreateEventSem(NULL, &Wake, 0, FALSE) ||
+     DosCreateThread(&Flusher, FlushThread, (ULONG) this, 0, 65536UL)){
+    Behind = 0;
+    if(Wake) DosCloseEventSem(Wake);
+    DosCloseMutexSem(FileGuard);
+    DosCloseMutexSem(Guard);
+    Flags &= ~WFDNodeWriteBehind;
+  }
+#else
+  Flags &= ~WFDNodeWriteBehind;
+#endif
+}
+
+
+/*
+**    StopFlusher
+**
+** Stops the write behind thread, if it is running, and waits for it to
+** finish the page it is writing. Any pages still dirty are left for the
+** caller to write.
+**
+*/
+void FDWCachedNode::StopFlusher()
+{
+  if(!Behind) return;
+  Stopping = 1;
+#if defined(WriteBehind) && defined(__NT__)
+  SetEvent(Wake);
+  WaitForSingleObject(Flusher, INFINITE);
+  CloseHandle(Flusher);
+  CloseHandle(Wake);
+  Behind = 0;
+  DeleteCriticalSection(&FileGuard);
+  DeleteCriticalSection(&Guard);
+#elif defined(WriteBehind) && defined(__OS2__)
+  DosPostEventSem(Wake);
+  DosWaitThread(&Flusher, DCWW_WAIT);
+  DosCloseEventSem(Wake);
+  Behind = 0;
+  DosCloseMutexSem(FileGuard);
+  DosCloseMutexSem(Guard);
+#endif
+}
+
+
+/*
+**    LockFiles, UnlockFiles, LockCache, UnlockCache
+**
+** While the write behind thread is running, the cache and the index files
+** are each only touched by one thread at a time. LockFiles() and
+** UnlockFiles() override the virtual functions in the base class, which
+** takes them around its reads and writes. A thread wanting both takes the
+** cache first, as when a dirty page is evicted, so that the write behind
+** thread need only hold the cache while it copies a page, and not while
+** the page is written.
+**
+*/
+void FDWCachedNode::LockFiles()
+{
+#if defined(WriteBehind) && defined(__NT__)
+  if(Behind) EnterCriticalSection(&FileGuard);
+#elif defined(WriteBehind) && defined(__OS2__)
+  if(Behind) DosRequestMutexSem(FileGuard, SEM_INDEFINITE_WAIT);
+#endif
+}
+
+
+void FDWCachedNode::UnlockFiles()
+{
+#if defined(WriteBehind) && defined(__NT__)
+  if(Behind) LeaveCriticalSection(&FileGuard);
+#elif defined(WriteBehind) && defined(__OS2__)
+  if(Behind) DosReleaseMutexSem(FileGuard);
+#endif
+}
+
+
+void FDWCachedNode::LockCache()
+{
+#if defined(WriteBehind) && defined(__NT__)
+  if(Behind) EnterCriticalSection(&Guard);
+#elif defined(WriteBehind) && defined(__OS2__)
+  if(Behind) DosRequestMutexSem(Guard, SEM_INDEFINITE_WAIT);
+#endif
+}
+
+
+void FDWCachedNode::UnlockCache()
+{
+#if defined(WriteBehind) && defined(__NT__)
+  if(Behind) LeaveCriticalSection(&Guard);
+#elif defined(WriteBehind) && defined(__OS2__)
+  if(Behind) DosReleaseMutexSem(Guard);
+#endif
+}
+
+
+/*
+**    FlushThread, FlushBehind
+**
+** The write behind thread. Dirty pages are written back, least recently
+** used first, which is the order in which they would be evicted, until
+** there are none left which haven't been used recently. The thread then
+** waits a while before looking again, unless it is asked to stop.
+**
+*/
+#if defined(WriteBehind) && defined(__NT__)
+DWORD WINAPI FDWCachedNode::FlushThread(LPVOID Node)
+{
+  ((FDWCachedNode *) Node)->FlushBehind();
+  return(0);
+}
+#elif defined(WriteBehind) && defined(__OS2__)
+void APIENTRY FDWCachedNode::FlushThread(ULONG Node)
+{
+  ((FDWCachedNode *) Node)->FlushBehind();
+}
+#endif
+
+
+void FDWCachedNode::FlushBehind()
+{
+  int Written;
+
+  while(!Stopping){
+    do{
+      Written  = FlushNFDXPage();
+      Written |= FlushUFDXPage();
+    } while(Written && !Stopping);
+#if defined(WriteBehind) && defined(__NT__)
+    WaitForSingleObject(Wake, FLUSHDELAY);
+#elif defined(WriteBehind) && defined(__OS2__)
+    DosWaitEventSem(Wake, FLUSHDELAY);
+#endif
+  }
+}
+
+
+/*
+**    FlushNFDXPage
+**
+** Called by the write behind thread. Finds the dirty page which has gone
+** longest without use, and if it hasn't been used in the time it takes to
+** make half as many cache accesses as there are pages in the caches, writes
+** it back and marks it clean. A page still in use would only be made dirty
+** again.
+**
+** The page is copied and marked clean with the cache held, and the files
+** taken before the cache is let go, so that the page cannot be read back
+** from disk before it is written. The copy is then written with only the
+** files held, and the cache is free meanwhile.
+**
+**    Returns
+**
+**    1 if a page was written; 0 if there was none to write
+**
+*/
+int FDWCachedNode::FlushNFDXPage()
+{
+  NFDXPage Copy;
+  long PageNo;
+  unsigned int loop;
+  int Slot = -1;
+
+  LockCache();
+  for(loop = 0; loop < NFDXCacheSize; loop++){
+    if(NFDXPageNo[loop] && GetNFDXBit(loop) && ((Slot < 0) || (NFDXHitNo[loop] < NFDXHitNo[Slot]))) Slot = loop;
+  }
+  if((Slot < 0) || (Counter - NFDXHitNo[Slot] <= (NFDXCacheSize + UFDXCacheSize) / 2)){
+    UnlockCache();
+    return(0);
+  }
+  memcpy(&Copy, &(NFDXCache[Slot]), sizeof(NFDXPage));
+  PageNo = NFDXPageNo[Slot];
+  ClearNFDXBit(Slot);
+  LockFiles();
+  UnlockCache();
+  RawWritePage(Copy, PageNo);
+  UnlockFiles();
+  return(1);
+}
+
+
+/*
+**    See analogous function above for more details
+*/
+int FDWCachedNode::FlushUFDXPage()
+{
+  UFDXPage Copy;
+  long PageNo;
+  unsigned int loop;
+  int Slot = -1;
+
+  LockCache();
+  for(loop = 0; loop < UFDXCacheSize; loop++){
+    if(UFDXPageNo[loop] && GetUFDXBit(loop) && ((Slot < 0) || (UFDXHitNo[loop] < UFDXHitNo[Slot]))) Slot = loop;
+  }
+  if((Slot < 0) || (Counter - UFDXHitNo[Slot] <= (NFDXCacheSize + UFDXCacheSize) / 2)){
+    UnlockCache();
+    return(0);
+  }
+  memcpy(&Copy, &(UFDXCache[Slot]), sizeof(UFDXPage));
+  PageNo = UFDXPageNo[Slot];
+  ClearUFDXBit(Slot);
+  LockFiles();
+  UnlockCache();
+  RawWritePage(Copy, PageNo);
+  UnlockFiles();
+  return(1);
+}
+
+
 void  FDWCachedNode::SetNFDXBit(long bit)
 {
   NFDXDirtyMap[bit / 8] |= (char) (1 << (bit % 8));
@@ -38,6 +38,25 @@
 #include <g_log.h>
 #endif // g_RunDebug
 
+// Where the platform has threads, dirty pages may be written back by a
+// thread of their own (see WFDNodeWriteBehind), so that a page is seldom
+// still dirty by the time it is evicted.
+
+#if defined(__NT__)
+#define WriteBehind
+#include <windows.h>
+#elif defined(__OS2__)
+#define WriteBehind
+#define INCL_DOSPROCESS
+#define INCL_DOSSEMAPHORES
+#include <os2.h>
+#endif
+
+// How often, in milliseconds, the write behind thread looks for pages to
+// write, once it has written all it can
+
+#define FLUSHDELAY  50
+
 
 
 class FDWCachedNode;
@@ -65,6 +84,22 @@ class FDWCachedNode : public FrontDoorWNode{
 
     unsigned char * NFDXDirtyMap;
     unsigned char * UFDXDirtyMap;
+
+  #ifdef WriteBehind
+  #if defined(__NT__)
+    CRITICAL_SECTION Guard;       // Held over the cache while Behind is set
+    CRITICAL_SECTION FileGuard;   // Held over the index files while Behind is set
+    HANDLE        Flusher;        // The write behind thread
+    HANDLE        Wake;           // Set to stop it
+  #elif defined(__OS2__)
+    HMTX          Guard;
+    HMTX          FileGuard;
+    TID           Flusher;
+    HEV           Wake;
+  #endif
+  #endif
+    int           Behind;         // The write behind thread is running
+    volatile int  Stopping;       // And has been asked to stop
   
   // Services
 
@@ -83,6 +118,8 @@ class FDWCachedNode : public FrontDoorWNode{
 
                virtual void OnThaw();
                virtual void OnFreeze();
+    FDNPREF    virtual void FDNFUNC LockFiles();
+    FDNPREF    virtual void FDNFUNC UnlockFiles();
     FDNPREF    virtual int  FDNFUNC CheckCache(NFDXPage & tofill, long page);
     FDNPREF    virtual int  FDNFUNC CommitCache(NFDXPage & value, long page);
     FDNPREF    virtual int  FDNFUNC CheckCache(UFDXPage & tofill, long page);
@@ -104,6 +141,21 @@ class FDWCachedNode : public FrontDoorWNode{
 
                       void  ConfigureDefaults();
 
+                      void  StartFlusher();
+                      void  StopFlusher();
+                      void  LockCache();
+                      void  UnlockCache();
+                       int  FlushNFDXPage();
+                       int  FlushUFDXPage();
+                      void  FlushBehind();
+  #ifdef WriteBehind
+  #if defined(__NT__)
+    static     DWORD WINAPI FlushThread(LPVOID Node);
+  #elif defined(__OS2__)
+    static    void APIENTRY FlushThread(ULONG Node);
+  #endif
+  #endif
+
   public:
 
   FDNPREF void FDNFUNC SetCacheSize(unsigned int nfdxCacheSize, unsigned int ufdxCacheSize);
@@ -4,6 +4,11 @@
 // FrontDoor is a registered trademark of Joaquim Homrighausen
 
 #include "fdnode.h"
+#if defined(__BORLANDC__) || defined(__TURBOC__)
+#include <dir.h>
+#else
+#include <direct.h>
+#endif
                               
 /****************************************************************************/
 /*                                                                          */
@@ -114,6 +119,7 @@ FDNPREF int FDNFUNC FrontDoorWNode::Thaw()
   if(IsFrozen()){
     success = InitClass();
     if(success) OnThaw();
+    DropSums();
     return(success);
   }
   return(1);
@@ -124,11 +130,16 @@ FDNPREF int FDNFUNC FrontDoorWNode::Thaw()
 **    Freeze
 **
 ** Renders class inactive. Writes current Stub information
-** and closes relevant files.
+** and closes relevant files. An index set built with WFDNodePublish
+** is then published, and readers move over to it, provided that every
+** file was written and no error is outstanding. Otherwise the set is
+** dropped as by Discard(), and readers keep the one they have.
 **
 */
 FDNPREF void FDNFUNC FrontDoorWNode::Freeze()
 {
+  int success = 1;
+
   if(IsFrozen()) return;
 
   OnFreeze();
@@ -136,17 +147,37 @@ FDNPREF void FDNFUNC FrontDoorWNode::Freeze()
   WriteNFDXStub();
   WriteUFDXStub();
   WritePFDXStub();
+  if(Flags & WFDNodeChecksum) WriteSums();
 
-  NFDX.Close();
-  UFDX.Close();
-  PFDX.Close();
-  PFDA.Close();
+  // Files held in memory are only written out here
+  if(!NFDX.Close()) success = 0;
+  if(!UFDX.Close()) success = 0;
+  if(!PFDX.Close()) success = 0;
+  if(!PFDA.Close()) success = 0;
+  if(!success) SignalError(103);
+
+  if(*Generation && success && !error) Publish();
 
   Frozen = 1;
   return;
 }
 
 
+/*
+**    Discard
+**
+** Freezes the class without publishing the index set it was building
+** under WFDNodePublish, so that readers carry on with the set they have.
+** The same as Freeze() otherwise.
+**
+*/
+FDNPREF void FDNFUNC FrontDoorWNode::Discard()
+{
+  *Generation = 0;
+  Freeze();
+}
+
+
 
 /****************************************************************************/
 /*                                                                          */
@@ -170,9 +201,14 @@ FDNPREF void FDNFUNC FrontDoorWNode::Freeze()
 */
 FDNPREF void FDNFUNC FrontDoorWNode::Constructor(const char FDNDATA *nldir, const char FDNDATA *nlext, unsigned short cc, long flags)
 {
-  Frozen = 1;
+  Frozen    = 1;
+  error     = 0;
+  CacheFill = 0;
   strcpy(NodelistDir, nldir);
   AddTrail(NodelistDir);
+  strcpy(IndexDir, NodelistDir);
+  *Generation = 0;
+  PageSum[0] = PageSum[1] = PageSum[2] = NULL;
   Flags = flags;
   CountryCode = cc;
   if(strlen(nlext) != 3) *NodeExt=0;
@@ -196,8 +232,9 @@ FDNPREF void FDNFUNC FrontDoorWNode::Constructor(const char FDNDATA *nldir, cons
 */
 FDNPREF int FDNFUNC FrontDoorWNode::InitClass()
 {
-  int  FatalError = 0;
+  int  FatalError = 0, Last;
   char filename[PATHLENGTH];
+  char Current[13];
 
   if(!CountryCode || *NodeExt==0){
     // Insufficient Data
@@ -205,41 +242,67 @@ FDNPREF int FDNFUNC FrontDoorWNode::InitClass()
     return(0);
   }
 
-  strcpy(filename, NodelistDir);
+  // Examine our Nodelist Extent
+  if((!stricmp(NodeExt, "CUR")) && (Flags & WFDNodeOverWrite)){
+    // We can't use the "Current" extent when we're in overwrite mode!
+    SignalError(100);
+    Frozen = 1;
+    return(0);
+  }
+
+  // Find the index set. To publish a new one, work in the generation
+  // directory after the one in use, on a copy of the set in use if it is
+  // to be updated rather than overwritten.
+  strcpy(IndexDir, NodelistDir);
+  *Generation = 0;
+  ReadGeneration(Current);
+  if(Flags & WFDNodePublish){
+    // The generation is the last character of the directory name
+    Last = *Current ? Current[strlen(Current) - 1] - '0' : -1;
+    if(Last < 0 || Last >= GENERATIONS) Last = -1;
+    sprintf(Generation, "%s%d", GENERATIONDIR, (Last + 1) % GENERATIONS);
+    strcat(IndexDir, Generation);
+    mkdir(IndexDir);
+    AddTrail(IndexDir);
+    if(!(Flags & WFDNodeOverWrite) && !StageIndex(Current)){
+      SignalError(102);
+      *Generation = 0;
+      Frozen = 1;
+      return(0);
+    }
+  }
+  else if(*Current){
+    strcat(IndexDir, Current);
+    AddTrail(IndexDir);
+  }
+
+  strcpy(filename, IndexDir);
   strcat(filename, "NODELIST.FDX");
   NFDX.SetName(filename);
   
-  strcpy(filename, NodelistDir);
+  strcpy(filename, IndexDir);
   strcat(filename, "USERLIST.FDX");
   UFDX.SetName(filename);
 
-  strcpy(filename, NodelistDir);
+  strcpy(filename, IndexDir);
   strcat(filename, "PHONE.FDX");
   PFDX.SetName(filename);
 
-  strcpy(filename, NodelistDir);
+  strcpy(filename, IndexDir);
   strcat(filename, "PHONE.FDA");
   PFDA.SetName(filename);
 
-  // Examine our Nodelist Extent
-  if((!stricmp(NodeExt, "CUR")) && (Flags & WFDNodeOverWrite)){
-    // We can't use the "Current" extent when we're in overwrite mode!
-    SignalError(100);
-    Frozen = 1;
-    return(0);
-  }
-
   if(Flags & WFDNodeOverWrite){
-    NFDX.SetFlags(FDNFileDestroy);
-    UFDX.SetFlags(FDNFileDestroy);
-    PFDX.SetFlags(FDNFileDestroy);
-    PFDA.SetFlags(FDNFileDestroy);    
+    NFDX.SetFlags(FDNFileDestroy | FileMode());
+    UFDX.SetFlags(FDNFileDestroy | FileMode());
+    PFDX.SetFlags(FDNFileDestroy | FileMode());
+    PFDA.SetFlags(FDNFileDestroy | FileMode());    
   }
   else {
-    NFDX.SetFlags(FDNFileUpdate);
-    UFDX.SetFlags(FDNFileUpdate);
-    PFDX.SetFlags(FDNFileUpdate);
-    PFDA.SetFlags(FDNFileUpdate);    
+    NFDX.SetFlags(FDNFileUpdate | FileMode());
+    UFDX.SetFlags(FDNFileUpdate | FileMode());
+    PFDX.SetFlags(FDNFileUpdate | FileMode());
+    PFDA.SetFlags(FDNFileUpdate | FileMode());    
   }
 
   // Open our file objects
@@ -267,6 +330,8 @@ FDNPREF int FDNFUNC FrontDoorWNode::InitClass()
   memset(&PFirst, 0, sizeof(FirstPage));
 
   memset(&DefaultInfo, 0, sizeof(StubInfo));
+  NInfo.FreePage = UInfo.FreePage = PInfo.FreePage = 0;
+  memset(Segment, 0, sizeof(Segment));
 
   // Find the lengths of the files - Calculate the Info block details
   PFDARecords = (PFDA.Size() / (long) sizeof(FDNPhoneRec) - 1L);
@@ -323,6 +388,13 @@ FDNPREF int FDNFUNC FrontDoorWNode::InitClass()
     }
   }
 
+  // The sums of the set as it stands let OnThaw() keep cached pages; the
+  // set is about to change, so they must not outlive this thaw
+  if(!(Flags & WFDNodeOverWrite)) ReadSums();
+  strcpy(filename, IndexDir);
+  strcat(filename, SUMFILE);
+  remove(filename);
+
   // Load in root pages - so that we can use ReadPage, we zero the records
   if(NFirst.index) RawReadPage(NRoot, NFirst.index);
   if(UFirst.index) RawReadPage(URoot, UFirst.index);
@@ -708,6 +780,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(NFDXRecord & NData)
   }
   if(GetInsertPoint(NData)){
     if(InsertPoint.Status && !(NInfo.Flags & WFDNodeUseDupes)) return(0); // Duplicate, simply kill
+    if(!InsertPoint.Status) NoteInsertPoint(NInfo);
     success = AddRecord(NData, 0, 0);
     if(success) NInfo.Records++;
     return(success);
@@ -728,6 +801,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(UFDXRecord & UData)
   }
   if(GetInsertPoint(UData)){
     if(InsertPoint.Status && !(UInfo.Flags & WFDNodeUseDupes)) return(0); // Duplicate, simply kill
+    if(!InsertPoint.Status) NoteInsertPoint(UInfo);
     success = AddRecord(UData, 0, 0);
     if(success) UInfo.Records++;
     return(success);
@@ -751,6 +825,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(PFDXRecord & PData)
   }
   if(GetInsertPoint(PData)){
     if(InsertPoint.Status && !(PInfo.Flags & WFDNodeUseDupes)) return(0); // Duplicate, simply kill
+    if(!InsertPoint.Status) NoteInsertPoint(PInfo);
     success = AddRecord(PData, 0, 0);
     if(success) PInfo.Records++;
     return(success);
@@ -759,6 +834,324 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(PFDXRecord & PData)
 }
 
 
+/*
+**    AddRecords
+**
+** Adds a batch of fully formed records into an existing tree, as a call
+** of AddRecord() above for each would, but faster. The batch is sorted
+** first, so that all the records which fall in one leaf are added to it
+** together, with one descent from the root rather than one per record.
+** Records with the same key are taken in the order given. The array
+** itself is not reordered, but a record which causes a page to split
+** may be overwritten, as with AddRecord().
+**
+**    Parameters
+**
+**    NData     The records to add. The link fields are ignored.
+**    Count     The number of records in NData
+**    Report    Filled with the number of records added, replaced, and
+**              dropped as duplicates
+**
+**    Returns
+**
+**    0 on failure; 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::AddRecords(NFDXRecord * NData, long Count, FDWNBatchReport & Report)
+{
+  return(AddBatch(NFDXIndex, (char *) NData, Count, Report));
+}
+
+
+/*
+** See overloaded variant above for details.
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::AddRecords(UFDXRecord * UData, long Count, FDWNBatchReport & Report)
+{
+  return(AddBatch(UFDXIndex, (char *) UData, Count, Report));
+}
+
+
+/*
+** See overloaded variant above for details.
+**
+** Note that this function does NOT handle PHONE.FDA at ALL.
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::AddRecords(PFDXRecord * PData, long Count, FDWNBatchReport & Report)
+{
+  return(AddBatch(PFDXIndex, (char *) PData, Count, Report));
+}
+
+
+/*
+**    UpdateRecord
+**
+** Replaces a record already in the index with new data, in place, keeping
+** its position in the tree. The key must match exactly; for NODELIST.FDX
+** that is the address, routing and status, so in practice this alters the
+** offset. Anything that changes the key is a DeleteRecord() followed by an
+** AddRecord().
+**
+**    Returns
+**
+**    0 on failure (including no record with this key)
+**    2 on success (key replaced)
+**
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::UpdateRecord(NFDXRecord & NData)
+{
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  if(!GetInsertPoint(NData) || !InsertPoint.Status) return(0);
+  return(AddRecord(NData, 0, 0));
+}
+
+
+/*
+** See overloaded variant above for details.
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::UpdateRecord(UFDXRecord & UData)
+{
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  if(!GetInsertPoint(UData) || !InsertPoint.Status) return(0);
+  return(AddRecord(UData, 0, 0));
+}
+
+
+/*
+** See overloaded variant above for details.
+**
+** Note that this function does NOT handle PHONE.FDA at ALL.
+**
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::UpdateRecord(PFDXRecord & PData)
+{
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  if(!GetInsertPoint(PData) || !InsertPoint.Status) return(0);
+  return(AddRecord(PData, 0, 0));
+}
+
+
+/*
+**    DeleteRecord
+**
+** A set of functions for removing fully formed records from existing
+** trees. The key must match exactly, see GetRecord() for finding the
+** NODELIST.FDX record for an address. Pages left too empty are merged
+** with, or borrow from, their neighbours, and pages no longer needed are
+** kept for reuse by later additions.
+**
+**    Parameters
+**
+**    The record to delete; on success it is overwritten with the record
+**    that was removed from the index.
+**
+**    Returns
+**
+**    0 on failure (including no record with this key)
+**    1 on success
+**
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::DeleteRecord(NFDXRecord & NData)
+{
+  int success;
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  success = DeleteFromTree(NFDXIndex, (char *) &NData);
+  if(success) NInfo.Records--;
+  return(success);
+}
+
+
+/*
+** See overloaded variant above for details.
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::DeleteRecord(UFDXRecord & UData)
+{
+  int success;
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  success = DeleteFromTree(UFDXIndex, (char *) &UData);
+  if(success) UInfo.Records--;
+  return(success);
+}
+
+
+/*
+** See overloaded variant above for details.
+**
+** Note that this function does NOT handle PHONE.FDA at ALL.
+**
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::DeleteRecord(PFDXRecord & PData)
+{
+  int success;
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  success = DeleteFromTree(PFDXIndex, (char *) &PData);
+  if(success) PInfo.Records--;
+  return(success);
+}
+
+
+/*
+**    DeleteRecord (USERLIST.FDX variant)
+**
+** Removes a SysOp name entry. The parameters are as for the equivalent
+** AddRecord() function.
+**
+**    Returns
+**
+**    0 on failure (including no such entry)
+**    1 on success
+**
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::DeleteRecord(unsigned short Zone, unsigned short Net, unsigned short Node, unsigned short Point, const char * UserName)
+{
+  UFDXRecord OldData;
+
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  CreateRecord(OldData, Zone, Net, Node, Point, UserName, 0, 0, 0);
+  return(DeleteRecord(OldData));
+}
+
+
+/*
+**    DeleteRecord (PHONE.FDX variant)
+**
+** Removes a dial translation or cost entry, and marks its record in
+** PHONE.FDA as erased.
+**
+**    Parameters
+**
+**    ToMatch   The string as it was passed to AddRecord()
+**
+**    Returns
+**
+**    0 on failure (including no such entry)
+**    1 on success
+**
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::DeleteRecord(const char * ToMatch)
+{
+  PFDXRecord OldData;
+  FDNPhoneRec PFDAData;
+
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  if(strlen(ToMatch) > 20){
+    SignalError(101);
+    return(0);
+  }
+  memset(&OldData, 0, sizeof(PFDXRecord));
+  OldData.key[0] = (char) strlen(ToMatch);
+  strncpy(OldData.key + 1, ToMatch, 19);
+  if(!DeleteRecord(OldData)) return(0);
+
+  // Mark the data record erased, and leave PHONE.FDA positioned for appending
+  if(PFDA.Seek(OldData.offset * sizeof(FDNPhoneRec), SEEK_SET) && PFDA.Read(&PFDAData, sizeof(FDNPhoneRec), 1, 1)){
+    PFDAData.Erased = 1;
+    PFDA.Seek(OldData.offset * sizeof(FDNPhoneRec), SEEK_SET);
+    PFDA.Write(&PFDAData, sizeof(FDNPhoneRec), 1, 1);
+  }
+  PFDA.Seek(0, SEEK_END);
+  return(1);
+}
+
+
+/*
+**    GetRecord
+**
+** Finds the NODELIST.FDX record for an address, whatever its routing and
+** status, so that it may be passed to UpdateRecord() or DeleteRecord().
+**
+**    Parameters
+**
+**    NData     The zone, net, node and point fields (as set by CreateRecord())
+**              give the address to find. Filled with the record if found.
+**    Whence    One of WFDNOfficial, WFDNPrivate, WFDNPoint or WFDNInternal
+**              to find only a record from that source, or -1 for any.
+**
+**    Returns
+**
+**    0 if there is no such record
+**    1 if the record was found
+**
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::GetRecord(NFDXRecord & NData, long int Whence)
+{
+  NFDXRecord Search;
+  NFDXRecord Found;
+  int Strict = 0;
+
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+
+  // The lowest possible key for the address
+  memcpy(&Search, &NData, sizeof(NFDXRecord));
+  Search.key[0]   = 14;
+  Search.rnet     = 0;
+  Search.rnode    = 0;
+  Search.nodetype = 0;
+  if(!GetInsertPoint(Search)) return(0);
+
+  while(GetSuccessor(NFDXIndex, (char *) &Found, Strict)){
+    if((Found.zone != NData.zone) || (Found.net != NData.net) || (Found.node != NData.node) || (Found.point != NData.point)) return(0);
+    if((Whence == -1) || ((Found.offset.loff & 0xFF000000UL) == (unsigned long) Whence)){
+      memcpy(&NData, &Found, sizeof(NFDXRecord));
+      return(1);
+    }
+    // Same address, different source, move past it
+    if(!GetInsertPoint(Found)) return(0);
+    Strict = 1;
+  }
+  return(0);
+}
+
+
+/*
+** See overloaded variant above for details. The USERLIST.FDX key is the
+** name and address, so UData (as set by CreateRecord()) must match the
+** record exactly, and only its source is checked.
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::GetRecord(UFDXRecord & UData, long int Whence)
+{
+  UFDXRecord Found;
+
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  if(!GetInsertPoint(UData) || !InsertPoint.Status) return(0);
+  if(!GetSuccessor(UFDXIndex, (char *) &Found, 0)) return(0);
+  if((Whence != -1) && ((Found.offset & 0xFF000000UL) != (unsigned long) Whence)) return(0);
+  memcpy(&UData, &Found, sizeof(UFDXRecord));
+  return(1);
+}
+
+
 /****************************************************************************/
 /*                                                                          */
 /*                  P R I V A T E   F U N C T I O N S                       */
@@ -980,6 +1373,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(NFDXRecord & NData, long LeftChil
 {
   int loop;
   int InsertRoom;
+  long NewPage = 0;
   int InsertRecord = InsertPoint.Record[InsertPoint.Level - 1];
 
   if(!(InsertPoint.Level)){    
@@ -993,9 +1387,9 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(NFDXRecord & NData, long LeftChil
     New.records        = 1;
 
     // Write and cache new root, and update first page data
-    WritePage(New, ++NInfo.Pages);
+    NFirst.index = AllocPage(NFDXIndex);
+    WritePage(New, NFirst.index);
     memcpy(&NRoot, &New, sizeof(NFDXPage));
-    NFirst.index = NInfo.Pages;
     NInfo.Level++;
 
     return(1);
@@ -1013,8 +1407,11 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(NFDXRecord & NData, long LeftChil
   
     if(InsertRoom > 0 || InsertPoint.Status){
       if(InsertPoint.Status){
-        // We have a duplicate, and we should be in KillDupe mode if we got this far
+        // We have a duplicate, replace it in place but keep its link
+        NData.link = Original.nodes[InsertRecord].link;
         memcpy(&(Original.nodes[InsertRecord]), &NData, sizeof(NData));
+        WritePage(Original, InsertPoint.Page[InsertPoint.Level-1]);
+        if(InsertPoint.Page[InsertPoint.Level-1] == NFirst.index) memcpy(&NRoot, &Original, sizeof(NFDXPage));
       }
       else{
         // This page has room for the insertion - make the gap.
@@ -1034,62 +1431,64 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(NFDXRecord & NData, long LeftChil
         if(InsertPoint.Page[InsertPoint.Level-1] == NFirst.index) memcpy(&NRoot, &Original, sizeof(NFDXPage));
       }
     }
-    if(InsertRoom == 0){
+    if((InsertRoom == 0) && !InsertPoint.Status){
       // This page has no room for the insertion
       NFDXPage New;
+      int Promote = GetSplitPoint(NInfo, InsertRecord);
+      NewPage = AllocPage(NFDXIndex);
   
-      // Copy the last 32/2 elements into the new page and remove from original, then write
-      if(InsertRecord < NInfo.PromoteRecord){
-        for(loop = NInfo.PromoteRecord; loop < 32; loop++) memcpy(&(New.nodes[loop - NInfo.PromoteRecord]), &(Original.nodes[loop]), sizeof(NFDXRecord));
-        for(loop = NInfo.PromoteRecord - 1; loop >= InsertRecord; loop--) memcpy(&(Original.nodes[loop+1]), &(Original.nodes[loop]), sizeof(NFDXRecord));
+      // Split around the promotion point chosen for this insertion, then write
+      if(InsertRecord < Promote){
+        for(loop = Promote; loop < 32; loop++) memcpy(&(New.nodes[loop - Promote]), &(Original.nodes[loop]), sizeof(NFDXRecord));
+        for(loop = Promote - 1; loop >= InsertRecord; loop--) memcpy(&(Original.nodes[loop+1]), &(Original.nodes[loop]), sizeof(NFDXRecord));
         memcpy(&(Original.nodes[InsertRecord]), &NData, sizeof(NFDXRecord));
   
-        // copy element (NInfo.PromoteRecord) (in Original) into NData (getting promoted)
-        memcpy(&NData, &(Original.nodes[NInfo.PromoteRecord]), sizeof(NFDXRecord));
+        // copy element (Promote) (in Original) into NData (getting promoted)
+        memcpy(&NData, &(Original.nodes[Promote]), sizeof(NFDXRecord));
         
         // Fix linking
         New.backref = NData.link;
-        NData.link   = NInfo.Pages + 1; // Ignored?
+        NData.link   = NewPage; // Ignored?
         Original.nodes[InsertRecord].link  = RightChild;
         if(!InsertRecord) Original.backref = LeftChild;
       }
       
-      if(InsertRecord == NInfo.PromoteRecord){
-        for(loop = NInfo.PromoteRecord; loop < 32; loop++) memcpy(&(New.nodes[loop - NInfo.PromoteRecord]), &(Original.nodes[loop]), sizeof(NData));
+      if(InsertRecord == Promote){
+        for(loop = Promote; loop < 32; loop++) memcpy(&(New.nodes[loop - Promote]), &(Original.nodes[loop]), sizeof(NData));
         New.backref = RightChild;
       }
       
-      if(InsertRecord > NInfo.PromoteRecord){
-        for(loop = InsertRecord; loop < 32; loop++) memcpy(&(New.nodes[loop-NInfo.PromoteRecord]), &(Original.nodes[loop]), sizeof(NFDXRecord));
-        for(loop = NInfo.PromoteRecord + 1; loop < InsertRecord; loop++) memcpy(&(New.nodes[loop-NInfo.PromoteRecord-1]), &(Original.nodes[loop]), sizeof(NFDXRecord));
-        memcpy(&(New.nodes[InsertRecord-NInfo.PromoteRecord-1]), &NData, sizeof(NFDXRecord));
+      if(InsertRecord > Promote){
+        for(loop = InsertRecord; loop < 32; loop++) memcpy(&(New.nodes[loop-Promote]), &(Original.nodes[loop]), sizeof(NFDXRecord));
+        for(loop = Promote + 1; loop < InsertRecord; loop++) memcpy(&(New.nodes[loop-Promote-1]), &(Original.nodes[loop]), sizeof(NFDXRecord));
+        memcpy(&(New.nodes[InsertRecord-Promote-1]), &NData, sizeof(NFDXRecord));
   
-        // copy element NInfo.PromoteRecord (in Original) into PData (getting promoted)
-        memcpy(&NData, &(Original.nodes[NInfo.PromoteRecord]), sizeof(NFDXRecord));
+        // copy element Promote (in Original) into PData (getting promoted)
+        memcpy(&NData, &(Original.nodes[Promote]), sizeof(NFDXRecord));
   
         // Fix linking
         New.backref = NData.link;
-        NData.link   = NInfo.Pages + 1; // Ignored?
-        New.nodes[InsertRecord - NInfo.PromoteRecord - 1].link    = RightChild;
-        if(!(InsertRecord - NInfo.PromoteRecord - 1)) New.backref = LeftChild;
+        NData.link   = NewPage; // Ignored?
+        New.nodes[InsertRecord - Promote - 1].link    = RightChild;
+        if(!(InsertRecord - Promote - 1)) New.backref = LeftChild;
         
       }
   
-      Original.records = NInfo.PromoteRecord;
-      New.records = (char) (32 - NInfo.PromoteRecord);
+      Original.records = Promote;
+      New.records = (char) (32 - Promote);
       
       WritePage(Original, InsertPoint.Page[InsertPoint.Level - 1]);
-      WritePage(New, ++NInfo.Pages);
+      WritePage(New, NewPage);
       
   
       // Add the middle element to the level above, with references to these pages
       InsertPoint.Level--;
-      //return(AddRecord(NData, InsertPoint.Page[InsertPoint.Level], NInfo.Pages));
+      //return(AddRecord(NData, InsertPoint.Page[InsertPoint.Level], NewPage));
     }
   }
   if(InsertPoint.Status) return(2);
   if(InsertRoom > 0 )    return(1);
-  if(InsertRoom == 0)    return(AddRecord(NData, InsertPoint.Page[InsertPoint.Level], NInfo.Pages));
+  if(InsertRoom == 0)    return(AddRecord(NData, InsertPoint.Page[InsertPoint.Level], NewPage));
   // Therefore InsertRoom < 0 which tell us we have an invalid index page
   SignalError(32);
   return(0);
@@ -1103,6 +1502,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(UFDXRecord & UData, long LeftChil
 {
   int loop;
   int InsertRoom;
+  long NewPage = 0;
   int InsertRecord = InsertPoint.Record[InsertPoint.Level - 1];
   
   if(!(InsertPoint.Level)){    
@@ -1116,9 +1516,9 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(UFDXRecord & UData, long LeftChil
     New.records        = 1;
 
     // Write and cache new root, and update first page data
-    WritePage(New, ++UInfo.Pages);
+    UFirst.index = AllocPage(UFDXIndex);
+    WritePage(New, UFirst.index);
     memcpy(&URoot, &New, sizeof(UFDXPage));
-    UFirst.index = UInfo.Pages;
     UInfo.Level++;
 
     return(1);
@@ -1136,8 +1536,11 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(UFDXRecord & UData, long LeftChil
   
     if(InsertRoom > 0 || InsertPoint.Status){
       if(InsertPoint.Status){
-        // We have a duplicate, and we should be in KillDupe mode if we got this far
+        // We have a duplicate, replace it in place but keep its link
+        UData.link = Original.names[InsertRecord].link;
         memcpy(&(Original.names[InsertRecord]), &UData, sizeof(UData));
+        WritePage(Original, InsertPoint.Page[InsertPoint.Level-1]);
+        if(InsertPoint.Page[InsertPoint.Level-1] == UFirst.index) memcpy(&URoot, &Original, sizeof(UFDXPage));
       }
       else{
         // This page has room for the insertion - make the gap.
@@ -1157,62 +1560,64 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(UFDXRecord & UData, long LeftChil
         if(InsertPoint.Page[InsertPoint.Level-1] == UFirst.index) memcpy(&URoot, &Original, sizeof(UFDXPage));
       }
     }
-    if(InsertRoom == 0){
+    if((InsertRoom == 0) && !InsertPoint.Status){
       // This page has no room for the insertion
       UFDXPage New;
+      int Promote = GetSplitPoint(UInfo, InsertRecord);
+      NewPage = AllocPage(UFDXIndex);
   
-      // Copy the last 32/2 elements into the new page and remove from original, then write
-      if(InsertRecord < UInfo.PromoteRecord){
-        for(loop = UInfo.PromoteRecord; loop < 32; loop++) memcpy(&(New.names[loop - UInfo.PromoteRecord]), &(Original.names[loop]), sizeof(UFDXRecord));
-        for(loop = UInfo.PromoteRecord - 1; loop >= InsertRecord; loop--) memcpy(&(Original.names[loop+1]), &(Original.names[loop]), sizeof(UFDXRecord));
+      // Split around the promotion point chosen for this insertion, then write
+      if(InsertRecord < Promote){
+        for(loop = Promote; loop < 32; loop++) memcpy(&(New.names[loop - Promote]), &(Original.names[loop]), sizeof(UFDXRecord));
+        for(loop = Promote - 1; loop >= InsertRecord; loop--) memcpy(&(Original.names[loop+1]), &(Original.names[loop]), sizeof(UFDXRecord));
         memcpy(&(Original.names[InsertRecord]), &UData, sizeof(UFDXRecord));
   
-        // copy element (UInfo.PromoteRecord) (in Original) into UData (getting promoted)
-        memcpy(&UData, &(Original.names[UInfo.PromoteRecord]), sizeof(UFDXRecord));
+        // copy element (Promote) (in Original) into UData (getting promoted)
+        memcpy(&UData, &(Original.names[Promote]), sizeof(UFDXRecord));
         
         // Fix linking
         New.backref = UData.link;
-        UData.link   = UInfo.Pages + 1; // Ignored?
+        UData.link   = NewPage; // Ignored?
         Original.names[InsertRecord].link  = RightChild;
         if(!InsertRecord) Original.backref = LeftChild;
       }
       
-      if(InsertRecord == UInfo.PromoteRecord){
-        for(loop = UInfo.PromoteRecord; loop < 32; loop++) memcpy(&(New.names[loop - UInfo.PromoteRecord]), &(Original.names[loop]), sizeof(UData));
+      if(InsertRecord == Promote){
+        for(loop = Promote; loop < 32; loop++) memcpy(&(New.names[loop - Promote]), &(Original.names[loop]), sizeof(UData));
         New.backref = RightChild;
       }
       
-      if(InsertRecord > UInfo.PromoteRecord){
-        for(loop = InsertRecord; loop < 32; loop++) memcpy(&(New.names[loop-UInfo.PromoteRecord]), &(Original.names[loop]), sizeof(UFDXRecord));
-        for(loop = UInfo.PromoteRecord + 1; loop < InsertRecord; loop++) memcpy(&(New.names[loop-UInfo.PromoteRecord-1]), &(Original.names[loop]), sizeof(UFDXRecord));
-        memcpy(&(New.names[InsertRecord-UInfo.PromoteRecord-1]), &UData, sizeof(UFDXRecord));
+      if(InsertRecord > Promote){
+        for(loop = InsertRecord; loop < 32; loop++) memcpy(&(New.names[loop-Promote]), &(Original.names[loop]), sizeof(UFDXRecord));
+        for(loop = Promote + 1; loop < InsertRecord; loop++) memcpy(&(New.names[loop-Promote-1]), &(Original.names[loop]), sizeof(UFDXRecord));
+        memcpy(&(New.names[InsertRecord-Promote-1]), &UData, sizeof(UFDXRecord));
   
-        // copy element UInfo.PromoteRecord (in Original) into PData (getting promoted)
-        memcpy(&UData, &(Original.names[UInfo.PromoteRecord]), sizeof(UFDXRecord));
+        // copy element Promote (in Original) into PData (getting promoted)
+        memcpy(&UData, &(Original.names[Promote]), sizeof(UFDXRecord));
   
         // Fix linking
         New.backref = UData.link;
-        UData.link   = UInfo.Pages + 1; // Ignored?
-        New.names[InsertRecord - UInfo.PromoteRecord - 1].link    = RightChild;
-        if(!(InsertRecord - UInfo.PromoteRecord - 1)) New.backref = LeftChild;
+        UData.link   = NewPage; // Ignored?
+        New.names[InsertRecord - Promote - 1].link    = RightChild;
+        if(!(InsertRecord - Promote - 1)) New.backref = LeftChild;
         
       }
   
-      Original.records = UInfo.PromoteRecord;
-      New.records = (char) (32 - UInfo.PromoteRecord);
+      Original.records = Promote;
+      New.records = (char) (32 - Promote);
       
       WritePage(Original, InsertPoint.Page[InsertPoint.Level - 1]);
-      WritePage(New, ++UInfo.Pages);
+      WritePage(New, NewPage);
       
   
       // Add the middle element to the level above, with references to these pages
       InsertPoint.Level--;
-      //return(AddRecord(UData, InsertPoint.Page[InsertPoint.Level], UInfo.Pages));
+      //return(AddRecord(UData, InsertPoint.Page[InsertPoint.Level], NewPage));
     }
   }
   if(InsertPoint.Status) return(2);
   if(InsertRoom > 0 )    return(1);
-  if(InsertRoom == 0)    return(AddRecord(UData, InsertPoint.Page[InsertPoint.Level], UInfo.Pages));
+  if(InsertRoom == 0)    return(AddRecord(UData, InsertPoint.Page[InsertPoint.Level], NewPage));
   // Therefore InsertRoom < 0 which tell us we have an invalid index page
   SignalError(32);
   return(0);
@@ -1226,6 +1631,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(PFDXRecord & PData, long LeftChil
 {
   int loop;
   int InsertRoom;
+  long NewPage = 0;
   int InsertRecord = InsertPoint.Record[InsertPoint.Level - 1];
 
   if(!(InsertPoint.Level)){    
@@ -1239,9 +1645,9 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(PFDXRecord & PData, long LeftChil
     New.records         = 1;
 
     // Write and cache new root, and update first page data
-    WritePage(New, ++PInfo.Pages);
+    PFirst.index = AllocPage(PFDXIndex);
+    WritePage(New, PFirst.index);
     memcpy(&PRoot, &New, sizeof(PFDXPage));
-    PFirst.index = PInfo.Pages;
     PInfo.Level++;
 
     return(1);
@@ -1259,8 +1665,11 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(PFDXRecord & PData, long LeftChil
   
     if(InsertRoom > 0 || InsertPoint.Status){
       if(InsertPoint.Status){
-        // We have a duplicate, and we should be in KillDupe mode if we got this far
+        // We have a duplicate, replace it in place but keep its link
+        PData.link = Original.phones[InsertRecord].link;
         memcpy(&(Original.phones[InsertRecord]), &PData, sizeof(PData));
+        WritePage(Original, InsertPoint.Page[InsertPoint.Level-1]);
+        if(InsertPoint.Page[InsertPoint.Level-1] == PFirst.index) memcpy(&PRoot, &Original, sizeof(PFDXPage));
       }
       else{
         // This page has room for the insertion - make the gap.
@@ -1280,62 +1689,64 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(PFDXRecord & PData, long LeftChil
         if(InsertPoint.Page[InsertPoint.Level-1] == PFirst.index) memcpy(&PRoot, &Original, sizeof(PFDXPage));
       }
     }
-    if(InsertRoom == 0){
+    if((InsertRoom == 0) && !InsertPoint.Status){
       // This page has no room for the insertion
       PFDXPage New;
+      int Promote = GetSplitPoint(PInfo, InsertRecord);
+      NewPage = AllocPage(PFDXIndex);
   
-      // Copy the last 32/2 elements into the new page and remove from original, then write
-      if(InsertRecord < PInfo.PromoteRecord){
-        for(loop = PInfo.PromoteRecord; loop < 32; loop++) memcpy(&(New.phones[loop - PInfo.PromoteRecord]), &(Original.phones[loop]), sizeof(PFDXRecord));
-        for(loop = PInfo.PromoteRecord - 1; loop >= InsertRecord; loop--) memcpy(&(Original.phones[loop+1]), &(Original.phones[loop]), sizeof(PFDXRecord));
+      // Split around the promotion point chosen for this insertion, then write
+      if(InsertRecord < Promote){
+        for(loop = Promote; loop < 32; loop++) memcpy(&(New.phones[loop - Promote]), &(Original.phones[loop]), sizeof(PFDXRecord));
+        for(loop = Promote - 1; loop >= InsertRecord; loop--) memcpy(&(Original.phones[loop+1]), &(Original.phones[loop]), sizeof(PFDXRecord));
         memcpy(&(Original.phones[InsertRecord]), &PData, sizeof(PFDXRecord));
   
-        // copy element (PInfo.PromoteRecord) (in Original) into PData (getting promoted)
-        memcpy(&PData, &(Original.phones[PInfo.PromoteRecord]), sizeof(PFDXRecord));
+        // copy element (Promote) (in Original) into PData (getting promoted)
+        memcpy(&PData, &(Original.phones[Promote]), sizeof(PFDXRecord));
         
         // Fix linking
         New.backref = PData.link;
-        PData.link   = PInfo.Pages + 1; // Ignored?
+        PData.link   = NewPage; // Ignored?
         Original.phones[InsertRecord].link  = RightChild;
         if(!InsertRecord) Original.backref = LeftChild;
       }
       
-      if(InsertRecord == PInfo.PromoteRecord){
-        for(loop = PInfo.PromoteRecord; loop < 32; loop++) memcpy(&(New.phones[loop - PInfo.PromoteRecord]), &(Original.phones[loop]), sizeof(PData));
+      if(InsertRecord == Promote){
+        for(loop = Promote; loop < 32; loop++) memcpy(&(New.phones[loop - Promote]), &(Original.phones[loop]), sizeof(PData));
         New.backref = RightChild;
       }
       
-      if(InsertRecord > PInfo.PromoteRecord){
-        for(loop = InsertRecord; loop < 32; loop++) memcpy(&(New.phones[loop-PInfo.PromoteRecord]), &(Original.phones[loop]), sizeof(PFDXRecord));
-        for(loop = PInfo.PromoteRecord + 1; loop < InsertRecord; loop++) memcpy(&(New.phones[loop-PInfo.PromoteRecord-1]), &(Original.phones[loop]), sizeof(PFDXRecord));
-        memcpy(&(New.phones[InsertRecord-PInfo.PromoteRecord-1]), &PData, sizeof(PFDXRecord));
+      if(InsertRecord > Promote){
+        for(loop = InsertRecord; loop < 32; loop++) memcpy(&(New.phones[loop-Promote]), &(Original.phones[loop]), sizeof(PFDXRecord));
+        for(loop = Promote + 1; loop < InsertRecord; loop++) memcpy(&(New.phones[loop-Promote-1]), &(Original.phones[loop]), sizeof(PFDXRecord));
+        memcpy(&(New.phones[InsertRecord-Promote-1]), &PData, sizeof(PFDXRecord));
   
-        // copy element PInfo.PromoteRecord (in Original) into PData (getting promoted)
-        memcpy(&PData, &(Original.phones[PInfo.PromoteRecord]), sizeof(PFDXRecord));
+        // copy element Promote (in Original) into PData (getting promoted)
+        memcpy(&PData, &(Original.phones[Promote]), sizeof(PFDXRecord));
   
         // Fix linking
         New.backref = PData.link;
-        PData.link   = PInfo.Pages + 1; // Ignored?
-        New.phones[InsertRecord - PInfo.PromoteRecord - 1].link    = RightChild;
-        if(!(InsertRecord - PInfo.PromoteRecord - 1)) New.backref = LeftChild;
+        PData.link   = NewPage; // Ignored?
+        New.phones[InsertRecord - Promote - 1].link    = RightChild;
+        if(!(InsertRecord - Promote - 1)) New.backref = LeftChild;
         
       }
   
-      Original.records = PInfo.PromoteRecord;
-      New.records = (char) (32 - PInfo.PromoteRecord);
+      Original.records = Promote;
+      New.records = (char) (32 - Promote);
       
       WritePage(Original, InsertPoint.Page[InsertPoint.Level - 1]);
-      WritePage(New, ++PInfo.Pages);
+      WritePage(New, NewPage);
       
   
       // Add the middle element to the level above, with references to these pages
       InsertPoint.Level--;
-      //return(AddRecord(PData, InsertPoint.Page[InsertPoint.Level], PInfo.Pages));
+      //return(AddRecord(PData, InsertPoint.Page[InsertPoint.Level], NewPage));
     }
   }
   if(InsertPoint.Status) return(2);
   if(InsertRoom > 0 )    return(1);
-  if(InsertRoom == 0)    return(AddRecord(PData, InsertPoint.Page[InsertPoint.Level], PInfo.Pages));
+  if(InsertRoom == 0)    return(AddRecord(PData, InsertPoint.Page[InsertPoint.Level], NewPage));
   // Therefore InsertRoom < 0 which tell us we have an invalid index page
   SignalError(32);
   return(0);
@@ -1343,19 +1754,994 @@ FDNPREF int  FDNFUNC FrontDoorWNode::AddRecord(PFDXRecord & PData, long LeftChil
 
 
 /*
-**    RawReadPage
-**
-** A set of functions to read pages from the various index files. This function
-** doesn't attempt to be fancy, examine the mini-cache system or virtual cache
-** system. It just fetches the page from secondary storage (and thus is used by
-** the above mechanisms).
-**
-**    Parameters
+**    NoteInsertPoint
 **
-**    Page    Object to copy page data to
-**    PageNo  The page number to read
+** Records where in its leaf the last insertion point fell, so that
+** GetSplitPoint() can tell sorted input from random input. Call this
+** after GetInsertPoint() and before the private AddRecord().
 **
-**    Returns
+*/
+FDNPREF void FDNFUNC FrontDoorWNode::NoteInsertPoint(FDWNTreeInfo & Info)
+{
+  int Leaf = InsertPoint.Level - 1;
+
+  if(Leaf < 0) return;    // Empty tree, nothing to learn
+
+  if(InsertPoint.Record[Leaf] == InsertPoint.MaxRecord[Leaf]){
+    Info.AppendRun++;
+    Info.PrependRun = 0;
+  }
+  else if(!InsertPoint.Record[Leaf]){
+    Info.PrependRun++;
+    Info.AppendRun = 0;
+  }
+  else Info.AppendRun = Info.PrependRun = 0;
+}
+
+
+/*
+**    GetSplitPoint
+**
+** Chooses the record to promote when a full page must be split.
+**
+** With WFDNodeAdaptSplit clear this is simply the fixed PromoteRecord.
+** With it set, a run of insertions at the right hand edge (ascending
+** input, as with an official nodelist) leaves the old page full and
+** starts the new page almost empty, and a run at the left hand edge
+** (descending input) does the reverse. Anything else splits at
+** PromoteRecord, which defaults to the middle of the page.
+**
+**    Parameters
+**
+**    Info          the tree being split
+**    InsertRecord  the position of the new record in the full page
+**
+**    Returns
+**
+**    The record to promote, between 1 and 31 inclusive
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::GetSplitPoint(FDWNTreeInfo & Info, int InsertRecord)
+{
+  if(Info.Flags & WFDNodeAdaptSplit){
+    if((InsertRecord == 32) && (Info.AppendRun >= ADAPTSPLITRUN)) return(31);
+    if((InsertRecord == 0) && (Info.PrependRun >= ADAPTSPLITRUN)) return(1);
+  }
+  return(Info.PromoteRecord);
+}
+
+
+/*
+**    AddBatch
+**
+** Does the work of AddRecords() for any of the three trees.
+**
+** The first record of each run goes in through AddRecord(), which finds
+** its leaf and splits that if it is full. As long as it was not split,
+** the records which follow are then placed in the same leaf directly,
+** up to the key above the leaf in its parent, or until the leaf fills.
+** The leaf is then written once, and the next record starts a new run.
+** The insertion point is kept up to date as AddRecord() would, so that
+** GetSplitPoint() still sees sorted input as such.
+**
+**    Parameters
+**
+**    Index     NFDXIndex, UFDXIndex or PFDXIndex
+**    Records   Count records of the tree given
+**    Count     The number of records
+**    Report    Filled with the number of records added, replaced, and
+**              dropped as duplicates
+**
+**    Returns
+**
+**    0 on failure; 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::AddBatch(char Index, char * Records, long Count, FDWNBatchReport & Report)
+{
+  int    RecSize = GetRecordSize(Index);
+  int    success = 1;
+  int    Leaf, Level, Position, Test, Result, Dirty;
+  long   Next;
+  long * Order;
+  char * Record;
+  char * Bound;
+  char * Work;
+  char * Stored;
+  FDWNTreeInfo  * Info = GetTreeFlags(Index);
+  FDWNPageImage * Image;
+  FDWNPageImage * Page;
+
+  Report.Added = Report.Replaced = Report.Skipped = 0;
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  if(!Info || (Count < 0)) return(0);
+  if(!Count) return(1);
+
+  Order = new long[Count];
+  Image = new FDWNPageImage[2];
+  Work  = new char[RecSize];
+  if(!Order || !Image || !Work){
+    if(Order) delete [] Order;
+    if(Image) delete [] Image;
+    if(Work)  delete [] Work;
+    SignalError(10);
+    return(0);
+  }
+  Page   = &Image[0];
+  Stored = (char *) &Page->Records;
+
+  for(Next = 0; Next < Count; Next++) Order[Next] = Next;
+  SortBatch(Index, Records, Order, Count);
+
+  Next = 0;
+  while(success && (Next < Count)){
+    // The first record of the run, in the usual way. AddRecord() may
+    // overwrite the record it is given, so it works on a copy.
+    memcpy(Work, Records + Order[Next++] * RecSize, RecSize);
+    switch(Index){
+      case NFDXIndex : Result = AddRecord(*(NFDXRecord *) Work); break;
+      case UFDXIndex : Result = AddRecord(*(UFDXRecord *) Work); break;
+      default        : Result = AddRecord(*(PFDXRecord *) Work); break;
+    }
+    if(Result == 1) Report.Added++;
+    else if(Result == 2) Report.Replaced++;
+    else if(InsertPoint.Status) Report.Skipped++;
+    else{
+      success = 0;
+      break;
+    }
+
+    // A split leaves the insertion point above the leaves (or empty, for
+    // a new root), as does a duplicate found in a link page
+    Leaf = InsertPoint.Level - 1;
+    if((Leaf < 0) || (Next >= Count)) continue;
+    if(!ReadImage(Index, InsertPoint.Page[Leaf], *Page)){
+      success = 0;
+      break;
+    }
+    if(Page->Links[0]) continue;
+
+    // The leaf takes keys up to the record above it in the nearest page
+    // up the path which has one, and all the rest if there is none
+    Bound = NULL;
+    for(Level = Leaf - 1; (Level >= 0) && (InsertPoint.Record[Level] >= InsertPoint.MaxRecord[Level]); Level--);
+    if(Level >= 0){
+      if(!ReadImage(Index, InsertPoint.Page[Level], Image[1])){
+        success = 0;
+        break;
+      }
+      Bound = (char *) &Image[1].Records + InsertPoint.Record[Level] * RecSize;
+    }
+
+    Dirty    = 0;
+    Position = InsertPoint.Record[Leaf];
+    while(Next < Count){
+      Record = Records + Order[Next] * RecSize;
+      if(Bound && (CompareRecords(Index, Record, Bound) >= 0)) break;
+      Test = 1;
+      while((Position < Page->Count) && ((Test = CompareRecords(Index, Record, Stored + Position * RecSize)) > 0)) Position++;
+      if((Position < Page->Count) && !Test){
+        // Already in the leaf, its link (always 0 here) is kept
+        if(Info->Flags & WFDNodeUseDupes){
+          memcpy(Stored + Position * RecSize, Record, RecSize);
+          Report.Replaced++;
+          Dirty = 1;
+        }
+        else Report.Skipped++;
+      }
+      else{
+        if(Page->Count >= 32) break;    // Full, AddRecord() will split it
+        memmove(Stored + (Position + 1) * RecSize, Stored + Position * RecSize, (Page->Count - Position) * RecSize);
+        memcpy(Stored + Position * RecSize, Record, RecSize);
+        Page->Links[Page->Count + 1] = 0;
+        InsertPoint.Status          = 0;
+        InsertPoint.Record[Leaf]    = Position;
+        InsertPoint.MaxRecord[Leaf] = Page->Count++;
+        NoteInsertPoint(*Info);
+        Info->Records++;
+        Report.Added++;
+        Dirty = 1;
+      }
+      Next++;
+    }
+    if(Dirty && !WriteImage(Index, InsertPoint.Page[Leaf], *Page)) success = 0;
+  }
+
+  delete [] Order;
+  delete [] Image;
+  delete [] Work;
+  return(success);
+}
+
+
+/*
+**    SortBatch
+**
+** Sorts a batch of records for AddBatch() by key, without moving them,
+** by filling Order with their positions in the batch in sorted order.
+** Records with the same key keep the order they were given in. Heapsort
+** is used, as it needs no more memory, and has no bad case.
+**
+**    Parameters
+**
+**    Index     NFDXIndex, UFDXIndex or PFDXIndex
+**    Records   Count records of the tree given
+**    Order     Count entries, filled with 0 to Count - 1 on entry
+**    Count     The number of records
+**
+*/
+FDNPREF void FDNFUNC FrontDoorWNode::SortBatch(char Index, char * Records, long * Order, long Count)
+{
+  int  RecSize = GetRecordSize(Index);
+  int  Test;
+  long Start = Count / 2 - 1;
+  long End   = Count - 1;
+  long Root, Child, Swap;
+
+  while(End > 0){
+    // Build a heap with the greatest record at the top, then repeatedly
+    // move the top to the end and restore the heap in what remains
+    if(Start >= 0) Root = Start--;
+    else{
+      Swap       = Order[0];
+      Order[0]   = Order[End];
+      Order[End] = Swap;
+      End--;
+      Root = 0;
+    }
+    while((Child = 2 * Root + 1) <= End){
+      if(Child < End){
+        Test = CompareRecords(Index, Records + Order[Child] * RecSize, Records + Order[Child + 1] * RecSize);
+        if((Test < 0) || (!Test && (Order[Child] < Order[Child + 1]))) Child++;
+      }
+      Test = CompareRecords(Index, Records + Order[Root] * RecSize, Records + Order[Child] * RecSize);
+      if((Test > 0) || (!Test && (Order[Root] > Order[Child]))) break;
+      Swap          = Order[Root];
+      Order[Root]   = Order[Child];
+      Order[Child]  = Swap;
+      Root = Child;
+    }
+  }
+}
+
+
+/*
+**    CompareRecords
+**
+** Compares the keys of two records of any of the three trees, in the
+** same way as GetInsertPoint().
+**
+**    Returns
+**
+**    As CompareKey()
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::CompareRecords(char Index, const char * Record1, const char * Record2)
+{
+  switch(Index){
+    case NFDXIndex : return(CompareKey(((NFDXRecord *) Record1)->key, ((NFDXRecord *) Record2)->key, ((NFDXRecord *) Record1)->key[0]));
+    case UFDXIndex : return(CompareKey(((UFDXRecord *) Record1)->key, ((UFDXRecord *) Record2)->key, 24));
+    case PFDXIndex : return(CompareKey(((PFDXRecord *) Record1)->key, ((PFDXRecord *) Record2)->key, 21));
+  }
+  return(0);
+}
+
+
+/*
+**    GetPageLinks
+**
+** Reads a page from any of the three trees and extracts its child
+** links, and optionally its records, so that tree walking code need
+** not be written three times.
+**
+**    Parameters
+**
+**    Index     NFDXIndex, UFDXIndex or PFDXIndex
+**    PageNo    Page to read
+**    Links     Array of at least 33 elements, filled with the backref
+**              followed by the link of each record. A leaf page has
+**              Links[0] == 0.
+**    Records   If not NULL, the records of the page are copied here
+**              (GetRecordSize() bytes each).
+**
+**    Returns
+**
+**    The number of records in the page, or -1 on failure
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::GetPageLinks(char Index, long PageNo, long * Links, char * Records)
+{
+  int loop;
+  int Count = -1;
+
+  switch(Index){
+    case NFDXIndex : {
+      NFDXPage Page;
+      if(!ReadPage(Page, PageNo) || (Page.records < 0) || (Page.records > 32)){
+        SignalError(32);
+        return(-1);
+      }
+      Count    = Page.records;
+      Links[0] = Page.backref;
+      for(loop = 0; loop < Count; loop++) Links[loop + 1] = Page.nodes[loop].link;
+      if(Records) memcpy(Records, Page.nodes, Count * sizeof(NFDXRecord));
+      break;
+    }
+    case UFDXIndex : {
+      UFDXPage Page;
+      if(!ReadPage(Page, PageNo) || (Page.records < 0) || (Page.records > 32)){
+        SignalError(33);
+        return(-1);
+      }
+      Count    = Page.records;
+      Links[0] = Page.backref;
+      for(loop = 0; loop < Count; loop++) Links[loop + 1] = Page.names[loop].link;
+      if(Records) memcpy(Records, Page.names, Count * sizeof(UFDXRecord));
+      break;
+    }
+    case PFDXIndex : {
+      PFDXPage Page;
+      if(!ReadPage(Page, PageNo) || (Page.records < 0) || (Page.records > 32)){
+        SignalError(34);
+        return(-1);
+      }
+      Count    = Page.records;
+      Links[0] = Page.backref;
+      for(loop = 0; loop < Count; loop++) Links[loop + 1] = Page.phones[loop].link;
+      if(Records) memcpy(Records, Page.phones, Count * sizeof(PFDXRecord));
+      break;
+    }
+  }
+  return(Count);
+}
+
+
+/*
+**    PutPageRecords
+**
+** The reverse of GetPageLinks(), builds a page for any of the three trees
+** from an array of records and links, and writes it. The root mini cache
+** is kept up to date.
+**
+**    Parameters
+**
+**    Index     NFDXIndex, UFDXIndex or PFDXIndex
+**    PageNo    Page to write
+**    Records   Count records, GetRecordSize() bytes each
+**    Count     Number of records for the page
+**    Links     The backref followed by the link of each record
+**    Direct    If non zero the page goes straight to disk, bypassing any
+**              cache. Only safe when the cache holds nothing of the tree.
+**
+**    Returns
+**
+**    0 on failure; 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::PutPageRecords(char Index, long PageNo, char * Records, int Count, long * Links, int Direct)
+{
+  int loop;
+  int success = 0;
+
+  switch(Index){
+    case NFDXIndex : {
+      NFDXPage Page;
+      memset(&Page, 0, sizeof(NFDXPage));
+      Page.records = (char) Count;
+      Page.backref = Links[0];
+      memcpy(Page.nodes, Records, Count * sizeof(NFDXRecord));
+      for(loop = 0; loop < Count; loop++) Page.nodes[loop].link = Links[loop + 1];
+      success = Direct ? RawWritePage(Page, PageNo) : WritePage(Page, PageNo);
+      if(PageNo == NFirst.index) memcpy(&NRoot, &Page, sizeof(NFDXPage));
+      break;
+    }
+    case UFDXIndex : {
+      UFDXPage Page;
+      memset(&Page, 0, sizeof(UFDXPage));
+      Page.records = (char) Count;
+      Page.backref = Links[0];
+      memcpy(Page.names, Records, Count * sizeof(UFDXRecord));
+      for(loop = 0; loop < Count; loop++) Page.names[loop].link = Links[loop + 1];
+      success = Direct ? RawWritePage(Page, PageNo) : WritePage(Page, PageNo);
+      if(PageNo == UFirst.index) memcpy(&URoot, &Page, sizeof(UFDXPage));
+      break;
+    }
+    case PFDXIndex : {
+      PFDXPage Page;
+      memset(&Page, 0, sizeof(PFDXPage));
+      Page.records = (char) Count;
+      Page.backref = Links[0];
+      memcpy(Page.phones, Records, Count * sizeof(PFDXRecord));
+      for(loop = 0; loop < Count; loop++) Page.phones[loop].link = Links[loop + 1];
+      success = Direct ? RawWritePage(Page, PageNo) : WritePage(Page, PageNo);
+      if(PageNo == PFirst.index) memcpy(&PRoot, &Page, sizeof(PFDXPage));
+      break;
+    }
+  }
+  return(success);
+}
+
+
+/*
+**    GetTreeRecords
+**
+** Copies every record of a tree, in key order, into Store which must
+** be large enough to hold them all (see GetTreeQuality()).
+**
+**    Returns
+**
+**    The number of records copied, or -1 on failure
+**
+*/
+FDNPREF long FDNFUNC FrontDoorWNode::GetTreeRecords(char Index, char * Store)
+{
+  long   Links[MAXHEIGHT][33];
+  int    Count[MAXHEIGHT];
+  int    Child[MAXHEIGHT];
+  int    RecSize = GetRecordSize(Index);
+  long   Stored = 0;
+  long   Page;
+  int    Depth = 0;
+  char * Level;
+
+  switch(Index){
+    case NFDXIndex : Page = NFirst.index; break;
+    case UFDXIndex : Page = UFirst.index; break;
+    case PFDXIndex : Page = PFirst.index; break;
+    default        : return(-1);
+  }
+  if(!Page) return(0);
+
+  // One page worth of records for each level of the descent
+  Level = new char[MAXHEIGHT * 32 * RecSize];
+  if(!Level){
+    SignalError(10);
+    return(-1);
+  }
+
+  Child[0] = 0;
+  Count[0] = GetPageLinks(Index, Page, Links[0], Level);
+  while(Count[Depth] >= 0){
+    if(!Links[Depth][0]){
+      // A leaf, take all of it
+      memcpy(Store + Stored * RecSize, Level + Depth * 32 * RecSize, Count[Depth] * RecSize);
+      Stored += Count[Depth];
+      if(!Depth--) break;
+      continue;
+    }
+    if(Child[Depth] > Count[Depth]){
+      // All children visited
+      if(!Depth--) break;
+      continue;
+    }
+    if(Child[Depth]){
+      // Returning from a child, the record to its right comes next
+      memcpy(Store + Stored * RecSize, Level + (Depth * 32 + Child[Depth] - 1) * RecSize, RecSize);
+      Stored++;
+    }
+    Page = Links[Depth][Child[Depth]++];
+    if(++Depth >= MAXHEIGHT){
+      SignalError(31 + Index);  // 32, 33 or 34, invalid page
+      Stored = -1;
+      break;
+    }
+    Child[Depth] = 0;
+    Count[Depth] = GetPageLinks(Index, Page, Links[Depth], Level + Depth * 32 * RecSize);
+  }
+  if((Depth >= 0) && (Depth < MAXHEIGHT) && (Count[Depth] < 0)) Stored = -1;
+
+  delete [] Level;
+  return(Stored);
+}
+
+
+/*
+**    GetRecordSize
+**
+** Returns the size of a record in the given tree, or 0 if the index
+** is not valid.
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::GetRecordSize(char Index)
+{
+  switch(Index){
+    case NFDXIndex : return(sizeof(NFDXRecord));
+    case UFDXIndex : return(sizeof(UFDXRecord));
+    case PFDXIndex : return(sizeof(PFDXRecord));
+  }
+  return(0);
+}
+
+
+/*
+**    ProbeRecord
+**
+** Performs a root to leaf descent for the key of the given record, as
+** a lookup would. Used to time the effect of compaction.
+**
+*/
+FDNPREF void FDNFUNC FrontDoorWNode::ProbeRecord(char Index, char * Record)
+{
+  switch(Index){
+    case NFDXIndex : GetInsertPoint(*(NFDXRecord *) Record); break;
+    case UFDXIndex : GetInsertPoint(*(UFDXRecord *) Record); break;
+    case PFDXIndex : GetInsertPoint(*(PFDXRecord *) Record); break;
+  }
+}
+
+
+/*
+**    GetSegmentSlot
+**
+** Returns the entry in Segment[] for a Whence, or -1 if it is not valid.
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::GetSegmentSlot(long Whence)
+{
+  switch(Whence){
+    case WFDNOfficial : return(0);
+    case WFDNPrivate  : return(1);
+    case WFDNPoint    : return(2);
+    case WFDNInternal : return(3);
+  }
+  return(-1);
+}
+
+
+/*
+**    GetIndexFile
+**
+** Returns the file object for the given tree, or NULL if the index
+** is not valid.
+**
+*/
+FDNPREF FDN_FileObject FDNFUNC *FrontDoorWNode::GetIndexFile(char Index)
+{
+  switch(Index){
+    case NFDXIndex : return(&NFDX);
+    case UFDXIndex : return(&UFDX);
+    case PFDXIndex : return(&PFDX);
+  }
+  return(NULL);
+}
+
+
+/*
+**    ReopenIndex
+**
+** Closes an index file and opens it again destructively, leaving it
+** empty. If this fails the class is frozen, as in InitClass().
+**
+**    Returns
+**
+**    0 on failure; 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::ReopenIndex(char Index)
+{
+  int success;
+  FDN_FileObject * File = GetIndexFile(Index);
+
+  if(!File) return(0);
+  File->Close();
+  File->SetFlags(FDNFileDestroy | FileMode());
+  File->Open();
+  success = File->GetStatus();
+  File->SetFlags(((Flags & WFDNodeOverWrite) ? FDNFileDestroy : FDNFileUpdate) | FileMode());
+
+  if(!success){
+    switch(Index){
+      case NFDXIndex : SignalError(1);  break;
+      case UFDXIndex : SignalError(2);  break;
+      case PFDXIndex : SignalError(14); break;
+    }
+    Frozen = 1;
+    NFDX.Close();
+    UFDX.Close();
+    PFDX.Close();
+    PFDA.Close();
+  }
+  return(success);
+}
+
+
+/*
+**    ReadImage, WriteImage
+**
+** Read and write a page of any of the three trees as an FDWNPageImage,
+** through the cache. Used by the tree independent deletion code below.
+**
+**    Returns
+**
+**    0 on failure; 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::ReadImage(char Index, long PageNo, FDWNPageImage & Image)
+{
+  Image.Count = GetPageLinks(Index, PageNo, Image.Links, (char *) &Image.Records);
+  return(Image.Count >= 0);
+}
+
+
+FDNPREF int FDNFUNC FrontDoorWNode::WriteImage(char Index, long PageNo, FDWNPageImage & Image)
+{
+  return(PutPageRecords(Index, PageNo, (char *) &Image.Records, Image.Count, Image.Links, 0));
+}
+
+
+/*
+**    RemoveFromImage
+**
+** Removes the record at Position from a page image, together with the
+** link to its right.
+**
+*/
+FDNPREF void FDNFUNC FrontDoorWNode::RemoveFromImage(FDWNPageImage & Image, int Position, int RecSize)
+{
+  int loop;
+  char * Records = (char *) &Image.Records;
+
+  memmove(Records + Position * RecSize, Records + (Position + 1) * RecSize, (Image.Count - Position - 1) * RecSize);
+  for(loop = Position + 1; loop < Image.Count; loop++) Image.Links[loop] = Image.Links[loop + 1];
+  Image.Count--;
+}
+
+
+/*
+**    AllocPage
+**
+** Returns a page number for a new page in a tree, reusing a page freed
+** by deletion if there is one, or extending the file otherwise.
+**
+*/
+FDNPREF long FDNFUNC FrontDoorWNode::AllocPage(char Index)
+{
+  FDWNTreeInfo * Info = GetTreeFlags(Index);
+  long Links[33];
+  long PageNo;
+
+  if(Info->FreePage){
+    PageNo = Info->FreePage;
+    if(GetPageLinks(Index, PageNo, Links, NULL) == 0){
+      Info->FreePage = Links[0];
+      return(PageNo);
+    }
+    // Not an empty page, so the chain is damaged. Abandon it rather than
+    // risk handing out a page which is still in use.
+    Info->FreePage = 0;
+  }
+  return(++Info->Pages);
+}
+
+
+/*
+**    FreePage
+**
+** Adds a page no longer used by a tree to the chain of free pages. A
+** free page has no records, and its backref is the next free page. The
+** head of the chain is kept in the stub (see FREEPAGEOFFSET).
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::FreePage(char Index, long PageNo)
+{
+  FDWNTreeInfo * Info = GetTreeFlags(Index);
+  long Links[33];
+
+  Links[0] = Info->FreePage;
+  if(!PutPageRecords(Index, PageNo, NULL, 0, Links, 0)) return(0);
+  Info->FreePage = PageNo;
+  return(1);
+}
+
+
+/*
+**    SetRoot
+**
+** Makes a new page the root of a tree (0 for an empty tree), and loads
+** it into the root mini cache.
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::SetRoot(char Index, long PageNo)
+{
+  int success = 1;
+
+  switch(Index){
+    case NFDXIndex :
+      NFirst.index  = PageNo;
+      NRoot.records = 0;    // So that ReadPage() fetches the real thing
+      if(PageNo) success = ReadPage(NRoot, PageNo);
+      break;
+    case UFDXIndex :
+      UFirst.index  = PageNo;
+      URoot.records = 0;
+      if(PageNo) success = ReadPage(URoot, PageNo);
+      break;
+    case PFDXIndex :
+      PFirst.index  = PageNo;
+      PRoot.records = 0;
+      if(PageNo) success = ReadPage(PRoot, PageNo);
+      break;
+  }
+  return(success);
+}
+
+
+/*
+**    DeleteFromTree
+**
+** Does the work of deleting a record from any of the three trees.
+**
+** A record in an interior page is replaced by its predecessor, so that
+** the record actually removed always comes from a leaf. Then, working
+** back up the path, a page left with fewer than MINRECORDS records is
+** merged with a neighbour if the two (and the record between them in
+** the parent) fit in one page, the parent losing a record in turn, or
+** otherwise shares the records of the neighbour evenly. A root left
+** empty gives way to its only child.
+**
+**    Parameters
+**
+**    Index     NFDXIndex, UFDXIndex or PFDXIndex
+**    Record    The record to delete. Overwritten with the record which
+**              was removed from the index.
+**
+**    Returns
+**
+**    0 on failure (including not found); 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::DeleteFromTree(char Index, char * Record)
+{
+  long   Path[MAXHEIGHT];     // Page at each level of the descent
+  int    Slot[MAXHEIGHT];     // Child taken at each level, record in the last
+  int    Depth, Sep, Total, loop;
+  int    RecSize = GetRecordSize(Index);
+  int    success = 1;
+  int    Done = 0;
+  long   LeftNo, RightNo, Found;
+  char * Combined;
+  long * CombinedLinks;
+  FDWNPageImage * Image;
+  FDWNPageImage * Page;
+  FDWNPageImage * Parent;
+  FDWNPageImage * Left;
+  FDWNPageImage * Right;
+  FDWNPageImage * Swap;
+
+  ProbeRecord(Index, Record);
+  if(!InsertPoint.Level || !InsertPoint.Status) return(0);
+  Depth = InsertPoint.Level - 1;
+  for(loop = 0; loop <= Depth; loop++){
+    Path[loop] = InsertPoint.Page[loop];
+    Slot[loop] = InsertPoint.Record[loop];
+  }
+
+  Image         = new FDWNPageImage[3];
+  Combined      = new char[65 * RecSize];
+  CombinedLinks = new long[66];
+  if(!Image || !Combined || !CombinedLinks){
+    if(Image)         delete [] Image;
+    if(Combined)      delete [] Combined;
+    if(CombinedLinks) delete [] CombinedLinks;
+    SignalError(10);
+    return(0);
+  }
+  Page   = &Image[0];
+  Parent = &Image[1];
+
+  if(!ReadImage(Index, Path[Depth], *Page)) success = 0;
+  else{
+    // Hand back the record being deleted
+    memcpy(Record, (char *) &Page->Records + Slot[Depth] * RecSize, RecSize);
+
+    if(Page->Links[0]){
+      // An interior record. Its predecessor is the last record in the
+      // rightmost leaf of the subtree to its left, and takes its place.
+      Found = Path[Depth];
+      while(success && Page->Links[0]){
+        if(Depth + 1 >= MAXHEIGHT){
+          SignalError(31 + Index);  // 32, 33 or 34, invalid page
+          success = 0;
+          break;
+        }
+        Path[Depth + 1] = Page->Links[Slot[Depth]];
+        Depth++;
+        if(!ReadImage(Index, Path[Depth], *Page)) success = 0;
+        else Slot[Depth] = Page->Count;
+      }
+      if(success){
+        Slot[Depth] = Page->Count - 1;
+        if(!ReadImage(Index, Found, *Parent)) success = 0;
+        else{
+          memcpy((char *) &Parent->Records + Slot[InsertPoint.Level - 1] * RecSize,
+                 (char *) &Page->Records + Slot[Depth] * RecSize, RecSize);
+          success = WriteImage(Index, Found, *Parent);
+        }
+      }
+    }
+  }
+
+  if(success){
+    // Take the record out of its leaf
+    RemoveFromImage(*Page, Slot[Depth], RecSize);
+
+    while(success && (Depth > 0) && (Page->Count < MINRECORDS)){
+      if(!ReadImage(Index, Path[Depth - 1], *Parent)){
+        success = 0;
+        break;
+      }
+      // Pick a neighbour, the left one if there is one
+      if(Slot[Depth - 1] > 0){
+        Sep     = Slot[Depth - 1] - 1;
+        Left    = &Image[2];
+        Right   = Page;
+        LeftNo  = Parent->Links[Sep];
+        RightNo = Path[Depth];
+        if(!ReadImage(Index, LeftNo, *Left)) success = 0;
+      }
+      else{
+        Sep     = 0;
+        Left    = Page;
+        Right   = &Image[2];
+        LeftNo  = Path[Depth];
+        RightNo = Parent->Links[1];
+        if(!ReadImage(Index, RightNo, *Right)) success = 0;
+      }
+      if(!success) break;
+
+      // Line up the left page, the record between, and the right page
+      Total = Left->Count + 1 + Right->Count;
+      memcpy(Combined, &Left->Records, Left->Count * RecSize);
+      memcpy(Combined + Left->Count * RecSize, (char *) &Parent->Records + Sep * RecSize, RecSize);
+      memcpy(Combined + (Left->Count + 1) * RecSize, &Right->Records, Right->Count * RecSize);
+      for(loop = 0; loop <= Left->Count; loop++)  CombinedLinks[loop] = Left->Links[loop];
+      for(loop = 0; loop <= Right->Count; loop++) CombinedLinks[Left->Count + 1 + loop] = Right->Links[loop];
+
+      if(Total <= 32){
+        // They fit in one page, merge into the left and free the right
+        Left->Count = Total;
+        memcpy(&Left->Records, Combined, Total * RecSize);
+        for(loop = 0; loop <= Total; loop++) Left->Links[loop] = CombinedLinks[loop];
+        success &= WriteImage(Index, LeftNo, *Left);
+        success &= FreePage(Index, RightNo);
+
+        // The parent loses the record between, and its link to the right
+        RemoveFromImage(*Parent, Sep, RecSize);
+        Swap   = Page;
+        Page   = Parent;
+        Parent = Swap;
+        Depth--;
+      }
+      else{
+        // Share the records evenly, a new record going up between them
+        Left->Count  = (Total - 1) / 2;
+        Right->Count = Total - 1 - Left->Count;
+        memcpy(&Left->Records, Combined, Left->Count * RecSize);
+        for(loop = 0; loop <= Left->Count; loop++) Left->Links[loop] = CombinedLinks[loop];
+        memcpy((char *) &Parent->Records + Sep * RecSize, Combined + Left->Count * RecSize, RecSize);
+        memcpy(&Right->Records, Combined + (Left->Count + 1) * RecSize, Right->Count * RecSize);
+        for(loop = 0; loop <= Right->Count; loop++) Right->Links[loop] = CombinedLinks[Left->Count + 1 + loop];
+        success &= WriteImage(Index, LeftNo, *Left);
+        success &= WriteImage(Index, RightNo, *Right);
+        success &= WriteImage(Index, Path[Depth - 1], *Parent);
+        Done = 1;
+        break;
+      }
+    }
+  }
+
+  if(success && !Done){
+    if(!Depth && !Page->Count){
+      // The root is empty, its only child (if any) takes over
+      success &= SetRoot(Index, Page->Links[0]);
+      success &= FreePage(Index, Path[0]);
+      GetTreeFlags(Index)->Level--;
+    }
+    else success = WriteImage(Index, Path[Depth], *Page);
+  }
+
+  delete [] Image;
+  delete [] Combined;
+  delete [] CombinedLinks;
+  return(success);
+}
+
+
+/*
+**    GetSuccessor
+**
+** Following a GetInsertPoint(), finds the record at or after the point
+** found, that is the lowest record with a key not less than the one
+** searched for.
+**
+**    Parameters
+**
+**    Index     NFDXIndex, UFDXIndex or PFDXIndex
+**    Found     Filled with the record, if there is one
+**    Strict    If non zero, and the search found an exact match, the
+**              record after the match is taken instead
+**
+**    Returns
+**
+**    0 if there is no such record; 1 if Found was filled in
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::GetSuccessor(char Index, char * Found, int Strict)
+{
+  int  Level    = InsertPoint.Level - 1;
+  int  RecSize  = GetRecordSize(Index);
+  int  Depth    = Level;
+  int  Position;
+  int  success  = 0;
+  long PageNo;
+  FDWNPageImage * Page;
+
+  if(Level < 0) return(0);
+  Page = new FDWNPageImage;
+  if(!Page){
+    SignalError(10);
+    return(0);
+  }
+
+  if(ReadImage(Index, InsertPoint.Page[Level], *Page)){
+    Position = InsertPoint.Record[Level];
+    if(InsertPoint.Status && Strict){
+      if(Page->Links[0]){
+        // The first record in the subtree to the right of the match
+        PageNo = Page->Links[Position + 1];
+        while(PageNo && (++Depth < MAXHEIGHT) && ReadImage(Index, PageNo, *Page)) PageNo = Page->Links[0];
+        if(!PageNo && Page->Count){
+          memcpy(Found, &Page->Records, RecSize);
+          success = 1;
+        }
+        Level = -1;   // Whatever happened, don't look above
+      }
+      else Position++;
+    }
+    if((Level >= 0) && (Position < Page->Count)){
+      memcpy(Found, (char *) &Page->Records + Position * RecSize, RecSize);
+      success = 1;
+    }
+    else{
+      // Off the end of this page, the next record is in a page above,
+      // to the right of the child we went down through
+      for(Level--; (Level >= 0) && !success; Level--){
+        if(InsertPoint.Record[Level] < InsertPoint.MaxRecord[Level]){
+          if(ReadImage(Index, InsertPoint.Page[Level], *Page)){
+            memcpy(Found, (char *) &Page->Records + InsertPoint.Record[Level] * RecSize, RecSize);
+            success = 1;
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  delete Page;
+  return(success);
+}
+
+
+/*
+**    RawReadPage
+**
+** A set of functions to read pages from the various index files. This function
+** doesn't attempt to be fancy, examine the mini-cache system or virtual cache
+** system. It just fetches the page from secondary storage (and thus is used by
+** the above mechanisms).
+**
+** NODELIST.FDX and USERLIST.FDX are read between LockFiles() and UnlockFiles(),
+** as a derived cache may write pages back to them on another thread.
+**
+**    Parameters
+**
+**    Page    Object to copy page data to
+**    PageNo  The page number to read
+**
+**    Returns
 **
 **    1 on success, 0 on failure.
 */
@@ -1363,8 +2749,10 @@ FDNPREF int  FDNFUNC FrontDoorWNode::RawReadPage(NFDXPage & Page, long PageNo)
 {
   int success = 1;
   
+  LockFiles();
   success &= NFDX.Seek(PageNo * sizeof(Page), SEEK_SET);
   success &= NFDX.Read(&Page, sizeof(Page), 1, 1);
+  UnlockFiles();
 
   return(success);
 }
@@ -1377,8 +2765,10 @@ FDNPREF int  FDNFUNC FrontDoorWNode::RawReadPage(UFDXPage & Page, long PageNo)
 {
   int success = 1;
   
+  LockFiles();
   success &= UFDX.Seek(PageNo * sizeof(Page), SEEK_SET);
   success &= UFDX.Read(&Page, sizeof(Page), 1, 1);
+  UnlockFiles();
 
   return(success);
 }
@@ -1404,7 +2794,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::RawReadPage(PFDXPage & Page, long PageNo)
 ** A set of functions to write pages to the various index files. This function
 ** doesn't attempt to be fancy, examine the mini-cache system or virtual cache
 ** system. It just sends the page from secondary storage (and thus is used by
-** the above mechanisms).
+** the above mechanisms). Locking is as for RawReadPage().
 **
 **    Parameters
 **
@@ -1419,8 +2809,10 @@ FDNPREF int  FDNFUNC FrontDoorWNode::RawWritePage(NFDXPage & Page, long PageNo)
 {
   int success = 1;
   
+  LockFiles();
   success &= NFDX.Seek(PageNo * sizeof(Page), SEEK_SET);
   success &= NFDX.Write(&Page, sizeof(Page), 1, 1);
+  UnlockFiles();
   return(success);
 }
 
@@ -1432,8 +2824,23 @@ FDNPREF int  FDNFUNC FrontDoorWNode::RawWritePage(UFDXPage & Page, long PageNo)
 {
   int success = 1;
   
+  LockFiles();
   success &= UFDX.Seek(PageNo * sizeof(Page), SEEK_SET);
   success &= UFDX.Write(&Page, sizeof(Page), 1, 1);
+  UnlockFiles();
+  return(success);
+}
+
+
+/*
+** See overloaded version above for more details
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::RawWritePage(PFDXPage & Page, long PageNo)
+{
+  int success = 1;
+  
+  success &= PFDX.Seek(PageNo * sizeof(Page), SEEK_SET);
+  success &= PFDX.Write(&Page, sizeof(Page), 1, 1);
   return(success);
 }
 
@@ -1481,8 +2888,12 @@ FDNPREF int  FDNFUNC FrontDoorWNode::ReadPage(NFDXPage & Page, long PageNo)
   // Ok, we're really going to have to fetch it
   success = RawReadPage(Page, PageNo);
 
-  // Experiment
-  if(success) CommitCache(Page, PageNo);
+  // Offer it to the cache, which must not think it needs writing back
+  if(success){
+    CacheFill = 1;
+    CommitCache(Page, PageNo);
+    CacheFill = 0;
+  }
 
   return(success);
 }
@@ -1524,9 +2935,13 @@ FDNPREF int  FDNFUNC FrontDoorWNode::ReadPage(UFDXPage & Page, long PageNo)
 
   // Ok, we're really going to have to fetch it
   success = RawReadPage(Page, PageNo);
-  
-  // Experiment
-  if(success) CommitCache(Page, PageNo);
+
+  // Offer it to the cache, which must not think it needs writing back
+  if(success){
+    CacheFill = 1;
+    CommitCache(Page, PageNo);
+    CacheFill = 0;
+  }
 
   return(success);
 }
@@ -1595,7 +3010,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::WritePage(PFDXPage & Page, long PageNo)
 */
 FDNPREF int  FDNFUNC FrontDoorWNode::WriteNFDXStub()
 {
-  int success = 0;
+  int success = 1;
   
   NFDXPage * First = new NFDXPage;
   if(!First){
@@ -1606,6 +3021,8 @@ FDNPREF int  FDNFUNC FrontDoorWNode::WriteNFDXStub()
   NFirst.flags = 0xFFFFFFFFUL;
   NFirst.pagelen = sizeof(NFDXPage);
   memcpy(First, &NFirst, sizeof(NFirst));
+  memcpy((char *) First + FREEPAGEOFFSET, &NInfo.FreePage, sizeof(long));
+  memcpy((char *) First + SEGMENTOFFSET, Segment, sizeof(Segment));
 
   DefaultInfo.CompileTime = Time(NULL);
 
@@ -1623,7 +3040,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::WriteNFDXStub()
 */
 FDNPREF int  FDNFUNC FrontDoorWNode::WriteUFDXStub()
 {
-  int success = 0;
+  int success = 1;
   
   UFDXPage * First = new UFDXPage;
   if(!First){
@@ -1634,6 +3051,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::WriteUFDXStub()
   UFirst.flags = 0xFFFFFFFFUL;
   UFirst.pagelen = sizeof(UFDXPage);
   memcpy(First, &UFirst, sizeof(UFirst));
+  memcpy((char *) First + FREEPAGEOFFSET, &UInfo.FreePage, sizeof(long));
 
   DefaultInfo.CompileTime = Time(NULL);
 
@@ -1651,7 +3069,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::WriteUFDXStub()
 */
 FDNPREF int  FDNFUNC FrontDoorWNode::WritePFDXStub()
 {
-  int success = 0;
+  int success = 1;
   
   PFDXPage * First = new PFDXPage;
   if(!First){
@@ -1662,6 +3080,7 @@ FDNPREF int  FDNFUNC FrontDoorWNode::WritePFDXStub()
   PFirst.flags = 0xFFFFFFFFUL;
   PFirst.pagelen = sizeof(PFDXPage);
   memcpy(First, &PFirst, sizeof(PFirst));
+  memcpy((char *) First + FREEPAGEOFFSET, &PInfo.FreePage, sizeof(long));
 
   DefaultInfo.CompileTime = Time(NULL);
 
@@ -1683,142 +3102,459 @@ FDNPREF int  FDNFUNC FrontDoorWNode::WritePFDXStub()
 **
 **    Returns
 **
-**    1 on success, 0 on failure.
+**    1 on success, 0 on failure.
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::ReadNFDXStub()
+{
+  int success;
+  int loop;
+  StubInfo * SInfo;
+  NFDXPage * First;
+
+  First = new NFDXPage;
+  if(!First){
+    SignalError(10);
+    return(0);
+  }
+  SInfo = new StubInfo;
+  if(!SInfo){
+    SignalError(10);
+    return(0);
+  }
+
+  memset(First, 0, sizeof(NFDXPage));
+
+  success = RawReadPage(*First, 0);    // Fetch the stub "page"
+  memcpy(SInfo, (char *) First + 256, sizeof(StubInfo));
+  if(success){
+    memcpy(&NFirst, First, sizeof(NFirst));
+    memcpy(&NInfo.FreePage, (char *) First + FREEPAGEOFFSET, sizeof(long));
+    memcpy(Segment, (char *) First + SEGMENTOFFSET, sizeof(Segment));
+  }
+  // Validate the elements
+  if(SInfo->ZeroWord || NFirst.pagelen!=sizeof(NFDXPage) || SInfo->RevisionMaj!=2 || SInfo->RevisionMin!=3){
+    SignalError(26);
+    success = 0;
+  }
+  if(success && !(Flags & WFDNodeOverWrite) && !stricmp(NodeExt, "CUR")){
+    // We need to read the current nodelist extension
+    DefaultInfo.NodeExt[0] = 3;
+    for(loop=1; loop<=3; loop++) NodeExt[loop - 1] = DefaultInfo.NodeExt[loop] = SInfo->NodeExt[loop];
+    NodeExt[3] = 0;
+  }
+  delete SInfo;
+  delete First;
+  return(success);
+}
+
+
+/*
+** See similar version above for more details
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::ReadUFDXStub()
+{
+  int success;
+  StubInfo * SInfo;
+  UFDXPage * First;
+
+  First = new UFDXPage;
+  if(!First){
+    SignalError(10);
+    return(0);
+  }
+  SInfo = new StubInfo;
+  if(!SInfo){
+    SignalError(10);
+    return(0);
+  }
+
+  memset(First, 0, sizeof(UFDXPage));
+
+  success = RawReadPage(*First, 0);    // Fetch the stub "page"
+  memcpy(SInfo, (char *) First + 256, sizeof(StubInfo));
+  if(success){
+    memcpy(&UFirst, First, sizeof(UFirst));
+    memcpy(&UInfo.FreePage, (char *) First + FREEPAGEOFFSET, sizeof(long));
+  }
+  // Validate the elements
+  if(UFirst.pagelen!=sizeof(UFDXPage)){
+    success = 0;
+    SignalError(27);
+  }
+  delete SInfo;
+  delete First;
+  return(success);
+}
+
+
+/*
+** See similar version above for more details
+*/
+FDNPREF int  FDNFUNC FrontDoorWNode::ReadPFDXStub()
+{
+  int success;
+  StubInfo * SInfo;
+  PFDXPage * First;
+
+  First = new PFDXPage;
+  if(!First){
+    SignalError(10);
+    return(0);
+  }
+  SInfo = new StubInfo;
+  if(!SInfo){
+    SignalError(10);
+    return(0);
+  }
+
+  memset(First, 0, sizeof(PFDXPage));
+
+  success = RawReadPage(*First, 0);    // Fetch the stub "page"
+  memcpy(SInfo, (char *) First + 256, sizeof(StubInfo));
+  if(success){
+    memcpy(&PFirst, First, sizeof(PFirst));
+    memcpy(&PInfo.FreePage, (char *) First + FREEPAGEOFFSET, sizeof(long));
+  }
+  // Validate the elements
+  if(PFirst.pagelen!=sizeof(PFDXPage)){
+    SignalError(28);
+    success = 0;
+  }
+  delete SInfo;
+  delete First;
+  return(success);
+}
+
+
+FDNPREF int  FDNFUNC FrontDoorWNode::WritePFDAStub()
+{
+  int success = 0;
+  
+  FirstPage * First = (FirstPage *) new char[sizeof(FDNPhoneRec)];
+  if(!First){
+    SignalError(10);
+    return(0);
+  }
+  memset(First, 0, sizeof(FDNPhoneRec));
+  First->flags = 0xFFFFFFFFUL;
+  First->pagelen = sizeof(FDNPhoneRec);
+
+  success &= PFDA.Seek(0, SEEK_SET);
+  success &= PFDA.Write(First, sizeof(FDNPhoneRec), 1, 1);
+  
+  delete First;
+  return(success);
+}
+
+
+/*
+**    ReadGeneration
+**
+** Reads the name of the directory holding the published index set from
+** GENERATIONFILE in the nodelist directory. If there is no such file the
+** index set is in the nodelist directory itself, and Name is left empty.
+**
+**    Returns
+**
+**    1 if a published set was named, 0 otherwise
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::ReadGeneration(char * Name)
+{
+  FDN_FileObject Pointer;
+  char filename[PATHLENGTH];
+  int  loop;
+
+  memset(Name, 0, 13);
+  strcpy(filename, NodelistDir);
+  strcat(filename, GENERATIONFILE);
+  Pointer.SetName(filename);
+  if(!Pointer.Open()) return(0);
+  Pointer.Read(Name, 1, 12, 0);
+  Pointer.Close();
+  for(loop = 0; loop < 12 && Name[loop] > ' '; loop++);
+  Name[loop] = 0;
+  return(*Name != 0);
+}
+
+
+/*
+**    StageIndex
+**
+** Copies the index files of the set in use, in the generation directory
+** Current (or the nodelist directory if that is empty), to IndexDir so
+** that they may be updated there and published.
+**
+**    Returns
+**
+**    0 on failure; 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::StageIndex(const char * Current)
+{
+  static const char * Files[] = { "NODELIST.FDX", "USERLIST.FDX", "PHONE.FDX", "PHONE.FDA", SUMFILE };
+  char From[PATHLENGTH], To[PATHLENGTH];
+  int  loop;
+
+  for(loop = 0; loop < 5; loop++){
+    strcpy(From, NodelistDir);
+    if(*Current){
+      strcat(From, Current);
+      AddTrail(From);
+    }
+    strcat(From, Files[loop]);
+    strcpy(To, IndexDir);
+    strcat(To, Files[loop]);
+    if(!CopyIndexFile(From, To)) return(0);
+  }
+  return(1);
+}
+
+
+/*
+**    CopyIndexFile
+**
+** Copies one file of an index set, COPYBLOCK bytes at a time. If From
+** does not exist then neither should To, so it is removed.
+**
+**    Returns
+**
+**    0 on failure; 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::CopyIndexFile(const char * From, const char * To)
+{
+  FDN_FileObject Source, Target;
+  char * Buffer;
+  long   Left;
+  size_t Block;
+  int    success = 1;
+
+  Source.SetName(From);
+  if(!Source.Open()){
+    remove(To);
+    return(1);
+  }
+  Target.SetName(To);
+  Target.SetFlags(FDNFileDestroy);
+  if(!Target.Open()) return(0);
+  Buffer = new char[COPYBLOCK];
+  if(!Buffer){
+    SignalError(10);
+    return(0);
+  }
+
+  Left = Source.Size();
+  while(success && Left > 0){
+    Block = (Left > (long) COPYBLOCK) ? COPYBLOCK : (size_t) Left;
+    success = Source.Read(Buffer, Block, 1, 1) && Target.Write(Buffer, Block, 1, 1);
+    Left -= (long) Block;
+  }
+  delete[] Buffer;
+  Source.Close();
+  if(!Target.Close()) success = 0;
+  return(success);
+}
+
+
+/*
+**    Publish
+**
+** Makes the index set built in IndexDir the one in use. The private
+** lists the index refers to are copied in beside it first, as the
+** compiler will build them again in the nodelist directory next time.
+** Then GENERATIONFILE is updated in place; as the generation names
+** differ only in their last character, readers see either the old set
+** or the new one, never a mixture. The first time a set is published
+** there is no GENERATIONFILE to update, and it is created.
+**
+**    Returns
+**
+**    0 on failure; 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::Publish()
+{
+  static const char * Lists[] = { "FDNET.PVT", "FDPOINT.PVT" };
+  FDN_FileObject Pointer;
+  char From[PATHLENGTH], To[PATHLENGTH];
+  int  loop, success = 1;
+
+  for(loop = 0; loop < 2 && success; loop++){
+    strcpy(From, NodelistDir);
+    strcat(From, Lists[loop]);
+    strcpy(To, IndexDir);
+    strcat(To, Lists[loop]);
+    success = CopyIndexFile(From, To);
+  }
+
+  if(success){
+    strcpy(From, NodelistDir);
+    strcat(From, GENERATIONFILE);
+    Pointer.SetName(From);
+    if(!Pointer.Open()) Pointer.SetFlags(FDNFileDestroy);
+    else{
+      Pointer.Close();
+      Pointer.SetFlags(FDNFileUpdate);
+    }
+    success = Pointer.Open() && Pointer.Seek(0, SEEK_SET) &&
+              Pointer.Write(Generation, strlen(Generation), 1, 1) && Pointer.Close();
+  }
+  if(!success) SignalError(102);
+  return(success);
+}
+
+
+/*
+**    ReadSums
+**
+** Reads SUMFILE from IndexDir into PageSum[], provided it was written
+** for the index set as it stands, that is with the same compile time in
+** NODELIST.FDX and the same number of pages in each file.
+**
+**    Returns
+**
+**    0 if there are no sums for the set; 1 otherwise
+**
 */
-FDNPREF int  FDNFUNC FrontDoorWNode::ReadNFDXStub()
+FDNPREF int FDNFUNC FrontDoorWNode::ReadSums()
 {
-  int success;
-  int loop;
-  StubInfo * SInfo;
+  FDN_FileObject Sums;
+  SumHeader Header;
   NFDXPage * First;
+  char filename[PATHLENGTH];
+  int  loop, success;
 
+  DropSums();
   First = new NFDXPage;
   if(!First){
     SignalError(10);
     return(0);
   }
-  SInfo = new StubInfo;
-  if(!SInfo){
-    SignalError(10);
-    return(0);
-  }
-
-  memset(First, 0, sizeof(NFDXPage));
-
-  success = RawReadPage(*First, 0);    // Fetch the stub "page"
-  memcpy(SInfo, (char *) First + 256, sizeof(StubInfo));
+  strcpy(filename, IndexDir);
+  strcat(filename, SUMFILE);
+  Sums.SetName(filename);
+  success = RawReadPage(*First, 0) && Sums.Open();
   if(success){
-    memcpy(&NFirst, First, sizeof(NFirst));
-  }
-  // Validate the elements
-  if(SInfo->ZeroWord || NFirst.pagelen!=sizeof(PFDXPage) || SInfo->RevisionMaj!=2 || SInfo->RevisionMin!=3){
-    SignalError(26);
-    success = 0;
-  }
-  if(success && !(Flags & WFDNodeOverWrite) && strnicmp(DefaultInfo.NodeExt+1, "CUR", 3)){
-    // We need to read the current nodelist extension
-    for(loop=1; loop<=3; loop++) DefaultInfo.NodeExt[loop] = SInfo->NodeExt[loop];
+    success = Sums.Read(&Header, sizeof(SumHeader), 1, 1) && !memcmp(Header.Magic, "FDNS", 4) &&
+              Header.CompileTime == ((StubInfo *) ((char *) First + 256))->CompileTime &&
+              Header.Pages[0] == NInfo.Pages + 1 && Header.Pages[1] == UInfo.Pages + 1 &&
+              Header.Pages[2] == PInfo.Pages + 1;
+    for(loop = 0; success && loop < 3; loop++){
+      PageSum[loop] = new unsigned long[(size_t) Header.Pages[loop]];
+      SumPages[loop] = Header.Pages[loop];
+      success = PageSum[loop] && Sums.Read(PageSum[loop], sizeof(unsigned long), (size_t) Header.Pages[loop], 1);
+    }
+    Sums.Close();
   }
-  delete SInfo;
   delete First;
+  if(!success) DropSums();
   return(success);
 }
 
 
 /*
-** See similar version above for more details
+**    WriteSums
+**
+** Writes SUMFILE in IndexDir, with the sum of each page of the three
+** index files as they now stand. Called from Freeze() once the stubs
+** are written, under WFDNodeChecksum. The magic number is written last,
+** so that a file left part written is never taken for the real thing.
+**
+**    Returns
+**
+**    0 on failure; 1 on success
+**
 */
-FDNPREF int  FDNFUNC FrontDoorWNode::ReadUFDXStub()
+FDNPREF int FDNFUNC FrontDoorWNode::WriteSums()
 {
-  int success;
-  StubInfo * SInfo;
-  UFDXPage * First;
-
-  First = new UFDXPage;
-  if(!First){
-    SignalError(10);
-    return(0);
+  static const unsigned Length[3] = { sizeof(NFDXPage), sizeof(UFDXPage), sizeof(PFDXPage) };
+  FDN_FileObject Sums;
+  FDN_FileObject * File;
+  SumHeader Header;
+  unsigned long Sum;
+  char * Page;
+  char filename[PATHLENGTH];
+  unsigned Largest = 0;
+  long PageNo;
+  int  loop, success;
+
+  memset(&Header, 0, sizeof(SumHeader));
+  for(loop = 0; loop < 3; loop++){
+    Header.Pages[loop] = GetIndexFile((char) (NFDXIndex + loop))->Size() / (long) Length[loop];
+    if(Length[loop] > Largest) Largest = Length[loop];
   }
-  SInfo = new StubInfo;
-  if(!SInfo){
+  Page = new char[Largest];
+  if(!Page){
     SignalError(10);
     return(0);
   }
 
-  memset(First, 0, sizeof(UFDXPage));
-
-  success = RawReadPage(*First, 0);    // Fetch the stub "page"
-  memcpy(SInfo, (char *) First + 256, sizeof(StubInfo));
-  if(success){
-    memcpy(&UFirst, First, sizeof(UFirst));
+  strcpy(filename, IndexDir);
+  strcat(filename, SUMFILE);
+  Sums.SetName(filename);
+  Sums.SetFlags(FDNFileDestroy);
+  success = Sums.Open() && Sums.Write(&Header, sizeof(SumHeader), 1, 1);
+  for(loop = 0; success && loop < 3; loop++){
+    File = GetIndexFile((char) (NFDXIndex + loop));
+    success = File->Seek(0, SEEK_SET);
+    for(PageNo = 0; success && PageNo < Header.Pages[loop]; PageNo++){
+      success = File->Read(Page, Length[loop], 1, 1);
+      if(!loop && !PageNo) Header.CompileTime = ((StubInfo *) (Page + 256))->CompileTime;
+      Sum = FDNPageSum(Page, Length[loop]);
+      success = success && Sums.Write(&Sum, sizeof(unsigned long), 1, 1);
+    }
   }
-  // Validate the elements
-  if(UFirst.pagelen!=sizeof(UFDXPage)){
-    success = 0;
-    SignalError(27);
+  if(success){
+    memcpy(Header.Magic, "FDNS", 4);
+    success = Sums.Seek(0, SEEK_SET) && Sums.Write(&Header, sizeof(SumHeader), 1, 1);
   }
-  delete SInfo;
-  delete First;
+  if(!Sums.Close()) success = 0;
+  if(!success) remove(filename);
+  delete[] Page;
   return(success);
 }
 
 
 /*
-** See similar version above for more details
+**    DropSums
+**
+** Forgets the page sums read by ReadSums().
+**
 */
-FDNPREF int  FDNFUNC FrontDoorWNode::ReadPFDXStub()
+FDNPREF void FDNFUNC FrontDoorWNode::DropSums()
 {
-  int success;
-  StubInfo * SInfo;
-  PFDXPage * First;
-
-  First = new PFDXPage;
-  if(!First){
-    SignalError(10);
-    return(0);
-  }
-  SInfo = new StubInfo;
-  if(!SInfo){
-    SignalError(10);
-    return(0);
-  }
-
-  memset(First, 0, sizeof(PFDXPage));
+  int loop;
 
-  success = RawReadPage(*First, 0);    // Fetch the stub "page"
-  memcpy(SInfo, (char *) First + 256, sizeof(StubInfo));
-  if(success){
-    memcpy(&PFirst, First, sizeof(PFirst));
-  }
-  // Validate the elements
-  if(PFirst.pagelen!=sizeof(PFDXPage)){
-    SignalError(28);
-    success = 0;
+  for(loop = 0; loop < 3; loop++){
+    delete[] PageSum[loop];
+    PageSum[loop] = NULL;
+    SumPages[loop] = 0;
   }
-  delete SInfo;
-  delete First;
-  return(success);
 }
 
 
-FDNPREF int  FDNFUNC FrontDoorWNode::WritePFDAStub()
+/*
+**    KnownPage
+**
+** For use in OnThaw(), to tell whether a page held over from before the
+** last Freeze() is still the page of that number in the index set.
+**
+**    Returns
+**
+**    1 if the page is known to be unchanged; 0 otherwise
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::KnownPage(char Index, long PageNo, const void * Page)
 {
-  int success = 0;
-  
-  FirstPage * First = (FirstPage *) new char[sizeof(FDNPhoneRec)];
-  if(!First){
-    SignalError(10);
-    return(0);
-  }
-  memset(First, 0, sizeof(FDNPhoneRec));
-  First->flags = 0xFFFFFFFFUL;
-  First->pagelen = sizeof(FDNPhoneRec);
+  int Tree = Index - NFDXIndex;
 
-  success &= PFDA.Seek(0, SEEK_SET);
-  success &= PFDA.Write(First, sizeof(FDNPhoneRec), 1, 1);
-  
-  delete First;
-  return(success);
+  if(Tree < 0 || Tree > 2 || !PageSum[Tree] || PageNo <= 0 || PageNo >= SumPages[Tree]) return(0);
+  switch(Index){
+    case NFDXIndex : return(FDNPageSum(Page, sizeof(NFDXPage)) == PageSum[Tree][PageNo]);
+    case UFDXIndex : return(FDNPageSum(Page, sizeof(UFDXPage)) == PageSum[Tree][PageNo]);
+  }
+  return(FDNPageSum(Page, sizeof(PFDXPage)) == PageSum[Tree][PageNo]);
 }
 
 
@@ -1961,6 +3697,24 @@ FDNPREF unsigned long FDNFUNC FrontDoorWNode::Time(unsigned long * pTime)
 }
 
 
+/*
+**    GetTreeFlags
+**
+** Returns the information block for one of the trees, or NULL if the
+** index is not valid.
+**
+*/
+FDNPREF FDWNTreeInfo FDNFUNC *FrontDoorWNode::GetTreeFlags(char Index)
+{
+  switch(Index){
+    case NFDXIndex : return(&NInfo);
+    case UFDXIndex : return(&UInfo);
+    case PFDXIndex : return(&PInfo);
+  }
+  return(NULL);
+}
+
+
 FDNPREF void FDNFUNC FrontDoorWNode::SetTreeFlags(char Index, long Flags, char PromoteRecord)
 {
   if((PromoteRecord < 1) || (PromoteRecord > 31)) PromoteRecord = 16;
@@ -1981,6 +3735,373 @@ FDNPREF void FDNFUNC FrontDoorWNode::SetTreeFlags(char Index, long Flags, char P
 }
 
 
+/*
+**    GetTreeQuality
+**
+** Walks one of the trees from its root and reports how well packed it
+** is. Useful for judging the effect of SetTreeFlags(), and for deciding
+** when an index set would benefit from being rebuilt.
+**
+**    Parameters
+**
+**    Index   NFDXIndex, UFDXIndex or PFDXIndex
+**    Report  filled in with the height, page and record counts and the
+**            percentage of record slots in use
+**
+**    Returns
+**
+**    0 on failure (bad index or invalid page)
+**    1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::GetTreeQuality(char Index, FDWNTreeQuality & Report)
+{
+  long Links[MAXHEIGHT][33];
+  int  Count[MAXHEIGHT];
+  int  Child[MAXHEIGHT];
+  long LeafRecords = 0;
+  long Page;
+  int  Depth = 0;
+
+  memset(&Report, 0, sizeof(FDWNTreeQuality));
+  switch(Index){
+    case NFDXIndex : Page = NFirst.index; break;
+    case UFDXIndex : Page = UFirst.index; break;
+    case PFDXIndex : Page = PFirst.index; break;
+    default        : return(0);
+  }
+  if(!Page) return(1);    // Empty tree
+
+  Child[0] = 0;
+  if((Count[0] = GetPageLinks(Index, Page, Links[0], NULL)) < 0) return(0);
+  for(;;){
+    if(Child[Depth] == 0){
+      // First visit to this page, account for it
+      Report.Pages++;
+      Report.Records += Count[Depth];
+      if(Depth + 1 > Report.Height) Report.Height = Depth + 1;
+      if(!Links[Depth][0]){
+        Report.LeafPages++;
+        LeafRecords += Count[Depth];
+      }
+    }
+    if(!Links[Depth][0] || (Child[Depth] > Count[Depth])){
+      // Leaf, or all children visited
+      if(!Depth--) break;
+      continue;
+    }
+    Page = Links[Depth][Child[Depth]++];
+    if(++Depth >= MAXHEIGHT){
+      SignalError(31 + Index);  // 32, 33 or 34, invalid page
+      return(0);
+    }
+    Child[Depth] = 0;
+    if((Count[Depth] = GetPageLinks(Index, Page, Links[Depth], NULL)) < 0) return(0);
+  }
+
+  Report.FillFactor = (int) ((Report.Records * 100L) / (Report.Pages * 32L));
+  if(Report.LeafPages) Report.LeafFill = (int) ((LeafRecords * 100L) / (Report.LeafPages * 32L));
+  return(1);
+}
+
+
+/*
+**    Compact
+**
+** Rewrites one of the trees into fully packed pages. Incremental or
+** unordered compiles leave half empty pages scattered through the file
+** in the order in which they were split; this pass reads every record,
+** and writes a tree whose pages are as full as a B-tree allows, with
+** the records shared evenly so no page is left nearly empty.
+**
+** Pages are numbered breadth first: the root is page 1, followed by
+** the rest of its level, and so on down to the leaves. A descent from
+** the root therefore moves forward through the file, and the upper
+** levels sit together at the front where they are most likely to be
+** cached. The result is an ordinary index, readable by FrontDoor and
+** FrontDoorNode.
+**
+** All records are held in memory while the file is rewritten.
+**
+**    Parameters
+**
+**    Index   NFDXIndex, UFDXIndex or PFDXIndex
+**    Report  filled in with the tree shape and file size before and
+**            after, and the time taken to look up every key through
+**            the old and new trees
+**
+**    Returns
+**
+**    0 on failure
+**    1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::Compact(char Index, FDWNCompactReport & Report)
+{
+  long   LevelPages[MAXHEIGHT];   // Pages in each level, leaves are level 0
+  long   LevelBase[MAXHEIGHT];    // Page number of the first page in each level
+  long   Links[33];
+  long   Records, Key, Next, Child, Page, Share, Extra;
+  int    RecSize, Height, Level, Count, loop;
+  int    success = 1;
+  clock_t Start;
+  char * Store;
+  char * Buffer;
+  long * Sep;
+  FirstPage    * First;
+  FDWNTreeInfo * Info;
+
+  memset(&Report, 0, sizeof(FDWNCompactReport));
+  if(IsFrozen()){
+    SignalError(29);
+    return(0);
+  }
+  switch(Index){
+    case NFDXIndex : First = &NFirst; Info = &NInfo; break;
+    case UFDXIndex : First = &UFirst; Info = &UInfo; break;
+    case PFDXIndex : First = &PFirst; Info = &PInfo; break;
+    default        : return(0);
+  }
+  RecSize = GetRecordSize(Index);
+
+  // Get any derived cache onto the disk, much as SetCacheSize() does
+  OnFreeze();
+
+  if(!GetTreeQuality(Index, Report.Before)) return(0);
+  Report.BytesBefore = GetIndexFile(Index)->Size();
+  Records = Report.Before.Records;
+  if(!Records){
+    memcpy(&Report.After, &Report.Before, sizeof(FDWNTreeQuality));
+    Report.BytesAfter = Report.BytesBefore;
+    return(1);
+  }
+
+  // Work out the shape of the packed tree. With N records there must be
+  // (N+1)/33 leaves rounded up, each pair separated by a promoted record,
+  // and each level above needs one page per 33 children of the level below.
+  LevelPages[0] = (Records + 33L) / 33L;
+  for(Height = 1; LevelPages[Height - 1] > 1; Height++){
+    if(Height >= MAXHEIGHT){
+      SignalError(31 + Index);  // 32, 33 or 34, invalid page
+      return(0);
+    }
+    LevelPages[Height] = (LevelPages[Height - 1] + 32L) / 33L;
+  }
+  LevelBase[Height - 1] = 1;
+  for(Level = Height - 2; Level >= 0; Level--) LevelBase[Level] = LevelBase[Level + 1] + LevelPages[Level + 1];
+
+  Store  = new char[Records * RecSize];
+  Buffer = new char[32 * RecSize];
+  Sep    = new long[LevelPages[0]];
+  if(!Store || !Buffer || !Sep){
+    if(Store)  delete [] Store;
+    if(Buffer) delete [] Buffer;
+    if(Sep)    delete [] Sep;
+    SignalError(10);
+    return(0);
+  }
+
+  if(GetTreeRecords(Index, Store) != Records){
+    delete [] Store;
+    delete [] Buffer;
+    delete [] Sep;
+    return(0);
+  }
+
+  Start = clock();
+  for(Key = 0; Key < Records; Key++) ProbeRecord(Index, Store + Key * RecSize);
+  Report.ProbeBefore = clock() - Start;
+
+  // Throw away any cached pages of the old tree, and start the file again
+  OnThaw();
+  if(!ReopenIndex(Index)){
+    delete [] Store;
+    delete [] Buffer;
+    delete [] Sep;
+    return(0);
+  }
+  First->index   = 1;
+  Info->Pages    = LevelBase[0] + LevelPages[0] - 1;
+  Info->Level    = Height;
+  Info->Records  = Records;
+  Info->AppendRun = Info->PrependRun = 0;
+  Info->FreePage = 0;
+  switch(Index){
+    case NFDXIndex : success &= WriteNFDXStub(); break;
+    case UFDXIndex : success &= WriteUFDXStub(); break;
+    case PFDXIndex : success &= WritePFDXStub(); break;
+  }
+
+  // The leaves share the records evenly, with one record held back
+  // between each pair of leaves to be promoted to the level above.
+  memset(Links, 0, sizeof(Links));
+  Share = (Records - LevelPages[0] + 1) / LevelPages[0];
+  Extra = (Records - LevelPages[0] + 1) % LevelPages[0];
+  Key   = 0;
+  for(Page = 0; Page < LevelPages[0]; Page++){
+    Count = (int) (Share + (Page < Extra));
+    success &= PutPageRecords(Index, LevelBase[0] + Page, Store + Key * RecSize, Count, Links, 1);
+    Key += Count;
+    if(Page < LevelPages[0] - 1) Sep[Page] = Key++;
+  }
+
+  // Each level above shares the pages below it evenly as children, the
+  // promoted records falling between them. One record is again held back
+  // between each pair of pages, and Sep is reused in place for those.
+  for(Level = 1; Level < Height; Level++){
+    Share = LevelPages[Level - 1] / LevelPages[Level];
+    Extra = LevelPages[Level - 1] % LevelPages[Level];
+    Child = 0;
+    Next  = 0;
+    for(Page = 0; Page < LevelPages[Level]; Page++){
+      Count = (int) (Share + (Page < Extra)) - 1;
+      Links[0] = LevelBase[Level - 1] + Child++;
+      for(loop = 0; loop < Count; loop++){
+        memcpy(Buffer + loop * RecSize, Store + Sep[Next++] * RecSize, RecSize);
+        Links[loop + 1] = LevelBase[Level - 1] + Child++;
+      }
+      success &= PutPageRecords(Index, LevelBase[Level] + Page, Buffer, Count, Links, 1);
+      if(Page < LevelPages[Level] - 1) Sep[Page] = Sep[Next++];
+    }
+  }
+
+  Start = clock();
+  for(Key = 0; Key < Records; Key++) ProbeRecord(Index, Store + Key * RecSize);
+  Report.ProbeAfter = clock() - Start;
+
+  delete [] Store;
+  delete [] Buffer;
+  delete [] Sep;
+
+  if(!GetTreeQuality(Index, Report.After)) success = 0;
+  Report.BytesAfter = GetIndexFile(Index)->Size();
+  return(success);
+}
+
+
+/*
+**    GetSegment, SetSegment
+**
+** The index set records, for each source of records (the official
+** nodelist, private nodelist and pointlist, as told apart by Whence), a
+** hash of the file compiled and how many entries it gave. This lets a
+** compiler tell which sources have changed since the index set was made,
+** and rebuild only those (see DeleteSegment()). The writer does not work
+** out the hash itself, or check it in any way.
+**
+** The WFDNInternal slot is not used by any list, and compilers may use it
+** to track anything else the index set depends on; COMPILE keeps the hash
+** of FDNODE.CTL there.
+**
+**    Parameters
+**
+**    Whence    WFDNOfficial, WFDNPrivate, WFDNPoint or WFDNInternal
+**    Info      Filled in by GetSegment(), stored by SetSegment()
+**
+**    Returns
+**
+**    0 on failure (invalid Whence); 1 on success
+**
+*/
+FDNPREF int FDNFUNC FrontDoorWNode::GetSegment(long Whence, FDWNSegment & Info)
+{
+  int Slot = GetSegmentSlot(Whence);
+
+  if(Slot < 0) return(0);
+  memcpy(&Info, &Segment[Slot], sizeof(FDWNSegment));
+  return(1);
+}
+
+
+FDNPREF int FDNFUNC FrontDoorWNode::SetSegment(long Whence, FDWNSegment & Info)
+{
+  int Slot = GetSegmentSlot(Whence);
+
+  if(Slot < 0) return(0);
+  memcpy(&Segment[Slot], &Info, sizeof(FDWNSegment));
+  return(1);
+}
+
+
+/*
+**    DeleteSegment
+**
+** Removes every record from one source from NODELIST.FDX and USERLIST.FDX,
+** ready for that source to be compiled again, and clears its segment
+** information. Records from other sources are left where they are.
+**
+** Note that where a record from this source replaced one from another
+** (the same key appearing in both), the other is not brought back. The
+** Shadowed field of FDWNSegment is there to let a compiler see when this
+** matters.
+**
+**    Parameters
+**
+**    Whence    WFDNOfficial, WFDNPrivate, WFDNPoint or WFDNInternal
+**
+**    Returns
+**
+**    The number of records removed, or -1 on failure
+**
+*/
+FDNPREF long FDNFUNC FrontDoorWNode::DeleteSegment(long Whence)
+{
+  FDWNTreeQuality Quality;
+  char   Index;
+  int    RecSize;
+  int    Slot = GetSegmentSlot(Whence);
+  long   Records, Matched, loop;
+  long   Removed = 0;
+  unsigned long Offset;
+  char * Store;
+
+  if(IsFrozen()){
+    SignalError(29);
+    return(-1);
+  }
+  if(Slot < 0) return(-1);
+
+  for(Index = NFDXIndex; Index <= UFDXIndex; Index++){
+    if(!GetTreeQuality(Index, Quality)) return(-1);
+    if(!Quality.Records) continue;
+    RecSize = GetRecordSize(Index);
+    Store   = new char[Quality.Records * RecSize];
+    if(!Store){
+      SignalError(10);
+      return(-1);
+    }
+    Records = GetTreeRecords(Index, Store);
+    if(Records < 0){
+      delete [] Store;
+      return(-1);
+    }
+
+    // Keep only the records from this source. The offset, with the Whence
+    // in its top byte, comes first in the records of every tree.
+    for(loop = Matched = 0; loop < Records; loop++){
+      memcpy(&Offset, Store + loop * RecSize, sizeof(Offset));
+      if((Offset & 0xFF000000UL) == (unsigned long) Whence){
+        if(Matched != loop) memcpy(Store + Matched * RecSize, Store + loop * RecSize, RecSize);
+        Matched++;
+      }
+    }
+
+    for(loop = 0; loop < Matched; loop++){
+      if(!DeleteFromTree(Index, Store + loop * RecSize)){
+        delete [] Store;
+        return(-1);
+      }
+      GetTreeFlags(Index)->Records--;
+      Removed++;
+    }
+    delete [] Store;
+  }
+
+  memset(&Segment[Slot], 0, sizeof(FDWNSegment));
+  return(Removed);
+}
+
+
 FDNPREF    int FDNFUNC FrontDoorWNode::CheckCache(NFDXPage & , long ) { return(0); }
 FDNPREF    int FDNFUNC FrontDoorWNode::CommitCache(NFDXPage & , long ) { return(0); }
 FDNPREF    int FDNFUNC FrontDoorWNode::CheckCache(UFDXPage & , long ) { return(0); }
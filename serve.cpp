@@ -0,0 +1,182 @@
+/***************************************************************************/
+/*                                                                         */
+/* SERVE.CPP,                                                              */
+/*     a sample file for use with the FrontDoor Nodelist Code              */
+/*                                                                         */
+/* (c) 1997,1998 Colin Turner                                              */
+/*                                                                         */
+/* Please see FDNODE.DOC for details on the conditions attached to this    */
+/* code.                                                                   */
+/*                                                                         */
+/***************************************************************************/
+/*                                                                         */
+/* Without parameters, serves lookups on the nodelist over a named pipe    */
+/* until interrupted. Given an address (zone:net/node.point) or a name     */
+/* (surname first) it asks a running server instead, as a program which    */
+/* looks up a single node would.                                           */
+/*                                                                         */
+/***************************************************************************/
+
+#include "fdncache.h"   // Nodelist class declarations
+#include "fdnpipe.h"    // Lookup server and client
+#include "ctl.h"        // FrontDoor SETUP.FD structure
+#include <stdio.h>
+
+
+// Prototypes
+
+void            main(int argc, char *argv[]);
+void            PrintBanner();
+void            ReadFD(void);
+void            Serve(void);
+void            Ask(char * Key);
+
+
+char NAME[]="FDNode Serve";
+char VERSION[]="1.00";
+char FDNodelistDir[72]="";
+char FDSemaphoreDir[72]="";
+
+void main(int argc, char *argv[])
+{
+  ReadFD();
+
+  if(argc==1){
+    PrintBanner();
+    Serve();
+  }
+  else{
+    char Key[100]="";
+    int  loop;
+
+    // The name may have been given as several parameters
+    for(loop=1; loop<argc && strlen(Key)+strlen(argv[loop])<sizeof(Key)-1; loop++){
+      if(loop>1) strcat(Key, " ");
+      strcat(Key, argv[loop]);
+    }
+    Ask(Key);
+  }
+}
+
+
+void PrintBanner()
+{
+  printf("\nFrontDoor (TM) Nodelist Lookup Server, Version %s\nColin Turner, 2:443/13.0\nCompiled at %s on %s\n", VERSION, __TIME__, __DATE__);
+}
+
+
+/*
+**    Serve
+**
+** Opens the nodelist as any long running program would, and serves it.
+** AutoFreezeThaw() is called by the server as requests arrive, so a
+** compile is picked up without restarting.
+**
+**/
+void Serve(void)
+{
+  FDNCachedNode * Nodelist;
+  FDNPipeServer * Server;
+
+  Nodelist = new FDNCachedNode(FDNodelistDir, FDSemaphoreDir, FDNodeCreateFrozen | FDNodeWatch, 0);
+  if(!Nodelist){
+    printf("\nMemory allocation error");
+    exit(10);
+  }
+  Nodelist->SetWarmStart(1);
+  if(!Nodelist->Thaw()){
+    printf("\nError opening nodelist indices (error %d).", Nodelist->GetError());
+    printf("\nEither run this program in the nodelist directory, the FD system\nDirectory, or correctly set the FD environment variable.\n\n");
+    exit(1);
+  }
+
+  Server = new FDNPipeServer(*Nodelist);
+  if(!Server){
+    printf("\nMemory allocation error");
+    exit(10);
+  }
+  printf("\nServing FD nodelist in %s\n", FDNodelistDir);
+  if(!Server->Run()) printf("\nUnable to create the pipe, named pipes are not available.\n");
+
+  delete Server;
+  delete Nodelist;
+}
+
+
+/*
+**    Ask
+**
+** Looks up an address or a name with a running server, and prints the
+** answer.
+**
+**/
+void Ask(char * Key)
+{
+  FDNPipeClient Client(FDNodelistDir);
+  FDNPipeResult Result;
+  unsigned short Zone=0, Net=0, Node=0, Point=0;
+  int Found;
+
+  if(!Client.IsOpen()){
+    printf("\nNo server is running for %s\n", FDNodelistDir);
+    exit(2);
+  }
+  if(sscanf(Key, "%hu:%hu/%hu.%hu", &Zone, &Net, &Node, &Point)>=3) Found = Client.Find(Result, Zone, Net, Node, Point);
+  else Found = Client.Find(Result, Key);
+
+  if(!Found){
+    if(Result.Status==FDNPipeFrozen) printf("\nThe nodelist is being compiled, try again later\n");
+    else printf("\n%s not found\n", Key);
+    exit(1);
+  }
+  printf("\n%u:%u/%u.%u, %s, %s\n", Result.Zone, Result.Net, Result.Node, Result.Point, Result.SysName, Result.Location);
+  printf("Sysop %s\n", Result.Sysop);
+  printf("Number %s, Speed %lu, Flags %s\n", Result.Number, Result.Speed, Result.Flags);
+}
+
+
+/*
+**    ReadFD
+**
+** A highly non-sophisticated function which reads the NodelistDir from the
+** SETUP.FD FrontDoor configuration file.
+**
+** NO Macro Expansion is performed.
+**
+**/
+void ReadFD(void)
+{
+  FILE *fp;
+  char filename[72]="";
+  struct _ctl *fdsetup;
+
+  fdsetup = new _ctl;
+  if(!fdsetup){
+         printf("\nUnable to allocate memory for SETUP.FD\n");
+         exit(11);
+  }
+  if(getenv("FD")){
+         strcpy(filename, getenv("FD"));
+         if(filename[strlen(filename)-1]!='\\') strcat(filename, "\\");
+         strcat(filename,"SETUP.FD");
+  }
+  else strcpy(filename, "SETUP.FD");
+  fp=_fsopen(filename,"rb",SH_DENYWR);
+  if(fp){
+
+    if((fread(fdsetup,sizeof(struct _ctl),1,fp))!=1) printf("\n SETUP.FD read error (structure packing in compiler?)\n");
+    fclose(fp);
+
+    strcpy(FDNodelistDir, fdsetup->s.nodelistpath);
+    strcpy(FDSemaphoreDir, fdsetup->s.rescanpath);
+    if(!strlen(FDSemaphoreDir)) strcpy(FDSemaphoreDir, fdsetup->s.systempath);
+
+  }
+  else{
+    printf("\nSETUP.FD must be in the current directory, or pointed to by\nan FD environment variable\n");
+    delete fdsetup;
+    exit(11);
+  }
+  delete fdsetup;
+
+}